@@ -1,17 +1,43 @@
 /*
  * ATM System in C (with OpenSSL SHA-256 hashing, hidden PIN input, transaction logs)
- * Build (Linux/macOS):  gcc atm.c -o atm -lcrypto
- * Build (Windows, MinGW): gcc atm.c -o atm -lcrypto -lssl -lws2_32
+ * Build (Linux/macOS):  make            (or: gcc atm.c -o atm -lcrypto -lpthread
+ *                                            gcc atm_client.c -o atm_client)
+ * Benchmarks:           make bench      (see atm_bench.c)
+ * Server mode: ./atm --server [socket] [workers], then connect with ./atm_client [socket]
+ * Batch mode:  ./atm --batch [file]   runs server commands from a file (or stdin)
+ * The account store is memory-mapped (mmap), so a POSIX system is required.
+ * accounts.dat holds 64-byte records behind a versioned header; files in the
+ * older layout are migrated automatically the first time they are opened.
  *
- * First run: uncomment createSampleAccounts(); in main() to seed demo accounts, then re-run with it commented.
+ * Backups:    ./atm --backup <file> while sessions run, ./atm --restore <file> with none running
+ * Shards:     ATM_SHARDS=<n> spreads a new store over accounts.<k>.dat files;
+ *             ./atm --reshard <n> changes the count later
+ *
+ * First run: with no accounts.dat yet, main() seeds two demo accounts (createSampleAccounts()).
  */
 
+#define _GNU_SOURCE   // F_OFD_SETLKW
+
 #include <stdio.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include <openssl/sha.h>
 
@@ -19,80 +45,767 @@
   #include <conio.h>
 #else
   #include <termios.h>
-  #include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+  #include <linux/io_uring.h>
+  #include <sys/syscall.h>
+  #define ATM_IO_URING   // see I/O Ring
 #endif
 
 /* ======================= Data Model ======================= */
 
+/* One account record: exactly one 64-byte cache line, stored little-endian
+   in the account files (format version 2) and used in place from the mapping. */
 typedef struct {
-    int    accountNumber;
-    char   name[50];
-    char   pinHash[65];    // SHA-256 hex string (64 chars + null)
-    double balance;
-    int    failedAttempts; // wrong PIN attempts
-    int    locked;         // 0 ok, 1 locked
+    int32_t  accountNumber;
+    uint32_t failedAttempts : 4;   // wrong PIN attempts
+    uint32_t locked         : 1;   // 0 ok, 1 locked
+    uint32_t eodMark        : 1;   // set by the end-of-day run that posted it (see End of Day)
+    uint32_t writing        : 1;   // the mapped record is being rewritten (see Storage)
+    uint32_t version        : 25;  // bumped by every commit; wraps
+    int64_t  balanceCents;
+    uint8_t  pinHash[32];          // raw SHA-256 digest
+    char     name[16];             // NUL-terminated, so at most 15 characters
 } Account;
 
+_Static_assert(sizeof(Account) == 64, "Account must fill one cache line");
+
+#define ACCOUNT_NAME_MAX 15   /* characters that fit in Account.name */
+
+/* Largest single amount or opening balance accepted; keeps cent arithmetic
+   far from int64 overflow and exact in a double. */
+#define MAX_AMOUNT 1e12
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+  #error "accounts.dat is little-endian and mapped directly"
+#endif
+
+/* Outcome of an ATM operation; atmStatusText() gives the user-facing message. */
+typedef enum {
+    ATM_OK = 0,
+    ATM_ERR_INPUT,
+    ATM_ERR_NOT_FOUND,
+    ATM_ERR_LOCKED,
+    ATM_ERR_BAD_PIN,
+    ATM_ERR_NOW_LOCKED,
+    ATM_ERR_WRONG_PIN,
+    ATM_ERR_PIN_SHORT,
+    ATM_ERR_AMOUNT,
+    ATM_ERR_FUNDS,
+    ATM_ERR_SAME_ACCOUNT,
+    ATM_ERR_NO_TARGET,
+    ATM_ERR_TARGET_LOCKED,
+    ATM_ERR_EXISTS,
+    ATM_ERR_HASH,
+    ATM_ERR_IO,
+    ATM_ERR_FILE,
+    ATM_ERR_NO_FILE,
+    ATM_ERR_BUSY,
+    ATM_ERR_POSTED,
+    ATM_ERR_CONFLICT,
+    ATM_ERR_NOT_BACKUP,
+    ATM_ERR_SHARDS,
+    ATM_ERR_NAME_LONG
+} AtmStatus;
+
+typedef enum {
+    TX_DEPOSIT = 1,
+    TX_WITHDRAW,
+    TX_TRANSFER_OUT,
+    TX_TRANSFER_IN,
+    TX_PIN_CHANGE,
+    TX_INTEREST,
+    TX_FEE
+} TxType;
+
+/* One transaction log entry; fixed 64 bytes on disk. */
+typedef struct {
+    int32_t  accountNumber;
+    uint16_t type;          // TxType
+    uint16_t reserved;
+    int64_t  timestamp;     // seconds since the epoch
+    int64_t  amountCents;
+    int64_t  balanceCents;  // balance after the transaction
+    int64_t  prev;          // log position of the account's previous record, -1 if none
+    char     note[24];      // not necessarily NUL-terminated
+} TxRecord;
+
+typedef struct {
+    FILE    *fp;
+    uint32_t seq;           // segment being read
+    uint32_t lastSeq;
+} TxLogReader;
+
+/* A date-range statement (see Statement queries): the account's records with
+   from <= timestamp <= to whose type bit (1u << TxType) is in types, or of
+   any type when types is 0. */
+typedef enum { STMT_TEXT, STMT_CSV, STMT_JSON } StmtFormat;
+typedef struct {
+    int64_t    from, to;
+    unsigned   types;
+    StmtFormat format;
+} StmtQuery;
+
+/* Which accounts an admin report lists, and in what order (see Reports). */
+typedef enum { REPORT_ALL, REPORT_LOCKED, REPORT_ATTEMPTS } ReportFilter;
+typedef enum { REPORT_BY_BALANCE, REPORT_BY_BALANCE_ASC, REPORT_BY_ATTEMPTS, REPORT_BY_NUMBER } ReportSort;
+
 /* ======================= Prototypes ======================= */
 void   createSampleAccounts(void);
-bool   sha256_hex(const char *input, char out_hex[65]);
+bool   sha256_digest(const char *input, uint8_t out[32]);
 void   get_hidden_input(char *buf, size_t sz);
 void   flush_line(void);
 
 const char* accountsFile(void);
+const char* indexFile(void);
+void   shardFile(unsigned k, unsigned shards, char *buf, size_t n);        // accounts.<k>.dat
+void   shardIndexFile(unsigned k, unsigned shards, char *buf, size_t n);   // accounts.<k>.idx
+
+bool   storeOpen(void);
+void   storeClose(void);
+bool   storeSync(void);
+size_t storeCount(void);
+Account* storeAt(size_t i);
+Account* accountRef(int accountNumber);     // record in place, NULL if absent
 
 bool   loadAccount(int accountNumber, Account *out);
 bool   updateAccount(const Account *acc);
 bool   appendAccount(const Account *acc);     // for admin create
+long   appendAccounts(Account *accs, long n, bool *taken);   // bulk import
 bool   accountExists(int accountNumber);
 
+const char* journalFile(void);
+bool   walOpen(void);
+void   walClose(void);
+bool   walCheckpoint(void);
+bool   commitAccounts(const Account *const *accs, int n);   // one durable record
+AtmStatus commitIfCurrent(Account *const *accs, int n);    // compare-and-swap on version
+bool   cacheFlush(void);                                   // write-back cache -> journal
+
+bool   indexRebuild(void);
+bool   indexLookup(int accountNumber, long *offset);
+void   nameIndexEnable(void);                 // build the name index now, not at the first search
+
+void   lockAccount(int accountNumber);
+void   unlockAccount(int accountNumber);
+void   lockAccountPair(int a, int b);
+void   unlockAccountPair(int a, int b);
+
+/* Operations (no terminal I/O) */
+const char* atmStatusText(AtmStatus st);
+AtmStatus opCheckLogin(int accountNumber);
+AtmStatus opLogin(int accountNumber, const char *pin, Account *out);
+AtmStatus opBalance(Account *user);
+AtmStatus opDeposit(Account *user, double amount);
+AtmStatus opWithdraw(Account *user, double amount);
+AtmStatus opChangePin(Account *user, const char *oldPin, const char *newPin);
+AtmStatus opCheckTarget(const Account *user, int toAcc);
+AtmStatus opTransfer(Account *user, int toAcc, double amount);
+bool      adminPasswordOk(const char *pass);
+AtmStatus opCreateAccount(int accountNumber, const char *name, const char *pin, double balance, Account *out);
+AtmStatus opUnlockAccount(int accountNumber);
+AtmStatus opResetPin(int accountNumber, const char *newPin);
+AtmStatus opExportLog(int accountNumber, const char *path, long *count);
+AtmStatus opImportAccounts(const char *path, FILE *report, const char *prefix, long *accepted, long *rejected);
+AtmStatus opBackup(const char *path, uint64_t *accounts, int64_t *logPos, long *redone);
+AtmStatus opRestore(const char *path, uint64_t *accounts, int64_t *logPos, long *rolled);
+AtmStatus opReshard(unsigned shards, uint64_t *accounts, long *redone);
+AtmStatus opSearchAccounts(const char *name, int page, Account *out, int *n, long *total);
+void   writeAccountList(FILE *out, const char *prefix);
+AtmStatus writeAccountSearch(FILE *out, const char *prefix, const char *name, int page, long *total);
+AtmStatus writeReport(FILE *out, const char *prefix, ReportFilter filter, ReportSort sort,
+                      int page, int threads, long *pages);
+void   writeMiniStatement(FILE *out, const char *prefix, int accountNumber, int lastN);
+bool   parseStmtQuery(const char *from, const char *to, const char *format, const char *types, StmtQuery *q);
+AtmStatus writeStatementRange(FILE *out, const char *prefix, int accountNumber, const StmtQuery *q, long *count);
+void   writeStats(FILE *out, const char *prefix);
+
+const char* statsFile(void);
+bool   statsDump(void);
+void   statsWatchSignal(void);
+
+int    runServer(const char *path, int workers);
+int    runBatch(const char *path);
+int    runEndOfDay(const char *rulesPath, int threads);
+int    runReconcile(int threads);
+int    runBulkTransfer(const char *path, const char *resultsPath);
+long   bulkRecover(void);                       // walOpen(): redo an interrupted bulk run
+int    runBackup(const char *path);
+int    runRestore(const char *path);            // before storeOpen(), with no other process running
+int    runReshard(unsigned shards);
+
 bool   login(Account *outUser);
 void   resetFailedAttempts(Account *user);
 
 void   atmMenu(Account *user);
-void   balanceInquiry(const Account *user);
+void   balanceInquiry(Account *user);
 void   deposit(Account *user);
 void   withdraw(Account *user);
 void   changePin(Account *user);
 void   transferFunds(Account *user);          // NEW
+void   statementByDate(Account *user);
 
-void   logTransaction(const Account *user, const char *type, double amount, const char *note);
+void   logTransaction(const Account *user, TxType type, int64_t amountCents, const char *note);
 void   showMiniStatement(const Account *user, int lastN); // NEW
 
+const char* txTypeName(int type);
+int64_t toCents(double amount);
+char*  fmtCents(int64_t cents, char buf[24]);
+void   txSegmentPath(uint32_t seq, char *buf, size_t n);
+bool   txlogSegmentRange(uint32_t *first, uint32_t *last);
+bool   txlogAppend(const TxRecord *rec);
+void   txlogDrain(void);                        // wait for the writer thread
+void   txlogRingCounters(uint64_t *fullWaits, uint64_t *failed);
+void   bloomCounters(uint64_t *ruledOut, uint64_t *falsePos);
+void   ioRingCounters(bool *enabled, const char **why, uint64_t *submits, uint64_t *writes, uint64_t *syncs);
+void   txlogClose(void);
+bool   txlogReaderOpen(TxLogReader *r);
+bool   txlogNext(TxLogReader *r, TxRecord *out);
+void   txlogReaderClose(TxLogReader *r);
+bool   txlogScanBackward(bool (*visit)(const TxRecord *rec, void *ctx), void *ctx);
+int    txlogLastN(int accountNumber, int n, TxRecord *out);
+int    txFormatLine(const TxRecord *rec, char *buf, size_t n);
+long   txlogExportText(FILE *out, int accountNumber);
+
 /* Admin */
 bool   adminLogin(void);
 void   adminMenu(void);
 void   adminCreateAccount(void);
 void   adminListAccounts(void);
+void   adminSearchAccounts(void);
+void   adminReports(void);
+void   adminAccountHistory(void);
 void   adminUnlockAccount(void);
 void   adminResetPin(void);
+void   adminExportLog(void);
+void   adminImportAccounts(void);
+void   adminShowStats(void);
+void   adminBackup(void);
+void   adminReshard(void);
+
+/* ======================= Metrics ======================= */
+/*
+ * Latency histograms and file I/O counters for the main operations. They
+ * are shown by the admin menu (Statistics) and the server's STATS command,
+ * and written to atm.stats on exit or when the process gets SIGUSR1.
+ *
+ * Histograms use the HdrHistogram layout: 8 sub-buckets per power of two
+ * nanoseconds, about 12% precision. Recording costs a few shifts and
+ * relaxed atomic adds. File I/O is charged to every instrumented operation
+ * running on the thread, so a transfer's journal write also counts for
+ * commitAccounts. I/O outside any operation (background threads, startup)
+ * is reported on its own. A submission to the I/O ring counts once, under
+ * rings, however many writes and syncs it carries, so the columns add up
+ * to the system calls made.
+ */
+typedef enum {
+    ST_LOGIN, ST_DEPOSIT, ST_WITHDRAW, ST_TRANSFER, ST_STATEMENT,
+    ST_LOAD, ST_COMMIT, ST_LOG, ST_SHA256, ST_SEARCH, ST_OTHER, ST_COUNT
+} StatOp;
+
+typedef enum { IO_OPEN, IO_READ, IO_WRITE, IO_SYNC, IO_RING, IO_KINDS } IoKind;
+
+static const char *const statOpNames[ST_COUNT] = {
+    "login", "deposit", "withdraw", "transfer", "statement",
+    "loadAccount", "commitAccounts", "logTransaction", "sha256", "search", "other"
+};
+
+#define HIST_SUB_BITS 3
+#define HIST_BUCKETS  (64 << HIST_SUB_BITS)
+
+typedef struct {
+    uint64_t count, sumNs, maxNs;
+    uint64_t io[IO_KINDS];
+    uint64_t hist[HIST_BUCKETS];
+} OpStats;
+
+static OpStats g_stats[ST_COUNT];
+static __thread uint32_t t_statActive;   // bit per StatOp running on this thread
+
+typedef struct {
+    uint64_t t0;
+    uint32_t saved;   // t_statActive before this scope
+    StatOp   op;
+} StatScope;
+
+static uint64_t monoNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned histBucket(uint64_t v) {
+    if (v < (1u << HIST_SUB_BITS)) return (unsigned)v;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(v);
+    return ((msb - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+           (unsigned)((v >> (msb - HIST_SUB_BITS)) & ((1u << HIST_SUB_BITS) - 1));
+}
+
+/* Middle of the range of values bucket b counts. */
+static uint64_t histValue(unsigned b) {
+    if (b < (1u << HIST_SUB_BITS)) return b;
+    unsigned shift = (b >> HIST_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)((1u << HIST_SUB_BITS) + (b & ((1u << HIST_SUB_BITS) - 1))) << shift;
+    return low + (((uint64_t)1 << shift) >> 1);
+}
+
+static StatScope statBegin(StatOp op) {
+    StatScope s = { monoNs(), t_statActive, op };
+    t_statActive |= 1u << op;
+    return s;
+}
+
+static void statEnd(StatScope *s) {
+    uint64_t ns = monoNs() - s->t0;
+    OpStats *st = &g_stats[s->op];
+    __atomic_add_fetch(&st->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&st->sumNs, ns, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&st->hist[histBucket(ns)], 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&st->maxNs, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&st->maxNs, &max, ns, true,
+                                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { /* retry */ }
+    t_statActive = s->saved;
+}
+
+/* Times the rest of the enclosing block, whichever way it is left. */
+#define STAT_SCOPE(op) StatScope statScope_ __attribute__((cleanup(statEnd))) = statBegin(op)
+
+/* Counts one open/read/write/sync call (or ring submission) on the accounts,
+   journal or log files. */
+static void statIo(IoKind kind) {
+    uint32_t active = t_statActive ? t_statActive : 1u << ST_OTHER;
+    while (active) {
+        int op = __builtin_ctz(active);
+        active &= active - 1;
+        __atomic_add_fetch(&g_stats[op].io[kind], 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* The accounts, journal and log file calls go through these, so statIo
+   sees them. */
+#define ioOpen(...)     (statIo(IO_OPEN), open(__VA_ARGS__))
+#define ioFopen(...)    (statIo(IO_OPEN), fopen(__VA_ARGS__))
+#define ioPread(...)    (statIo(IO_READ), pread(__VA_ARGS__))
+#define ioFread(...)    (statIo(IO_READ), fread(__VA_ARGS__))
+#define ioPwrite(...)   (statIo(IO_WRITE), pwrite(__VA_ARGS__))
+#define ioWrite(...)    (statIo(IO_WRITE), write(__VA_ARGS__))
+#define ioFwrite(...)   (statIo(IO_WRITE), fwrite(__VA_ARGS__))
+#define ioFdatasync(fd) (statIo(IO_SYNC), fdatasync(fd))
+#define ioFsync(fd)     (statIo(IO_SYNC), fsync(fd))
+#define ioMsync(...)    (statIo(IO_SYNC), msync(__VA_ARGS__))
+
+const char* statsFile(void) {
+    return "atm.stats";
+}
+
+/* Value at quantile q (0..1) of a snapshot of hist with n samples, in us;
+   max keeps a bucket's midpoint from overshooting the largest sample. */
+static double histQuantile(const uint64_t *hist, uint64_t n, double q, uint64_t max) {
+    uint64_t rank = (uint64_t)(q * (double)n + 0.5), seen = 0;
+    if (rank == 0) rank = 1;
+    for (unsigned b = 0; b < HIST_BUCKETS; ++b) {
+        seen += hist[b];
+        if (seen >= rank) {
+            uint64_t v = histValue(b);
+            return (double)(v < max ? v : max) / 1000.0;
+        }
+    }
+    return (double)max / 1000.0;
+}
+
+void writeStats(FILE *out, const char *prefix) {
+    static uint64_t hist[HIST_BUCKETS];   // snapshot; callers are not hot
+    static pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&mu);
+
+    fprintf(out, "%s--- Latency (us) and file I/O per call ---\n", prefix);
+    fprintf(out, "%s%-15s %8s %9s %9s %9s %9s %9s %6s %6s %6s %6s %6s\n", prefix, "operation", "count",
+            "mean", "p50", "p90", "p99", "max", "opens", "reads", "writes", "syncs", "rings");
+    for (int op = 0; op < ST_OTHER; ++op) {
+        const OpStats *st = &g_stats[op];
+        uint64_t n = 0;
+        for (unsigned b = 0; b < HIST_BUCKETS; ++b) {
+            hist[b] = __atomic_load_n(&st->hist[b], __ATOMIC_RELAXED);
+            n += hist[b];
+        }
+        if (n == 0) continue;
+        double per = 1.0 / (double)n;
+        uint64_t max = __atomic_load_n(&st->maxNs, __ATOMIC_RELAXED);
+        fprintf(out, "%s%-15s %8llu %9.2f %9.2f %9.2f %9.2f %9.2f %6.2f %6.2f %6.2f %6.2f %6.2f\n", prefix,
+                statOpNames[op], (unsigned long long)n,
+                (double)__atomic_load_n(&st->sumNs, __ATOMIC_RELAXED) * per / 1000.0,
+                histQuantile(hist, n, 0.50, max),
+                histQuantile(hist, n, 0.90, max),
+                histQuantile(hist, n, 0.99, max),
+                (double)max / 1000.0,
+                (double)__atomic_load_n(&st->io[IO_OPEN], __ATOMIC_RELAXED) * per,
+                (double)__atomic_load_n(&st->io[IO_READ], __ATOMIC_RELAXED) * per,
+                (double)__atomic_load_n(&st->io[IO_WRITE], __ATOMIC_RELAXED) * per,
+                (double)__atomic_load_n(&st->io[IO_SYNC], __ATOMIC_RELAXED) * per,
+                (double)__atomic_load_n(&st->io[IO_RING], __ATOMIC_RELAXED) * per);
+    }
+    const OpStats *bg = &g_stats[ST_OTHER];
+    fprintf(out, "%sOutside operations (background threads, startup): %llu opens, %llu reads, %llu writes, %llu syncs, %llu rings\n",
+            prefix,
+            (unsigned long long)__atomic_load_n(&bg->io[IO_OPEN], __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&bg->io[IO_READ], __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&bg->io[IO_WRITE], __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&bg->io[IO_SYNC], __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&bg->io[IO_RING], __ATOMIC_RELAXED));
+    bool ringOn;
+    const char *ringWhy;
+    uint64_t submits, ringWrites, ringSyncs;
+    ioRingCounters(&ringOn, &ringWhy, &submits, &ringWrites, &ringSyncs);
+    if (ringOn || submits > 0) {
+        fprintf(out, "%sI/O ring: %llu submission(s) carrying %llu write(s) and %llu sync(s)%s%s\n",
+                prefix, (unsigned long long)submits, (unsigned long long)ringWrites,
+                (unsigned long long)ringSyncs, ringOn ? "" : "; now off: ", ringOn ? "" : ringWhy);
+    } else {
+        fprintf(out, "%sI/O ring: off (%s); plain writes and syncs\n", prefix, ringWhy);
+    }
+    uint64_t fullWaits, failed;
+    txlogRingCounters(&fullWaits, &failed);
+    fprintf(out, "%sTransaction log ring: %llu full wait(s), %llu failed append(s)\n",
+            prefix, (unsigned long long)fullWaits, (unsigned long long)failed);
+    uint64_t ruledOut, falsePos;
+    bloomCounters(&ruledOut, &falsePos);
+    fprintf(out, "%sAccount filter: %llu miss(es) ruled out, %llu false positive(s) (%.2f%% of misses)\n",
+            prefix, (unsigned long long)ruledOut, (unsigned long long)falsePos,
+            ruledOut + falsePos ? 100.0 * (double)falsePos / (double)(ruledOut + falsePos) : 0.0);
+    pthread_mutex_unlock(&mu);
+}
+
+/* Writes the statistics to atm.stats (replaced atomically). */
+bool statsDump(void) {
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", statsFile());
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return false;
+
+    char when[32];
+    time_t now = time(NULL);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm_info);
+    fprintf(fp, "ATM statistics of process %d at %s\n", (int)getpid(), when);
+    writeStats(fp, "");
+    bool ok = fclose(fp) == 0 && rename(tmp, statsFile()) == 0;
+    if (!ok) remove(tmp);
+    return ok;
+}
+
+static void* statsSignalWaiter(void *arg) {
+    const sigset_t *set = (const sigset_t*)arg;
+    for (;;) {
+        int sig;
+        if (sigwait(set, &sig) == 0) (void)statsDump();
+    }
+    return NULL;
+}
+
+/* Dumps the statistics whenever SIGUSR1 arrives. Call before any other
+   thread starts, so they all inherit the blocked signal. */
+void statsWatchSignal(void) {
+    static sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL) != 0) return;
+    pthread_t t;
+    if (pthread_create(&t, NULL, statsSignalWaiter, &set) == 0) pthread_detach(t);
+}
+
+/* ======================= I/O Ring ======================= */
+/*
+ * Writes that must reach the disk together - a journal group commit, an
+ * account append, a bulk-transfer block - go out as one io_uring submission:
+ * the writes linked to the fdatasync that covers them, handed to the kernel
+ * and waited for with a single io_uring_enter(). A group commit costs one
+ * system call instead of a write() and an fdatasync(); a bulk block one
+ * instead of four. Concurrent operations already share these through the
+ * journal's group commit, so under load the calls per operation fall with
+ * the batch size.
+ *
+ * The ring is set up with the raw system calls (no liburing), one per
+ * thread that writes, since a ring's queues belong to one submitter. Where
+ * the kernel has no io_uring, or refuses it (seccomp, io_uring_disabled),
+ * or ATM_IO=sync is set, the same calls fall back to pwrite()/write() and
+ * fdatasync(). A write the ring leaves short or cancelled is finished the
+ * same way, so callers never see the difference.
+ */
+#define IORING_ENTRIES 8   // writes plus the sync of the largest submission
+
+typedef struct {
+    const void *buf;
+    size_t      len;
+    off_t       off;   // < 0: append (the file is O_APPEND)
+} IoChunk;
+
+static struct {
+    pthread_once_t once;
+    pthread_key_t  key;        // this thread's IoRing
+    bool           enabled;    // false: every call takes the fallback
+    const char    *why;        // why it is off
+    uint64_t       submits, writes, syncs;
+} g_ioRing = { PTHREAD_ONCE_INIT, 0, false, "not started", 0, 0, 0 };
+
+#ifdef ATM_IO_URING
+typedef struct {
+    int                  fd;
+    void                *sqMap, *cqMap;
+    size_t               sqLen, cqLen, sqesLen;
+    unsigned            *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned            *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+} IoRing;
+
+static void ringFree(void *arg) {
+    IoRing *r = (IoRing*)arg;
+    if (r->sqes) munmap(r->sqes, r->sqesLen);
+    if (r->cqMap && r->cqMap != r->sqMap) munmap(r->cqMap, r->cqLen);
+    if (r->sqMap) munmap(r->sqMap, r->sqLen);
+    if (r->fd >= 0) close(r->fd);
+    free(r);
+}
+
+/* Off on a failure, for every thread: the kernel would refuse the others too. */
+static void ringDisable(const char *why) {
+    __atomic_store_n(&g_ioRing.why, why, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_ioRing.enabled, false, __ATOMIC_RELEASE);
+}
+
+static IoRing* ringSetup(void) {
+    IoRing *r = (IoRing*)calloc(1, sizeof(IoRing));
+    if (!r) return NULL;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, IORING_ENTRIES, &p);
+    if (r->fd < 0) {
+        ringDisable(errno == ENOSYS ? "no io_uring in this kernel" : "io_uring refused");
+        ringFree(r);
+        return NULL;
+    }
+
+    r->sqLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && r->cqLen > r->sqLen) r->sqLen = r->cqLen;
+    r->sqMap = mmap(NULL, r->sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sqMap == MAP_FAILED) r->sqMap = NULL;
+    r->cqMap = single ? r->sqMap :
+               mmap(NULL, r->cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cqMap == MAP_FAILED) r->cqMap = NULL;
+    r->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqesLen, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) r->sqes = NULL;
+    if (!r->sqMap || !r->cqMap || !r->sqes) {
+        ringDisable("io_uring rings could not be mapped");
+        ringFree(r);
+        return NULL;
+    }
+
+    char *sq = (char*)r->sqMap, *cq = (char*)r->cqMap;
+    r->sqHead = (unsigned*)(sq + p.sq_off.head);
+    r->sqTail = (unsigned*)(sq + p.sq_off.tail);
+    r->sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sqArray = (unsigned*)(sq + p.sq_off.array);
+    r->cqHead = (unsigned*)(cq + p.cq_off.head);
+    r->cqTail = (unsigned*)(cq + p.cq_off.tail);
+    r->cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return r;
+}
+
+/* This thread's ring, set up on first use; NULL if the ring is off. */
+static IoRing* ringGet(void) {
+    if (!__atomic_load_n(&g_ioRing.enabled, __ATOMIC_ACQUIRE)) return NULL;
+    IoRing *r = (IoRing*)pthread_getspecific(g_ioRing.key);
+    if (r) return r;
+    r = ringSetup();
+    if (r && pthread_setspecific(g_ioRing.key, r) != 0) { ringFree(r); r = NULL; }
+    return r;
+}
+
+static void sqePush(IoRing *r, unsigned *tail, uint8_t opcode, int fd, uint64_t user) {
+    unsigned i = *tail & *r->sqMask;
+    struct io_uring_sqe *sqe = &r->sqes[i];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user;
+    r->sqArray[i] = i;
+    (*tail)++;
+}
+
+/* Submits the chunks (and the sync) as one linked chain and waits for all
+   of it. res[i] is chunk i's result, res[n] the sync's. False if nothing
+   could be submitted. */
+static bool ringRun(IoRing *r, int fd, const IoChunk *c, int n, bool sync, int *res) {
+    unsigned tail = *r->sqTail;
+    int want = n + (sync ? 1 : 0);
+    for (int i = 0; i < want; ++i) {
+        struct io_uring_sqe *sqe = &r->sqes[tail & *r->sqMask];
+        if (i < n) {
+            sqePush(r, &tail, IORING_OP_WRITE, fd, (uint64_t)i);
+            sqe->addr = (uint64_t)(uintptr_t)c[i].buf;
+            sqe->len = (uint32_t)c[i].len;
+            sqe->off = c[i].off < 0 ? (uint64_t)-1 : (uint64_t)c[i].off;
+        } else {
+            sqePush(r, &tail, IORING_OP_FSYNC, fd, (uint64_t)i);
+            sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        }
+        if (i + 1 < want) sqe->flags = IOSQE_IO_LINK;   // each waits for the one before
+    }
+    __atomic_store_n(r->sqTail, tail, __ATOMIC_RELEASE);
+
+    int submit = want, got = 0;
+    while (got < want) {
+        int rc = (int)syscall(__NR_io_uring_enter, r->fd, (unsigned)submit, (unsigned)(want - got),
+                              IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0 && errno != EINTR) {
+            if (submit > 0) {
+                // the entries are still queued: drop them with the ring
+                ringDisable("io_uring_enter failed");
+                return false;
+            }
+            continue;
+        }
+        if (rc > 0) submit -= rc < submit ? rc : submit;
+        unsigned head = *r->cqHead;
+        while (head != __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE)) {
+            const struct io_uring_cqe *cqe = &r->cqes[head & *r->cqMask];
+            if (cqe->user_data < (uint64_t)want) res[cqe->user_data] = cqe->res;
+            head++;
+            got++;
+        }
+        __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+    }
+    __atomic_add_fetch(&g_ioRing.submits, 1, __ATOMIC_RELAXED);
+    statIo(IO_RING);
+    return true;
+}
+#endif
+
+static void ringInit(void) {
+    const char *mode = getenv("ATM_IO");
+#ifdef ATM_IO_URING
+    bool off = mode && strcmp(mode, "sync") == 0;
+    g_ioRing.why = off ? "ATM_IO=sync" : NULL;
+    g_ioRing.enabled = !off && pthread_key_create(&g_ioRing.key, ringFree) == 0;
+    if (!off && !g_ioRing.enabled) g_ioRing.why = "no thread key";
+#else
+    (void)mode;
+    g_ioRing.why = "built without io_uring";
+#endif
+}
+
+/* Writes what is left of a chunk from byte done on, with plain calls. */
+static bool ioChunkFinish(int fd, const IoChunk *c, size_t done) {
+    while (done < c->len) {
+        const char *p = (const char*)c->buf + done;
+        ssize_t w = c->off < 0 ? ioWrite(fd, p, c->len - done)
+                               : ioPwrite(fd, p, c->len - done, c->off + (off_t)done);
+        if (w <= 0) return false;
+        done += (size_t)w;
+    }
+    return true;
+}
+
+/* Writes n chunks to fd in order and, if sync, makes them durable with
+   fdatasync(); true once all of it is done. More chunks than one submission
+   holds go in groups, with the sync after the last. */
+static bool ioWriteChunks(int fd, const IoChunk *c, int n, bool sync) {
+    if (n + 1 > IORING_ENTRIES) {
+        for (int i = 0; i < n; i += IORING_ENTRIES - 1) {
+            int take = n - i < IORING_ENTRIES - 1 ? n - i : IORING_ENTRIES - 1;
+            if (!ioWriteChunks(fd, c + i, take, sync && i + take == n)) return false;
+        }
+        return true;
+    }
+
+    pthread_once(&g_ioRing.once, ringInit);
+    int res[IORING_ENTRIES];   // one per chunk, then the sync's
+    bool ran = false;
+#ifdef ATM_IO_URING
+    IoRing *r = ringGet();
+    ran = r && ringRun(r, fd, c, n, sync, res);
+#endif
+    if (!ran) {
+        for (int i = 0; i <= n; ++i) res[i] = 0;
+    } else {
+        __atomic_add_fetch(&g_ioRing.writes, (uint64_t)n, __ATOMIC_RELAXED);
+        if (sync) __atomic_add_fetch(&g_ioRing.syncs, 1, __ATOMIC_RELAXED);
+    }
+
+    // whatever the ring did not finish (short, cancelled or failed) goes the plain way
+    bool ok = true, unsupported = false;
+    for (int i = 0; ok && i < n; ++i) {
+        if (res[i] == -EINVAL || res[i] == -EOPNOTSUPP) unsupported = true;
+        if (ran && res[i] == (int)c[i].len) continue;
+        ok = ioChunkFinish(fd, &c[i], res[i] > 0 ? (size_t)res[i] : 0);
+    }
+    if (ok && sync && !(ran && res[n] == 0)) {
+        if (ran && (res[n] == -EINVAL || res[n] == -EOPNOTSUPP)) unsupported = true;
+        ok = ioFdatasync(fd) == 0;
+    }
+#ifdef ATM_IO_URING
+    if (unsupported) ringDisable("io_uring lacks write or fsync");
+#else
+    (void)unsupported;
+#endif
+    return ok;
+}
+
+/* Whether the ring is on, and how much it carried, for the statistics. */
+void ioRingCounters(bool *enabled, const char **why, uint64_t *submits, uint64_t *writes, uint64_t *syncs) {
+    pthread_once(&g_ioRing.once, ringInit);
+    *enabled = __atomic_load_n(&g_ioRing.enabled, __ATOMIC_ACQUIRE);
+    *why = __atomic_load_n(&g_ioRing.why, __ATOMIC_RELAXED);
+    *submits = __atomic_load_n(&g_ioRing.submits, __ATOMIC_RELAXED);
+    *writes = __atomic_load_n(&g_ioRing.writes, __ATOMIC_RELAXED);
+    *syncs = __atomic_load_n(&g_ioRing.syncs, __ATOMIC_RELAXED);
+}
 
 /* ======================= Helpers ======================= */
 const char* accountsFile(void) {
     return "accounts.dat";
 }
 
+const char* indexFile(void) {
+    return "accounts.idx";
+}
+
 void flush_line(void) {
     int c;
     while ((c = getchar()) != '\n' && c != EOF) { /* discard */ }
 }
 
-bool sha256_hex(const char *input, char out_hex[65]) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
+bool sha256_digest(const char *input, uint8_t out[32]) {
+    STAT_SCOPE(ST_SHA256);
     SHA256_CTX ctx;
     if (!SHA256_Init(&ctx)) return false;
     if (!SHA256_Update(&ctx, (const unsigned char*)input, strlen(input))) return false;
-    if (!SHA256_Final(hash, &ctx)) return false;
+    return SHA256_Final(out, &ctx) == 1;
+}
 
-    static const char *hex = "0123456789abcdef";
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
-        out_hex[i*2]     = hex[(hash[i] >> 4) & 0xF];
-        out_hex[i*2 + 1] = hex[(hash[i]     ) & 0xF];
-    }
-    out_hex[64] = '\0';
+/* Whole-token parsers for commands and CSV fields. */
+static bool parseInt(const char *tok, int *out) {
+    if (!tok) return false;
+    char *end;
+    long v = strtol(tok, &end, 10);
+    if (*end || end == tok || v < INT32_MIN || v > INT32_MAX) return false;
+    *out = (int)v;
     return true;
 }
 
+static bool parseAmount(const char *tok, double *out) {
+    if (!tok) return false;
+    char *end;
+    *out = strtod(tok, &end);
+    return *tok && !*end;
+}
+
 /* Hidden input for PIN (no echo) */
 void get_hidden_input(char *buf, size_t sz) {
 #ifdef _WIN32
@@ -130,507 +843,6920 @@ void get_hidden_input(char *buf, size_t sz) {
 #endif
 }
 
-/* ======================= Storage ======================= */
-bool loadAccount(int accountNumber, Account *out) {
-    FILE *fp = fopen(accountsFile(), "rb");
-    if (!fp) return false;
+/* ======================= Account Store ======================= */
+/*
+ * Account files are mapped once (storeOpen) and records are read and written
+ * in place: no per-call fopen and no trip through stdio buffers. Each mapping
+ * sits inside a large PROT_NONE reservation, so growing a file just maps more
+ * pages at the same address and Account pointers from accountRef() stay valid
+ * across appends.
+ *
+ * Every file starts with a 64-byte StoreHeader, so every record sits on its
+ * own cache line. The header's count is raised only after appended records are
+ * on disk; anything past it is a torn append and gets overwritten. A headerless
+ * file from before version 2 is migrated on open (see Legacy Format).
+ *
+ * The records may be spread over shards: accounts.<k>.dat for k below the
+ * shard count, a power of two. An account lives in the shard picked by the top
+ * bits of its number's hash (shardOf()), and each shard has its own mapping,
+ * index, filter, lock and append lock byte, so lookups and appends for
+ * different shards do not queue behind each other, and rebuilding an index or
+ * growing a file covers one shard, not the whole store. ATM_SHARDS (1 to 64,
+ * default 1) sets the count when a new store is created; `atm --reshard <n>`
+ * changes it later (see Resharding). With one shard the records stay in
+ * accounts.dat; with more, accounts.dat keeps only the header the whole store
+ * shares (shard count, end-of-day state) and the lock bytes.
+ *
+ * Dirty pages reach the disk according to ATM_MSYNC:
+ *   never   - leave write-back to the kernel (default)
+ *   always  - msync(MS_SYNC) the touched page after every update
+ *   <n>     - msync(MS_ASYNC) the whole mapping every n updates
+ */
+#define STORE_RESERVE    ((size_t)1 << 36)   /* 64 GiB of address space per shard */
+#define STORE_MAGIC      0x54434341u         /* "ACCT" */
+#define STORE_VERSION    2u
+#define STORE_MAX_SHARDS 64
 
-    Account tmp;
-    while (fread(&tmp, sizeof(Account), 1, fp) == 1) {
-        if (tmp.accountNumber == accountNumber) {
-            *out = tmp;
-            fclose(fp);
-            return true;
-        }
-    }
-    fclose(fp);
-    return false;
-}
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    uint64_t count;        // records that follow
+    int32_t  eodDay;       // yyyymmdd of the latest end-of-day run
+    uint8_t  eodMark;      // the eodMark that run sets in the records it posts, and appends copy
+    uint8_t  eodRunning;   // 1 until the run has posted every record
+    uint8_t  backup;       // 1 in a backup copy (see Backup and Restore); the rest is 0 in accounts.dat
+    uint8_t  reserved;
+    int64_t  logFrom;      // transaction log end when the backup started
+    int64_t  logPos;       // and when its snapshot was taken
+    uint64_t refsEnd;      // size of transfers.refs at the snapshot
+    uint32_t shards;       // shard count (0 in older files: one); a shard file's is the layout it belongs to
+    char     pad[4];
+} StoreHeader;
 
-bool updateAccount(const Account *acc) {
-    FILE *fp = fopen(accountsFile(), "rb+");
-    if (!fp) return false;
+_Static_assert(sizeof(StoreHeader) == sizeof(Account), "records must stay 64-byte aligned");
 
-    Account tmp;
-    while (fread(&tmp, sizeof(Account), 1, fp) == 1) {
-        if (tmp.accountNumber == acc->accountNumber) {
-            if (fseek(fp, -(long)sizeof(Account), SEEK_CUR) != 0) { fclose(fp); return false; }
-            if (fwrite(acc, sizeof(Account), 1, fp) != 1)        { fclose(fp); return false; }
-            fclose(fp);
-            return true;
-        }
-    }
-    fclose(fp);
-    return false;
-}
+typedef enum { SYNC_NEVER, SYNC_ALWAYS, SYNC_EVERY_N } SyncPolicy;
 
-bool appendAccount(const Account *acc) {
-    FILE *fp = fopen(accountsFile(), "ab");
-    if (!fp) return false;
-    bool ok = fwrite(acc, sizeof(Account), 1, fp) == 1;
-    fclose(fp);
-    return ok;
-}
+typedef struct IndexHeader IndexHeader;   // see Account Index
+typedef struct BloomBlock  BloomBlock;    // see Account Filter
+typedef struct NameEntry   NameEntry;     // see Name Index
 
-bool accountExists(int accountNumber) {
-    Account x;
-    return loadAccount(accountNumber, &x);
-}
+/* One mapped account file. Its lock guards the indexes, the filter and the
+   mapped size: lookups hold it shared; appends and index rebuilds hold it
+   exclusively. Records themselves are protected by the per-account locks,
+   not by this. */
+typedef struct {
+    int              fd;
+    bool             ownsFd;        // false for accounts.dat, whose fd is the store's
+    bool             retired;       // replaced by a reshard; still mapped for readers inside it
+    char            *base;          // start of the reservation / mapping
+    size_t           size;          // mapped bytes: header plus whole records
+    unsigned         pending;       // updates since the last msync
+    char             file[32];
+    char             idxFile[32];
+    pthread_rwlock_t lock;
+    IndexHeader     *idx;           // mapped index (header, then slots)
+    size_t           idxLen;
+    ino_t            idxIno;        // file idx maps; another process may replace it
+    BloomBlock      *bloom;         // see Account Filter
+    uint64_t         bloomMask;     // block count - 1
+    uint64_t         bloomKeys;     // keys it was sized for
+    size_t           bloomCovered;  // records [0, bloomCovered) are in it
+    NameEntry       *names;         // see Name Index: sorted names
+    size_t           nameCount;
+    NameEntry       *recent;        // sorted names mapped since the last merge
+    size_t           recentCount;
+    size_t           recentCap;
+    size_t           namesCovered;  // records [0, namesCovered) are in names or recent
+} StoreShard;
 
-/* ======================= Logging ======================= */
-void logTransaction(const Account *user, const char *type, double amount, const char *note) {
-    char filename[64];
-    snprintf(filename, sizeof(filename), "%d_log.txt", user->accountNumber);
+/* The shards in use. A reshard installs a new layout and keeps the old one,
+   mappings and all, until storeClose(), so a record pointer taken a moment
+   before the switch still points at mapped memory. */
+typedef struct StoreLayout {
+    unsigned            shards;   // a power of two
+    StoreShard         *shard[STORE_MAX_SHARDS];
+    struct StoreLayout *prev;
+} StoreLayout;
 
-    FILE *fp = fopen(filename, "a");
-    if (!fp) return;
+typedef struct {
+    int          fd;         // accounts.dat: the shared header and the lock bytes
+    StoreHeader *header;     // its header, mapped
+    StoreLayout *layout;
+    SyncPolicy   policy;
+    unsigned     syncEvery;
+} AccountStore;
 
-    time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
-    char ts[32];
-    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", tm_info);
+static AccountStore g_store = { -1, NULL, NULL, SYNC_NEVER, 0 };
 
-    fprintf(fp, "[%s] %-10s Amount: %.2f  Balance: %.2f", ts, type, amount, user->balance);
-    if (note && *note) fprintf(fp, "  Note: %s", note);
-    fputc('\n', fp);
-    fclose(fp);
-}
+/* Appends, listings and the end-of-day pass hold it shared; a reshard holds
+   it exclusively while it switches layouts, so nothing is appended to a
+   shard being replaced or walked twice. */
+static pthread_rwlock_t g_layoutLock = PTHREAD_RWLOCK_INITIALIZER;
 
-void showMiniStatement(const Account *user, int lastN) {
-    char filename[64];
-    snprintf(filename, sizeof(filename), "%d_log.txt", user->accountNumber);
+/*
+ * Several atm processes may share the same files. They coordinate with fcntl
+ * byte-range locks: each record's own bytes in its shard file (see Account
+ * Locks), plus a few lock bytes past anything a file can hold that stand for
+ * the append path (in each shard file), the journal and the transaction log
+ * (in accounts.dat). Within a process the matching mutex is always taken
+ * first, so the fcntl lock only ever has to exclude other processes.
+ */
+#define LOCK_BYTE_APPEND ((off_t)STORE_RESERVE)
+#define LOCK_BYTE_WAL    ((off_t)STORE_RESERVE + 1)
+#define LOCK_BYTE_TXLOG  ((off_t)STORE_RESERVE + 2)
+#define LOCK_BYTE_OWNER  ((off_t)STORE_RESERVE + 3)   // shared by every process, exclusive when alone
+#define LOCK_BYTE_ASYNC  ((off_t)STORE_RESERVE + 4)   // shared while a process queues log records
+#define LOCK_BYTE_BACKUP ((off_t)STORE_RESERVE + 5)   // shared while a process takes a backup
 
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        printf("No transactions yet.\n");
-        return;
-    }
+#ifdef F_OFD_SETLKW
+  #define RANGE_SETLKW F_OFD_SETLKW   // owned by the open file: not dropped when another fd closes
+  #define RANGE_SETLK  F_OFD_SETLK
+  #define RANGE_GETLK  F_OFD_GETLK
+#else
+  #define RANGE_SETLKW F_SETLKW
+  #define RANGE_SETLK  F_SETLK
+  #define RANGE_GETLK  F_GETLK
+#endif
 
-    // Store last N lines (simple ring buffer)
-    char **bufs = (char**)calloc(lastN, sizeof(char*));
-    for (int i = 0; i < lastN; ++i) {
-        bufs[i] = (char*)calloc(256, 1);
+/* Locks (F_RDLCK/F_WRLCK) or unlocks (F_UNLCK) len bytes of fd at start,
+   waiting for other processes as long as it takes. */
+static bool rangeLock(int fd, short type, off_t start, off_t len) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len;
+    while (fcntl(fd, RANGE_SETLKW, &fl) != 0) {
+        // EDEADLK: process-owned locks see all our threads as one owner and may
+        // report a cycle that the lock ordering rules out; just wait again
+        if (errno == EDEADLK) usleep(1000);
+        else if (errno != EINTR) return false;
     }
+    return true;
+}
 
-    int count = 0;
-    while (fgets(bufs[count % lastN], 256, fp)) {
-        count++;
+/* Like rangeLock() but fails at once if another process holds a conflicting lock. */
+static bool rangeTryLock(int fd, short type, off_t start, off_t len) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len;
+    int rc;
+    while ((rc = fcntl(fd, RANGE_SETLK, &fl)) != 0 && errno == EINTR) { /* retry */ }
+    return rc == 0;
+}
+
+/* True if no other process holds a lock that would conflict with type. */
+static bool rangeFree(int fd, short type, off_t start, off_t len) {
+    struct flock fl;
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    fl.l_start = start;
+    fl.l_len = len;
+    return fcntl(fd, RANGE_GETLK, &fl) == 0 && fl.l_type == F_UNLCK;
+}
+
+static void storeParsePolicy(void) {
+    const char *p = getenv("ATM_MSYNC");
+    g_store.policy = SYNC_NEVER;
+    if (!p || !*p || strcmp(p, "never") == 0) return;
+    if (strcmp(p, "always") == 0) { g_store.policy = SYNC_ALWAYS; return; }
+    long n = strtol(p, NULL, 10);
+    if (n > 0) {
+        g_store.policy = SYNC_EVERY_N;
+        g_store.syncEvery = (unsigned)n;
     }
-    fclose(fp);
+}
 
-    int toShow = count < lastN ? count : lastN;
-    if (toShow == 0) {
-        printf("No transactions to show.\n");
-    } else {
-        printf("\n--- Last %d transactions ---\n", toShow);
-        int start = (count - toShow);
-        for (int i = 0; i < toShow; ++i) {
-            int idx = (start + i) % lastN;
-            printf("%s", bufs[idx]);
-        }
-        printf("---------------------------\n");
+/* ATM_SHARDS for a store about to be created. */
+static unsigned storeShardsWanted(void) {
+    const char *p = getenv("ATM_SHARDS");
+    long n = p && *p ? strtol(p, NULL, 10) : 1;
+    if (n < 1 || n > STORE_MAX_SHARDS || (n & (n - 1)) != 0) {
+        printf("⚠️ ATM_SHARDS must be a power of two from 1 to %d; using 1.\n", STORE_MAX_SHARDS);
+        return 1;
     }
+    return (unsigned)n;
+}
+
+static uint64_t idxHash(int32_t key);
 
-    for (int i = 0; i < lastN; ++i) free(bufs[i]);
-    free(bufs);
+/* The shard an account lives in: top bits of its hash, which the index and
+   the filter leave to pick slots and blocks. */
+static unsigned shardOf(int32_t accountNumber, unsigned shards) {
+    return (unsigned)(idxHash(accountNumber) >> 58) & (shards - 1);
 }
 
-/* ======================= Auth ======================= */
-void resetFailedAttempts(Account *user) {
-    if (user->failedAttempts != 0) {
-        user->failedAttempts = 0;
-        (void)updateAccount(user);
+static StoreLayout* storeLayout(void) {
+    return __atomic_load_n(&g_store.layout, __ATOMIC_ACQUIRE);
+}
+
+/* Locks and returns the shard of the current layout that holds (or would
+   hold) accountNumber. */
+static StoreShard* shardLock(int32_t accountNumber, bool exclusive) {
+    for (;;) {
+        StoreLayout *l = storeLayout();
+        StoreShard *sh = l->shard[shardOf(accountNumber, l->shards)];
+        if (exclusive) pthread_rwlock_wrlock(&sh->lock);
+        else pthread_rwlock_rdlock(&sh->lock);
+        if (!sh->retired) return sh;
+        pthread_rwlock_unlock(&sh->lock);   // a reshard replaced it meanwhile
     }
 }
 
-bool login(Account *outUser) {
-    int accNo;
-    printf("\nEnter Account Number: ");
-    if (scanf("%d", &accNo) != 1) { printf("Invalid input.\n"); return false; }
-    flush_line();
+void shardFile(unsigned k, unsigned shards, char *buf, size_t n) {
+    if (shards == 1) snprintf(buf, n, "%s", accountsFile());
+    else snprintf(buf, n, "accounts.%u.dat", k);
+}
 
-    Account user;
-    if (!loadAccount(accNo, &user)) {
-        printf("Account not found.\n");
-        return false;
-    }
+void shardIndexFile(unsigned k, unsigned shards, char *buf, size_t n) {
+    if (shards == 1) snprintf(buf, n, "%s", indexFile());
+    else snprintf(buf, n, "accounts.%u.idx", k);
+}
 
-    if (user.locked) {
-        printf("❌ Account is LOCKED due to multiple wrong PIN attempts. Contact admin.\n");
-        return false;
+/* Removes the data files of shards from and up (all of them for 0, which
+   leaves accounts.dat alone), the index files of the same shards or, with
+   indexes, of every shard, and any files a reshard left behind. */
+static void storeRemoveShards(unsigned from, bool indexes) {
+    for (unsigned k = 0; k < STORE_MAX_SHARDS; ++k) {
+        char path[48];
+        size_t len;
+        shardFile(k, STORE_MAX_SHARDS, path, sizeof(path));
+        if (k >= from) remove(path);
+        len = strlen(path);
+        snprintf(path + len, sizeof(path) - len, ".split");
+        remove(path);
+        shardIndexFile(k, STORE_MAX_SHARDS, path, sizeof(path));
+        if (k >= from || indexes) remove(path);
+        len = strlen(path);
+        snprintf(path + len, sizeof(path) - len, ".split");
+        remove(path);
     }
+}
 
-    char pin[64];
-    printf("Enter PIN (hidden): ");
-    get_hidden_input(pin, sizeof(pin));
+static void bloomCover(StoreShard *sh);
+static void bloomFree(StoreShard *sh);
+static void nameCover(StoreShard *sh);
+static void nameFree(StoreShard *sh);
 
-    char pinHash[65];
-    if (!sha256_hex(pin, pinHash)) {
-        printf("Hash error.\n");
-        return false;
-    }
-    if (strcmp(pinHash, user.pinHash) != 0) {
-        user.failedAttempts++;
-        if (user.failedAttempts >= 3) {
-            user.locked = 1;
-            printf("❌ Invalid PIN. Account LOCKED after 3 failed attempts.\n");
-        } else {
-            printf("❌ Invalid PIN. Attempts: %d/3\n", user.failedAttempts);
-        }
-        (void)updateAccount(&user);
-        return false;
+/* Maps the first size bytes of a shard; its filter and name index follow
+   the mapping. */
+static bool shardMapTo(StoreShard *sh, size_t size) {
+    if (size > STORE_RESERVE) return false;
+    if (size > 0) {
+        void *p = mmap(sh->base, size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_FIXED, sh->fd, 0);
+        if (p == MAP_FAILED) return false;
     }
-
-    resetFailedAttempts(&user);
-    *outUser = user;
-    printf("\n✅ Login successful! Welcome, %s (A/C %d)\n", user.name, user.accountNumber);
+    sh->size = size;
+    bloomCover(sh);
+    nameCover(sh);
     return true;
 }
 
-/* ======================= Features ======================= */
-void balanceInquiry(const Account *user) {
-    printf("💰 Current Balance: %.2f\n", user->balance);
+/* The header the whole store shares (accounts.dat's). */
+static StoreHeader* storeHeader(void) {
+    return g_store.header;
 }
 
-void deposit(Account *user) {
-    double amount;
-    printf("Enter deposit amount: ");
-    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
-    flush_line();
+static StoreHeader* shardHeader(const StoreShard *sh) {
+    return (StoreHeader*)sh->base;
+}
 
-    if (amount <= 0) {
-        printf("❌ Amount must be positive.\n");
-        return;
-    }
-    user->balance += amount;
-    if (!updateAccount(user)) {
-        printf("⚠️ Failed to update account on disk.\n");
-        return;
-    }
-    logTransaction(user, "DEPOSIT", amount, "");
-    printf("✅ Deposit successful. New Balance: %.2f\n", user->balance);
+static size_t shardCount(const StoreShard *sh) {
+    return sh->size ? (sh->size - sizeof(StoreHeader)) / sizeof(Account) : 0;
 }
 
-void withdraw(Account *user) {
-    double amount;
-    printf("Enter withdrawal amount: ");
-    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
-    flush_line();
+static Account* shardAt(const StoreShard *sh, size_t i) {
+    return (Account*)(sh->base + sizeof(StoreHeader) + i * sizeof(Account));
+}
 
-    if (amount <= 0) {
-        printf("❌ Amount must be positive.\n");
-        return;
-    }
-    if (amount > user->balance) {
-        printf("❌ Insufficient funds.\n");
-        return;
-    }
-    user->balance -= amount;
-    if (!updateAccount(user)) {
-        printf("⚠️ Failed to update account on disk.\n");
-        return;
-    }
-    logTransaction(user, "WITHDRAW", amount, "");
-    printf("✅ Withdrawal successful. New Balance: %.2f\n", user->balance);
+/* Records in all shards. */
+size_t storeCount(void) {
+    const StoreLayout *l = storeLayout();
+    size_t n = 0;
+    for (unsigned k = 0; l && k < l->shards; ++k) n += shardCount(l->shard[k]);
+    return n;
+}
+
+/* The i-th record, counting shard by shard. */
+Account* storeAt(size_t i) {
+    const StoreLayout *l = storeLayout();
+    for (unsigned k = 0;; ++k) {
+        size_t n = shardCount(l->shard[k]);
+        if (i < n || k + 1 == l->shards) return shardAt(l->shard[k], i);
+        i -= n;
+    }
+}
+
+static bool shardSync(StoreShard *sh) {
+    sh->pending = 0;
+    if (!sh->base || sh->size == 0) return true;
+    return ioMsync(sh->base, sh->size, MS_SYNC) == 0;
+}
+
+bool storeSync(void) {
+    const StoreLayout *l = storeLayout();
+    bool ok = true;
+    for (unsigned k = 0; l && k < l->shards; ++k) {
+        if (!shardSync(l->shard[k])) ok = false;
+    }
+    return ok;
+}
+
+/* Applies the msync policy after a record at byte offset off of sh was written. */
+static void storeNoteWrite(StoreShard *sh, size_t off) {
+    switch (g_store.policy) {
+        case SYNC_NEVER:
+            break;
+        case SYNC_ALWAYS: {
+            size_t page = (size_t)sysconf(_SC_PAGESIZE);
+            size_t start = off & ~(page - 1);
+            size_t end = off + sizeof(Account);
+            (void)ioMsync(sh->base + start, end - start, MS_SYNC);
+            break;
+        }
+        case SYNC_EVERY_N:
+            if (__atomic_add_fetch(&sh->pending, 1, __ATOMIC_RELAXED) >= g_store.syncEvery) {
+                __atomic_store_n(&sh->pending, 0, __ATOMIC_RELAXED);
+                (void)ioMsync(sh->base, sh->size, MS_ASYNC);
+            }
+            break;
+    }
+}
+
+static bool idxReady(StoreShard *sh);
+static void idxUnmap(StoreShard *sh);
+static bool storeMigrateLegacy(void);
+static void reshardRecover(void);
+
+/* Returns the bytes of an account file to map (header and counted records),
+   writing a header for `shards` into a new empty file; 0 if the file is not
+   usable. */
+static size_t storeCheckHeader(int fd, const char *file, unsigned shards) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return 0;
+
+    StoreHeader h;
+    if (st.st_size == 0) {
+        memset(&h, 0, sizeof(h));
+        h.magic = STORE_MAGIC;
+        h.version = STORE_VERSION;
+        h.headerSize = sizeof(StoreHeader);
+        h.recordSize = sizeof(Account);
+        h.shards = shards;
+        if (ioPwrite(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || ioFdatasync(fd) != 0) return 0;
+        return sizeof(h);
+    }
+    if (ioPread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || h.magic != STORE_MAGIC ||
+        h.version != STORE_VERSION || h.headerSize != sizeof(StoreHeader) ||
+        h.recordSize != sizeof(Account) ||
+        h.count > ((uint64_t)st.st_size - sizeof(StoreHeader)) / sizeof(Account)) {
+        printf("%s has an unknown format or a damaged header.\n", file);
+        return 0;
+    }
+    return sizeof(StoreHeader) + (size_t)h.count * sizeof(Account);
+}
+
+static void shardClose(StoreShard *sh) {
+    pthread_rwlock_wrlock(&sh->lock);
+    idxUnmap(sh);
+    pthread_rwlock_unlock(&sh->lock);
+    if (sh->base) munmap(sh->base, STORE_RESERVE);
+    if (sh->ownsFd && sh->fd >= 0) close(sh->fd);
+    bloomFree(sh);
+    nameFree(sh);
+    pthread_rwlock_destroy(&sh->lock);
+    free(sh);
+}
+
+/* Opens and maps one account file, creating it (with a header for `shards`)
+   if create; fd >= 0 is accounts.dat's own, already open. */
+static StoreShard* shardOpen(const char *file, const char *idxFile, int fd, bool create, unsigned shards) {
+    StoreShard *sh = (StoreShard*)calloc(1, sizeof(StoreShard));
+    if (!sh) return NULL;
+    pthread_rwlock_init(&sh->lock, NULL);
+    snprintf(sh->file, sizeof(sh->file), "%s", file);
+    snprintf(sh->idxFile, sizeof(sh->idxFile), "%s", idxFile);
+    sh->fd = fd;
+    if (fd < 0) {
+        sh->fd = ioOpen(file, O_RDWR | (create ? O_CREAT : 0), 0644);
+        sh->ownsFd = true;
+        if (sh->fd < 0 && errno == ENOENT) printf("%s is missing.\n", file);
+    }
+    size_t size = sh->fd >= 0 ? storeCheckHeader(sh->fd, file, shards) : 0;
+    void *base = size ? mmap(NULL, STORE_RESERVE, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) : MAP_FAILED;
+    if (base == MAP_FAILED) { shardClose(sh); return NULL; }
+    sh->base = (char*)base;
+
+    if (!shardMapTo(sh, size)) { shardClose(sh); return NULL; }
+    pthread_rwlock_wrlock(&sh->lock);
+    (void)idxReady(sh);
+    pthread_rwlock_unlock(&sh->lock);
+    return sh;
+}
+
+static void layoutFree(StoreLayout *l) {
+    while (l) {
+        StoreLayout *prev = l->prev;
+        for (unsigned k = 0; k < l->shards; ++k) {
+            if (l->shard[k]) shardClose(l->shard[k]);
+        }
+        free(l);
+        l = prev;
+    }
+}
+
+bool storeOpen(void) {
+    if (g_store.layout) return true;
+    if (!storeMigrateLegacy()) return false;
+
+    int fd = ioOpen(accountsFile(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    // a new store takes ATM_SHARDS, and no shard files of an old one
+    struct stat st;
+    bool fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+    unsigned shards = fresh ? storeShardsWanted() : 1;
+    if (fresh) storeRemoveShards(0, true);
+
+    size_t size = storeCheckHeader(fd, accountsFile(), shards);
+    void *h = size ? mmap(NULL, sizeof(StoreHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (h == MAP_FAILED) { close(fd); return false; }
+    g_store.fd = fd;
+    g_store.header = (StoreHeader*)h;
+    storeParsePolicy();
+    reshardRecover();
+
+    shards = g_store.header->shards ? g_store.header->shards : 1;
+    StoreLayout *l = (StoreLayout*)calloc(1, sizeof(StoreLayout));
+    bool ok = l && shards <= STORE_MAX_SHARDS && (shards & (shards - 1)) == 0;
+    if (!ok && l) printf("%s names %u shards, not a power of two up to %d.\n", accountsFile(), shards, STORE_MAX_SHARDS);
+    if (ok) l->shards = shards;
+    for (unsigned k = 0; ok && k < shards; ++k) {
+        char file[32], idx[32];
+        shardFile(k, shards, file, sizeof(file));
+        shardIndexFile(k, shards, idx, sizeof(idx));
+        l->shard[k] = shardOpen(file, idx, shards == 1 ? fd : -1, fresh, shards);
+        ok = l->shard[k] != NULL;
+    }
+    if (!ok) {
+        layoutFree(l);
+        munmap(g_store.header, sizeof(StoreHeader));
+        close(fd);
+        g_store.header = NULL;
+        g_store.fd = -1;
+        return false;
+    }
+    __atomic_store_n(&g_store.layout, l, __ATOMIC_RELEASE);
+    return true;
+}
+
+void storeClose(void) {
+    if (!g_store.layout) return;
+    (void)storeSync();
+    layoutFree(g_store.layout);
+    g_store.layout = NULL;
+    munmap(g_store.header, sizeof(StoreHeader));
+    close(g_store.fd);
+    g_store.header = NULL;
+    g_store.fd = -1;
+}
+
+/* ======================= Account Index ======================= */
+/*
+ * Each shard's index (accounts.idx beside accounts.dat, accounts.<k>.idx
+ * beside accounts.<k>.dat) is an open-addressing hash table (linear probing)
+ * that maps accountNumber -> byte offset of the record in the shard's file. It
+ * is mapped alongside the records, so a lookup touches one short run of slots
+ * instead of scanning every record. The header remembers the data size it
+ * describes; if the file was changed behind our back (or the index is
+ * missing) it is rebuilt in one pass over the shard's mapped records.
+ */
+#define IDX_MAGIC    0x58444941u   /* "AIDX" */
+#define IDX_VERSION  1u
+#define IDX_MIN_CAP  1024u
+
+struct IndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;   // number of slots, power of two
+    uint64_t count;      // used slots
+    int64_t  dataSize;   // size of the account file this index describes
+};
+
+typedef struct {
+    int32_t  accountNumber;
+    uint32_t used;
+    int64_t  offset;
+} IndexSlot;
+
+static IndexSlot* idxSlots(const StoreShard *sh) {
+    return (IndexSlot*)(sh->idx + 1);
+}
+
+static uint64_t idxHash(int32_t key) {
+    uint64_t x = (uint32_t)key;
+    x ^= x >> 33; x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33; x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t idxCapacityFor(uint64_t n) {
+    uint64_t cap = IDX_MIN_CAP;
+    while (cap < n * 2) cap <<= 1;   // keep load factor <= 0.5
+    return cap;
+}
+
+/* Returns the slot holding key, or the free slot where it would go. */
+static IndexSlot* idxProbe(IndexSlot *slots, uint64_t cap, int32_t key) {
+    uint64_t mask = cap - 1;
+    for (uint64_t i = idxHash(key) & mask;; i = (i + 1) & mask) {
+        if (!slots[i].used || slots[i].accountNumber == key) return &slots[i];
+    }
+}
+
+static void idxUnmap(StoreShard *sh) {
+    if (sh->idx) munmap(sh->idx, sh->idxLen);
+    sh->idx = NULL;
+    sh->idxLen = 0;
+}
+
+/* Maps the shard's index if it is well formed and describes the mapped file. */
+static bool idxMap(StoreShard *sh) {
+    idxUnmap(sh);
+    int fd = ioOpen(sh->idxFile, O_RDWR);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IndexHeader)) { close(fd); return false; }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+
+    IndexHeader *h = (IndexHeader*)p;
+    if (h->magic == IDX_MAGIC && h->version == IDX_VERSION &&
+        h->capacity >= IDX_MIN_CAP && (h->capacity & (h->capacity - 1)) == 0 &&
+        (size_t)st.st_size == sizeof(IndexHeader) + h->capacity * sizeof(IndexSlot) &&
+        h->dataSize == (int64_t)sh->size) {
+        sh->idx = h;
+        sh->idxLen = (size_t)st.st_size;
+        sh->idxIno = st.st_ino;
+        return true;
+    }
+    munmap(p, (size_t)st.st_size);
+    return false;
+}
+
+/* Caller holds the shard's lock exclusively. */
+static bool idxRebuildLocked(StoreShard *sh) {
+    idxUnmap(sh);
+    uint64_t n = shardCount(sh);
+    uint64_t cap = idxCapacityFor(n + 1);
+
+    IndexSlot *slots = (IndexSlot*)calloc((size_t)cap, sizeof(IndexSlot));
+    if (!slots) return false;
+
+    // keep the first offset seen for a key, as the old front-to-back scan did
+    IndexHeader h = { IDX_MAGIC, IDX_VERSION, cap, 0, (int64_t)sh->size };
+    for (uint64_t i = 0; i < n; ++i) {
+        int32_t key = shardAt(sh, i)->accountNumber;
+        IndexSlot *s = idxProbe(slots, cap, key);
+        if (s->used) continue;
+        s->accountNumber = key;
+        s->used = 1;
+        s->offset = (int64_t)(sizeof(StoreHeader) + i * sizeof(Account));
+        h.count++;
+    }
+
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", sh->idxFile);
+    FILE *fp = ioFopen(tmp, "wb");
+    bool ok = fp != NULL;
+    if (ok) {
+        ok = ioFwrite(&h, sizeof(h), 1, fp) == 1 &&
+             ioFwrite(slots, sizeof(IndexSlot), (size_t)cap, fp) == cap;
+        if (fclose(fp) != 0) ok = false;
+    }
+    free(slots);
+    if (ok) ok = rename(tmp, sh->idxFile) == 0;
+    if (!ok) { remove(tmp); return false; }
+    return idxMap(sh);
+}
+
+static bool shardIndexRebuild(StoreShard *sh) {
+    pthread_rwlock_wrlock(&sh->lock);
+    bool ok = idxRebuildLocked(sh);
+    pthread_rwlock_unlock(&sh->lock);
+    return ok;
+}
+
+/* Rebuilds the index of every shard. */
+bool indexRebuild(void) {
+    if (!storeOpen()) return false;
+    const StoreLayout *l = storeLayout();
+    bool ok = true;
+    for (unsigned k = 0; k < l->shards; ++k) {
+        if (!shardIndexRebuild(l->shard[k])) ok = false;
+    }
+    return ok;
+}
+
+/* Caller holds the shard's lock exclusively. */
+static bool idxReady(StoreShard *sh) {
+    return sh->idx || idxMap(sh) || idxRebuildLocked(sh);
+}
+
+static bool bloomRulesOut(StoreShard *sh, int32_t accountNumber);
+static void bloomLetThrough(StoreShard *sh);
+
+/* Looks accountNumber up in its shard (*shard, set whenever the store is
+   open). Sets *final when a miss needs no second look: no process has
+   appended past the shard's mapping, so its filter and index cover every
+   record. */
+static bool idxLookup(int accountNumber, StoreShard **shard, long *offset, bool *final) {
+    *final = false;
+    *shard = NULL;
+    if (!storeOpen()) return false;
+
+    StoreShard *sh = shardLock(accountNumber, false);
+    *shard = sh;
+    bool current = __atomic_load_n(&shardHeader(sh)->count, __ATOMIC_ACQUIRE) == shardCount(sh);
+    if (current && bloomRulesOut(sh, accountNumber)) {
+        pthread_rwlock_unlock(&sh->lock);
+        *final = true;
+        return false;
+    }
+    if (!sh->idx) {
+        // first use or a failed rebuild: retry under the exclusive lock
+        pthread_rwlock_unlock(&sh->lock);
+        pthread_rwlock_wrlock(&sh->lock);
+        if (!idxReady(sh)) { pthread_rwlock_unlock(&sh->lock); return false; }
+    }
+    IndexSlot *s = idxProbe(idxSlots(sh), sh->idx->capacity, accountNumber);
+    bool hit = s->used;
+    if (hit) *offset = (long)s->offset;
+    else if (current) bloomLetThrough(sh);
+    *final = current;
+    pthread_rwlock_unlock(&sh->lock);
+    return hit;
+}
+
+bool indexLookup(int accountNumber, long *offset) {
+    StoreShard *sh;
+    bool final;
+    return idxLookup(accountNumber, &sh, offset, &final);
+}
+
+/* Records a freshly appended account; dataSize is the shard file's new size.
+   Caller holds the shard's lock exclusively. */
+static bool idxInsert(StoreShard *sh, int accountNumber, long offset, long dataSize) {
+    // the index must describe the file as it was just before the append
+    if (!sh->idx || sh->idx->dataSize != (int64_t)offset || (sh->idx->count + 1) * 2 > sh->idx->capacity) {
+        return idxRebuildLocked(sh);
+    }
+    IndexSlot *s = idxProbe(idxSlots(sh), sh->idx->capacity, accountNumber);
+    if (!s->used) {
+        s->accountNumber = accountNumber;
+        s->offset = offset;
+        s->used = 1;
+        sh->idx->count++;
+    }
+    sh->idx->dataSize = dataSize;
+    return true;
+}
+
+/* ======================= Account Filter ======================= */
+/*
+ * A Bloom filter over the account numbers of each shard's mapped records,
+ * kept in memory by every process. Most lookups for numbers that do not exist
+ * (mistyped logins, bad transfer targets, credential stuffing) end at one
+ * cache line of it, without touching the shard's index.
+ *
+ * The filter is blocked: a key's BLOOM_HASHES bits all fall in one 512-bit
+ * block, so a check costs a single cache miss. It follows the mapping:
+ * records mapped by an append or picked up from another process are added
+ * as the mapping grows, and the filter is rebuilt twice as large in one pass
+ * over the records once it holds its planned number of keys. It answers
+ * only while no process has appended past the mapping (the header's count);
+ * otherwise the lookup goes on to refresh the shard as before. Building it
+ * takes one pass over the records, the same as an index rebuild, so it is
+ * not saved to disk.
+ *
+ * Checks that rule a number out, and misses the filter let through (false
+ * positives), are counted for the statistics.
+ */
+#define BLOOM_BITS_PER_KEY 16
+#define BLOOM_HASHES       8
+#define BLOOM_MIN_KEYS     4096
+
+struct BloomBlock {
+    uint64_t w[8];   // 512 bits: one cache line
+};
+
+static struct {
+    uint64_t ruledOut;   // lookups a filter answered
+    uint64_t falsePos;   // lookups one let through that missed
+} g_bloom;
+
+static void bloomFree(StoreShard *sh) {
+    free(sh->bloom);
+    sh->bloom = NULL;
+    sh->bloomCovered = 0;
+}
+
+/* The key's block; its bits are (a + i * b) mod 512 for i < BLOOM_HASHES. */
+static BloomBlock* bloomBlock(const StoreShard *sh, int32_t key, uint64_t *a, uint64_t *b) {
+    uint64_t h = idxHash(key);
+    *a = (h >> 32) & 511;
+    *b = (h >> 41) | 1;
+    return &sh->bloom[h & sh->bloomMask];
+}
+
+static void bloomAdd(StoreShard *sh, int32_t key) {
+    uint64_t a, b;
+    BloomBlock *blk = bloomBlock(sh, key, &a, &b);
+    for (uint64_t i = 0; i < BLOOM_HASHES; ++i) {
+        uint64_t bit = (a + i * b) & 511;
+        blk->w[bit >> 6] |= 1ull << (bit & 63);
+    }
+}
+
+static bool bloomMayHold(const StoreShard *sh, int32_t key) {
+    uint64_t a, b;
+    const BloomBlock *blk = bloomBlock(sh, key, &a, &b);
+    for (uint64_t i = 0; i < BLOOM_HASHES; ++i) {
+        uint64_t bit = (a + i * b) & 511;
+        if (!(blk->w[bit >> 6] & (1ull << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+/* Adds the records mapped since the last call, first rebuilding the filter
+   larger if they would overfill it. Caller holds the shard's lock
+   exclusively (or is opening it). On failure the filter is dropped and
+   lookups go to the index. */
+static void bloomCover(StoreShard *sh) {
+    size_t n = shardCount(sh);
+    if (sh->bloom && n > sh->bloomKeys) bloomFree(sh);
+    if (!sh->bloom) {
+        uint64_t keys = BLOOM_MIN_KEYS;
+        while (keys < 2 * (uint64_t)n) keys <<= 1;
+        uint64_t blocks = keys * BLOOM_BITS_PER_KEY / 512;
+        sh->bloom = (BloomBlock*)aligned_alloc(sizeof(BloomBlock), (size_t)blocks * sizeof(BloomBlock));
+        if (!sh->bloom) return;
+        memset(sh->bloom, 0, (size_t)blocks * sizeof(BloomBlock));
+        sh->bloomMask = blocks - 1;
+        sh->bloomKeys = keys;
+        sh->bloomCovered = 0;
+    }
+    for (size_t i = sh->bloomCovered; i < n; ++i) bloomAdd(sh, shardAt(sh, i)->accountNumber);
+    sh->bloomCovered = n;
+}
+
+/* Called with the shard's lock held: true if accountNumber is certainly absent. */
+static bool bloomRulesOut(StoreShard *sh, int32_t accountNumber) {
+    if (!sh->bloom || bloomMayHold(sh, accountNumber)) return false;
+    __atomic_add_fetch(&g_bloom.ruledOut, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+/* The index missed a number the filter let through. */
+static void bloomLetThrough(StoreShard *sh) {
+    if (sh->bloom) __atomic_add_fetch(&g_bloom.falsePos, 1, __ATOMIC_RELAXED);
+}
+
+void bloomCounters(uint64_t *ruledOut, uint64_t *falsePos) {
+    *ruledOut = __atomic_load_n(&g_bloom.ruledOut, __ATOMIC_RELAXED);
+    *falsePos = __atomic_load_n(&g_bloom.falsePos, __ATOMIC_RELAXED);
+}
+
+/* ======================= Name Index ======================= */
+/*
+ * Admin searches by name (SEARCH, the admin menu) use an in-memory index over
+ * Account.name, kept per shard like the filter: the names of the shard's
+ * mapped records, ASCII case-folded, in one sorted array plus a short sorted
+ * run of the names mapped since (appends, records picked up from another
+ * process). The run is merged into the array once it holds NAME_RECENT_MAX
+ * names, so an append costs a binary search and a short memmove. The names
+ * starting with a prefix are one range of each, found by binary search, and
+ * a page of matches is the merge of those ranges in (name, number) order.
+ *
+ * Names never change once written, so the index only has to follow growth.
+ * Building it is one pass over the shard's records and a sort. The server
+ * and the interactive program build it when they start (nameIndexEnable());
+ * other runs only if they get a SEARCH.
+ */
+#define NAME_RECENT_MAX 4096
+#define SEARCH_PAGE     20     // matches per page
+
+struct NameEntry {
+    char    key[16];        // case-folded name, NUL-padded
+    int32_t accountNumber;
+};
+
+static bool g_namesWanted;   // set by nameIndexEnable()
+
+/* Lower-cases the first len bytes of name into a NUL-padded key. */
+static void nameFold(const char *name, size_t len, char key[16]) {
+    memset(key, 0, 16);
+    for (size_t i = 0; i < len && i < 15 && name[i]; ++i) key[i] = (char)tolower((unsigned char)name[i]);
+}
+
+static int nameCmp(const NameEntry *x, const NameEntry *y) {
+    int c = memcmp(x->key, y->key, sizeof(x->key));
+    return c ? c : (x->accountNumber > y->accountNumber) - (x->accountNumber < y->accountNumber);
+}
+
+static int nameCmpQsort(const void *a, const void *b) {
+    return nameCmp((const NameEntry*)a, (const NameEntry*)b);
+}
+
+/* First entry of a[0..n) whose key's first len bytes are >= prefix, or with
+   upper, > prefix. */
+static size_t nameBound(const NameEntry *a, size_t n, const char *prefix, size_t len, bool upper) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int c = memcmp(a[mid].key, prefix, len);
+        if (c < 0 || (upper && c == 0)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void nameFree(StoreShard *sh) {
+    free(sh->names);
+    free(sh->recent);
+    sh->names = sh->recent = NULL;
+    sh->nameCount = sh->recentCount = sh->recentCap = 0;
+    sh->namesCovered = 0;
+}
+
+/* Folds the recent run into the sorted array. */
+static bool nameMerge(StoreShard *sh) {
+    if (sh->nameCount == 0) {   // first build: the run is the whole array
+        free(sh->names);
+        sh->names = sh->recent;
+        sh->nameCount = sh->recentCount;
+        sh->recent = NULL;
+        sh->recentCount = sh->recentCap = 0;
+        return true;
+    }
+    size_t n = sh->nameCount + sh->recentCount, i = 0, j = 0, k = 0;
+    NameEntry *m = (NameEntry*)malloc(n * sizeof(NameEntry));
+    if (!m) return false;
+    while (i < sh->nameCount && j < sh->recentCount) {
+        m[k++] = nameCmp(&sh->names[i], &sh->recent[j]) <= 0 ? sh->names[i++] : sh->recent[j++];
+    }
+    while (i < sh->nameCount) m[k++] = sh->names[i++];
+    while (j < sh->recentCount) m[k++] = sh->recent[j++];
+    free(sh->names);
+    sh->names = m;
+    sh->nameCount = n;
+    sh->recentCount = 0;
+    return true;
+}
+
+/* Adds the names of the records mapped since the last call, once the index
+   is wanted. Caller holds the shard's lock exclusively (or is opening it). On
+   failure the index is dropped and the next search builds it again. */
+static void nameCover(StoreShard *sh) {
+    size_t n = shardCount(sh);
+    if (!__atomic_load_n(&g_namesWanted, __ATOMIC_ACQUIRE) || n <= sh->namesCovered) return;
+    size_t add = n - sh->namesCovered;
+    if (sh->recentCount + add > sh->recentCap) {
+        size_t cap = sh->recentCount + add;
+        if (cap < NAME_RECENT_MAX) cap = NAME_RECENT_MAX;
+        NameEntry *r = (NameEntry*)realloc(sh->recent, cap * sizeof(NameEntry));
+        if (!r) { nameFree(sh); return; }
+        sh->recent = r;
+        sh->recentCap = cap;
+    }
+    NameEntry *run = sh->recent;
+    for (size_t i = sh->namesCovered; i < n; ++i) {
+        const Account *a = shardAt(sh, i);
+        NameEntry e;
+        nameFold(a->name, sizeof(a->name), e.key);
+        e.accountNumber = a->accountNumber;
+        if (add > 1) { run[sh->recentCount++] = e; continue; }
+        size_t at = sh->recentCount;   // a single append: insert in place
+        while (at > 0 && nameCmp(&run[at - 1], &e) > 0) --at;
+        memmove(&run[at + 1], &run[at], (sh->recentCount - at) * sizeof(NameEntry));
+        run[at] = e;
+        sh->recentCount++;
+    }
+    if (add > 1) qsort(run, sh->recentCount, sizeof(NameEntry), nameCmpQsort);
+    sh->namesCovered = n;
+    if (sh->recentCount >= NAME_RECENT_MAX && !nameMerge(sh)) nameFree(sh);
+}
+
+/* Builds the name index of every shard; from now on it follows the mappings. */
+void nameIndexEnable(void) {
+    __atomic_store_n(&g_namesWanted, true, __ATOMIC_RELEASE);
+    if (!storeOpen()) return;
+    pthread_rwlock_rdlock(&g_layoutLock);
+    const StoreLayout *l = storeLayout();
+    for (unsigned k = 0; k < l->shards; ++k) {
+        StoreShard *sh = l->shard[k];
+        pthread_rwlock_wrlock(&sh->lock);
+        nameCover(sh);
+        pthread_rwlock_unlock(&sh->lock);
+    }
+    pthread_rwlock_unlock(&g_layoutLock);
+}
+
+static bool storeRefreshLocked(StoreShard *sh);
+
+/* Fills numbers[] with up to limit account numbers whose names start with
+   prefix (ignoring ASCII case), after skipping the first skip matches in
+   (name, number) order; *total gets the number of matches. Returns how many
+   were filled, or -1 if a shard's index could not be built. */
+static long nameSearch(const char *prefix, long skip, int limit, int32_t *numbers, long *total) {
+    char key[16];
+    size_t len = strlen(prefix);
+    *total = 0;
+    if (len >= sizeof(key)) return 0;   // longer than any name
+    nameFold(prefix, len, key);
+    if (!__atomic_load_n(&g_namesWanted, __ATOMIC_ACQUIRE)) nameIndexEnable();
+    if (!storeOpen()) return -1;
+
+    pthread_rwlock_rdlock(&g_layoutLock);   // one shard layout throughout
+    const StoreLayout *l = storeLayout();
+    // pick up other processes' appends, or rebuild a dropped index
+    for (unsigned k = 0; k < l->shards; ++k) {
+        StoreShard *sh = l->shard[k];
+        pthread_rwlock_rdlock(&sh->lock);
+        bool current = __atomic_load_n(&shardHeader(sh)->count, __ATOMIC_ACQUIRE) == shardCount(sh) &&
+                       sh->namesCovered == shardCount(sh);
+        pthread_rwlock_unlock(&sh->lock);
+        if (current) continue;
+        pthread_rwlock_wrlock(&sh->lock);
+        (void)storeRefreshLocked(sh);
+        nameCover(sh);
+        pthread_rwlock_unlock(&sh->lock);
+    }
+
+    // the matching range of every run, merged while all shards are held
+    struct { const NameEntry *a; size_t at, end; } runs[2 * STORE_MAX_SHARDS];
+    int nruns = 0;
+    bool ok = true;
+    for (unsigned k = 0; k < l->shards; ++k) {
+        StoreShard *sh = l->shard[k];
+        pthread_rwlock_rdlock(&sh->lock);
+        if (sh->namesCovered != shardCount(sh)) ok = false;
+        const NameEntry *a[2] = { sh->names, sh->recent };
+        size_t n[2] = { sh->nameCount, sh->recentCount };
+        for (int r = 0; r < 2; ++r) {
+            runs[nruns].a = a[r];
+            runs[nruns].at = nameBound(a[r], n[r], key, len, false);
+            runs[nruns].end = nameBound(a[r], n[r], key, len, true);
+            *total += (long)(runs[nruns].end - runs[nruns].at);
+            nruns++;
+        }
+    }
+    long filled = 0;
+    for (long seen = 0; ok && filled < limit; ++seen) {
+        int best = -1;
+        for (int r = 0; r < nruns; ++r) {
+            if (runs[r].at < runs[r].end &&
+                (best < 0 || nameCmp(&runs[r].a[runs[r].at], &runs[best].a[runs[best].at]) < 0)) best = r;
+        }
+        if (best < 0) break;
+        const NameEntry *e = &runs[best].a[runs[best].at++];
+        if (seen >= skip) numbers[filled++] = e->accountNumber;
+    }
+    for (unsigned k = 0; k < l->shards; ++k) pthread_rwlock_unlock(&l->shard[k]->lock);
+    pthread_rwlock_unlock(&g_layoutLock);
+    return ok ? filled : -1;
+}
+
+/* ======================= Storage ======================= */
+/* Picks up records appended and index files replaced by other processes.
+   Caller holds the shard's lock exclusively. */
+static bool storeRefreshLocked(StoreShard *sh) {
+    struct stat ist;
+    if (!sh->base) return false;
+
+    // the header page is shared with the other processes' mappings
+    size_t size = sizeof(StoreHeader) + (size_t)__atomic_load_n(&shardHeader(sh)->count, __ATOMIC_ACQUIRE) * sizeof(Account);
+    bool idxMoved = sh->idx && (stat(sh->idxFile, &ist) != 0 || ist.st_ino != sh->idxIno);
+    if (size <= sh->size && !idxMoved) return idxReady(sh);
+    if (size > sh->size && !shardMapTo(sh, size)) return false;
+    idxUnmap(sh);
+    return idxReady(sh);
+}
+
+static bool storeRefresh(StoreShard *sh) {
+    pthread_rwlock_wrlock(&sh->lock);
+    bool ok = storeRefreshLocked(sh);
+    pthread_rwlock_unlock(&sh->lock);
+    return ok;
+}
+
+/* Returns the record in place, and the shard it is in. A miss may be an
+   account another process just appended, so unless nothing was appended
+   since the mapping (see Account Filter) look at the file once more; a
+   mismatch means the index went stale without the file size changing, so
+   rebuild once and retry. */
+static Account* shardRef(int accountNumber, StoreShard **shard) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        long off;
+        bool final;
+        StoreShard *sh;
+        bool hit = idxLookup(accountNumber, &sh, &off, &final);
+        if (hit && (size_t)off + sizeof(Account) <= sh->size) {
+            Account *a = (Account*)(sh->base + off);
+            if (a->accountNumber == accountNumber) {
+                if (shard) *shard = sh;
+                return a;
+            }
+            if (attempt == 0 && !shardIndexRebuild(sh)) return NULL;
+        } else if (!hit && final) {
+            return NULL;
+        } else if (attempt == 0 && (!sh || !storeRefresh(sh))) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+Account* accountRef(int accountNumber) {
+    return shardRef(accountNumber, NULL);
+}
+
+/* Records are read without the account's lock, while another thread or
+   process may be applying a commit to them. The word holding the version
+   works like a seqlock: a writer sets the writing bit, rewrites the rest
+   and then stores the word with the new version, and a reader retries
+   until it copies the record between two equal, idle looks at that word. */
+static uint32_t* recordWord(const Account *a) {
+    return (uint32_t*)((char*)a + sizeof(int32_t));
+}
+
+static uint32_t recordWritingBit(void) {
+    static uint32_t bit;
+    if (!bit) {
+        Account t;
+        memset(&t, 0, sizeof(t));
+        t.writing = 1;
+        bit = *recordWord(&t);
+    }
+    return bit;
+}
+
+static void recordWrite(Account *dst, const Account *src) {
+    uint32_t *w = recordWord(dst);
+    __atomic_store_n(w, __atomic_load_n(w, __ATOMIC_RELAXED) | recordWritingBit(), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    Account img = *src;
+    *recordWord(&img) = __atomic_load_n(w, __ATOMIC_RELAXED);
+    memcpy(dst, &img, sizeof(img));
+    __atomic_store_n(w, *recordWord(src) & ~recordWritingBit(), __ATOMIC_RELEASE);
+}
+
+static void recordRead(Account *dst, const Account *src) {
+    const uint32_t *w = recordWord(src);
+    for (;;) {
+        uint32_t before = __atomic_load_n(w, __ATOMIC_ACQUIRE);
+        if (before & recordWritingBit()) { sched_yield(); continue; }
+        memcpy(dst, src, sizeof(*dst));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(w, __ATOMIC_RELAXED) == before) return;
+    }
+}
+
+static bool cacheGet(int accountNumber, Account *out);
+
+bool loadAccount(int accountNumber, Account *out) {
+    STAT_SCOPE(ST_LOAD);
+    if (cacheGet(accountNumber, out)) return true;
+    Account *a = accountRef(accountNumber);
+    if (!a) return false;
+    recordRead(out, a);
+    return true;
+}
+
+bool updateAccount(const Account *acc) {
+    return commitAccounts(&acc, 1);
+}
+
+/* Fails if the account number is already taken, including by an append
+   another process made a moment ago. */
+bool appendAccount(const Account *acc) {
+    Account a = *acc;
+    bool taken;
+    return appendAccounts(&a, 1, &taken) == 1;
+}
+
+/* Writes n new records at the end of one shard with one sequential write,
+   then raises its count and indexes them. Caller holds the shard's lock
+   exclusively and its append lock byte. */
+static bool shardAppend(StoreShard *sh, const Account *accs, long n) {
+    size_t off = sh->size, bytes = n > 0 ? (size_t)n * sizeof(Account) : 0;
+    IoChunk c = { accs, bytes, (off_t)off };
+    bool ok = bytes == 0 ||
+              (ioWriteChunks(sh->fd, &c, 1, true) &&   // the records first, then the count that covers them
+               shardMapTo(sh, off + bytes));
+    if (ok && bytes > 0) {
+        __atomic_store_n(&shardHeader(sh)->count, (uint64_t)shardCount(sh), __ATOMIC_RELEASE);
+        ok = ioMsync(sh->base, sizeof(StoreHeader), MS_SYNC) == 0;   // journaled updates may follow at once
+    }
+    // a rebuild triggered by one insert covers the rest of the batch as well
+    for (long i = 0; ok && i < n && sh->idx && sh->idx->dataSize != (int64_t)sh->size; ++i) {
+        size_t at = off + (size_t)i * sizeof(Account);
+        if (!idxInsert(sh, accs[i].accountNumber, (long)at, (long)(at + sizeof(Account)))) {
+            // not fatal: the next lookup notices the size change and rebuilds
+            idxUnmap(sh);
+            remove(sh->idxFile);
+            break;
+        }
+    }
+    return ok;
+}
+
+/* Appends new records, one sequential write per shard they go to. Numbers
+   already in the store (counting appends other processes made a moment ago)
+   are flagged in taken[] and skipped; the rest move to the front of accs, in
+   order. Returns how many were written, or -1 on an I/O error. */
+long appendAccounts(Account *accs, long n, bool *taken) {
+    if (!storeOpen()) return -1;
+    // a new record counts as posted by the latest end-of-day run, so the next one takes it
+    unsigned mark = storeHeader()->eodMark;
+    for (long i = 0; i < n; ++i) accs[i].eodMark = mark;
+    Account *part = (Account*)malloc((size_t)(n > 0 ? n : 1) * sizeof(Account));
+    if (!part) return -1;
+
+    pthread_rwlock_rdlock(&g_layoutLock);
+    const StoreLayout *l = storeLayout();
+    uint64_t todo = 0;   // shards with records in this batch
+    for (long i = 0; i < n; ++i) todo |= 1ull << shardOf(accs[i].accountNumber, l->shards);
+
+    bool ok = true;
+    for (unsigned k = 0; ok && k < l->shards; ++k) {
+        if (!(todo & (1ull << k))) continue;
+        StoreShard *sh = l->shard[k];
+        pthread_rwlock_wrlock(&sh->lock);
+        bool locked = rangeLock(sh->fd, F_WRLCK, LOCK_BYTE_APPEND, 1);
+        ok = locked && storeRefreshLocked(sh);
+        long m = 0;
+        for (long i = 0; ok && i < n; ++i) {
+            if (shardOf(accs[i].accountNumber, l->shards) != k) continue;
+            taken[i] = idxProbe(idxSlots(sh), sh->idx->capacity, accs[i].accountNumber)->used;
+            if (!taken[i]) part[m++] = accs[i];
+        }
+        ok = ok && shardAppend(sh, part, m);
+        if (locked) (void)rangeLock(sh->fd, F_UNLCK, LOCK_BYTE_APPEND, 1);
+        pthread_rwlock_unlock(&sh->lock);
+    }
+    pthread_rwlock_unlock(&g_layoutLock);
+    free(part);
+
+    long kept = 0;
+    for (long i = 0; ok && i < n; ++i) {
+        if (!taken[i]) accs[kept++] = accs[i];
+    }
+    return ok ? kept : -1;
+}
+
+bool accountExists(int accountNumber) {
+    return accountRef(accountNumber) != NULL;
+}
+
+/* ======================= Journal (WAL) ======================= */
+/*
+ * Account mutations become durable in accounts.wal before they touch the
+ * mapped store. A commit appends one record holding the after-image of every
+ * account it changes (both legs of a transfer travel together), and commits
+ * that arrive while a flush is running share the next fdatasync: whoever finds
+ * no flush in progress becomes the leader, writes everything buffered so far,
+ * applies it to the store and wakes the rest. A background thread checkpoints
+ * (msync the store, then truncate the log), and walOpen() in the first
+ * process to open the files replays whatever was not checkpointed.
+ *
+ * Processes sharing the files share one log. A leader holds the journal lock
+ * byte from its write until its images are in the store, and checkpoints and
+ * replays hold it too, so the log is one ordered stream and is never cut
+ * while it holds a record that has not been applied yet.
+ *
+ * Commits to the same account must be serialized by the caller; commits to
+ * different accounts may run concurrently.
+ */
+#define WAL_MAGIC            0x324C4157u   /* "WAL2": version 2 Account images */
+#define WAL_MAX_IMAGES       (1u << 20)
+#define WAL_CHECKPOINT_BYTES ((uint64_t)16 << 20)
+#define WAL_CHECKPOINT_MS    1000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t count;      // account images that follow
+    uint64_t lsn;
+    uint32_t checksum;   // FNV-1a over lsn, count and the images
+    uint32_t reserved;
+} WalRecord;
+
+typedef struct {
+    int              fd;
+    pthread_mutex_t  mu;
+    pthread_cond_t   flushed;    // durableLsn advanced
+    pthread_cond_t   wake;       // checkpointer: stop, or log grew large
+    char            *buf;        // records appended but not yet written
+    size_t           len, cap;
+    char            *spare;      // buffer the current leader is writing
+    size_t           spareCap;
+    uint64_t         nextLsn;
+    uint64_t         durableLsn;
+    uint64_t         logBytes;   // size of accounts.wal after our last write
+    bool             flushing;   // a leader or a checkpoint owns the log
+    bool             failed;     // a write/fsync failed: refuse further commits
+    bool             stop;
+    bool             running;
+    pthread_t        thread;
+} Journal;
+
+static Journal g_wal = {
+    .fd = -1,
+    .mu = PTHREAD_MUTEX_INITIALIZER,
+    .flushed = PTHREAD_COND_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+const char* journalFile(void) {
+    return "accounts.wal";
+}
+
+static uint32_t fnv1a(uint32_t h, const void *data, size_t n) {
+    const unsigned char *p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; ++i) { h ^= p[i]; h *= 16777619u; }
+    return h;
+}
+
+static uint32_t walChecksum(uint64_t lsn, uint32_t count, const void *images, size_t imageSize) {
+    uint32_t h = 2166136261u;
+    h = fnv1a(h, &lsn, sizeof(lsn));
+    h = fnv1a(h, &count, sizeof(count));
+    return fnv1a(h, images, (size_t)count * imageSize);
+}
+
+static bool writeAll(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = ioWrite(fd, p, n);
+        if (w < 0) return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+static bool growBuffer(char **buf, size_t *cap, size_t need) {
+    if (need <= *cap) return true;
+    size_t n = *cap ? *cap : 4096;
+    while (n < need) n *= 2;
+    char *p = (char*)realloc(*buf, n);
+    if (!p) return false;
+    *buf = p;
+    *cap = n;
+    return true;
+}
+
+/* Copies every image of a written batch into the store. */
+static void walApply(const char *buf, size_t len) {
+    size_t pos = 0;
+    while (pos + sizeof(WalRecord) <= len) {
+        WalRecord r;
+        memcpy(&r, buf + pos, sizeof(r));
+        const Account *img = (const Account*)(buf + pos + sizeof(WalRecord));
+        for (uint32_t i = 0; i < r.count; ++i) {
+            StoreShard *sh;
+            Account *a = shardRef(img[i].accountNumber, &sh);
+            if (!a) continue;
+            recordWrite(a, &img[i]);
+            storeNoteWrite(sh, (size_t)((char*)a - sh->base));
+        }
+        pos += sizeof(WalRecord) + (size_t)r.count * sizeof(Account);
+    }
+}
+
+/* Leader only: writes a batch, waits for the disk and applies it, under the
+   journal lock byte. Returns the log size afterwards, or -1. */
+static off_t walWriteBatch(const char *buf, size_t len) {
+    if (!rangeLock(g_store.fd, F_WRLCK, LOCK_BYTE_WAL, 1)) return -1;
+    off_t end = -1;
+    IoChunk c = { buf, len, -1 };
+    if (ioWriteChunks(g_wal.fd, &c, 1, true)) {
+        walApply(buf, len);
+        end = lseek(g_wal.fd, 0, SEEK_END);
+    }
+    (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_WAL, 1);
+    return end;
+}
+
+/* Called with g_wal.mu held; returns once lsn is on disk and in the store. */
+static bool walFlushUntil(uint64_t lsn) {
+    while (g_wal.durableLsn < lsn) {
+        if (g_wal.failed) return false;
+        if (g_wal.flushing) {
+            pthread_cond_wait(&g_wal.flushed, &g_wal.mu);
+            continue;
+        }
+
+        // become the leader: take everything buffered so far
+        char *out = g_wal.buf;         size_t outCap = g_wal.cap;
+        g_wal.buf = g_wal.spare;       g_wal.cap = g_wal.spareCap;
+        g_wal.spare = out;             g_wal.spareCap = outCap;
+        size_t len = g_wal.len;
+        uint64_t upto = g_wal.nextLsn;
+        g_wal.len = 0;
+        g_wal.flushing = true;
+        pthread_mutex_unlock(&g_wal.mu);
+
+        off_t end = walWriteBatch(out, len);
+
+        pthread_mutex_lock(&g_wal.mu);
+        g_wal.flushing = false;
+        if (end >= 0) {
+            g_wal.durableLsn = upto;
+            g_wal.logBytes = (uint64_t)end;
+        } else {
+            g_wal.failed = true;
+        }
+        pthread_cond_broadcast(&g_wal.flushed);
+    }
+    return true;
+}
+
+static bool cacheEnabled(void);
+static bool cacheCommit(const Account *const *accs, int n);
+static void cacheOpen(void);
+static void cacheClose(void);
+
+/* Durably records the new images of n accounts, then writes them into the
+   store. Either all of them reach the journal or none is applied. The caller
+   holds the accounts' locks. */
+static bool walCommit(const Account *const *accs, int n) {
+    if (n <= 0 || (unsigned)n > WAL_MAX_IMAGES) return false;
+
+    bool ok = true;
+    for (int i = 0; i < n && ok; ++i) ok = accountRef(accs[i]->accountNumber) != NULL;
+
+    if (ok && g_wal.running) {
+        pthread_mutex_lock(&g_wal.mu);
+
+        size_t bytes = sizeof(WalRecord) + (size_t)n * sizeof(Account);
+        ok = !g_wal.failed && growBuffer(&g_wal.buf, &g_wal.cap, g_wal.len + bytes);
+        if (ok) {
+            WalRecord r = { WAL_MAGIC, (uint32_t)n, ++g_wal.nextLsn, 0, 0 };
+            Account *img = (Account*)(g_wal.buf + g_wal.len + sizeof(WalRecord));
+            for (int i = 0; i < n; ++i) img[i] = *accs[i];
+            r.checksum = walChecksum(r.lsn, r.count, img, sizeof(Account));
+            memcpy(g_wal.buf + g_wal.len, &r, sizeof(r));
+            g_wal.len += bytes;
+            ok = walFlushUntil(r.lsn);
+        }
+        bool big = g_wal.logBytes >= WAL_CHECKPOINT_BYTES;
+        pthread_mutex_unlock(&g_wal.mu);
+        if (big) pthread_cond_signal(&g_wal.wake);
+    } else if (ok) {
+        // journal not running (offline tools): write straight to the store
+        for (int i = 0; i < n; ++i) {
+            StoreShard *sh;
+            Account *dst = shardRef(accs[i]->accountNumber, &sh);
+            if (dst != accs[i]) recordWrite(dst, accs[i]);
+            storeNoteWrite(sh, (size_t)((char*)dst - sh->base));
+        }
+    }
+    return ok;
+}
+
+/* Commits accs only if each account is still at the version its image was
+   read at, and bumps their versions; ATM_ERR_CONFLICT if another commit came
+   first. The caller holds the accounts' locks. Goes through the write-back
+   cache when it is on (see Account Cache). */
+AtmStatus commitIfCurrent(Account *const *accs, int n) {
+    STAT_SCOPE(ST_COMMIT);
+    for (int i = 0; i < n; ++i) {
+        Account cur;
+        if (!loadAccount(accs[i]->accountNumber, &cur)) return ATM_ERR_NOT_FOUND;
+        if (cur.version != accs[i]->version) return ATM_ERR_CONFLICT;
+    }
+    for (int i = 0; i < n; ++i) accs[i]->version++;
+    const Account *const *imgs = (const Account *const *)accs;
+    bool ok = cacheEnabled() ? cacheCommit(imgs, n) : walCommit(imgs, n);
+    return ok ? ATM_OK : ATM_ERR_IO;
+}
+
+/* commitIfCurrent() for images read under the accounts' locks. */
+bool commitAccounts(const Account *const *accs, int n) {
+    if (n <= 0 || (unsigned)n > WAL_MAX_IMAGES) return false;
+    Account local[2], *localRef[2];
+    Account *imgs = n <= 2 ? local : (Account*)malloc((size_t)n * sizeof(Account));
+    Account **ref = n <= 2 ? localRef : (Account**)malloc((size_t)n * sizeof(Account*));
+    bool ok = imgs && ref;
+    for (int i = 0; ok && i < n; ++i) {
+        imgs[i] = *accs[i];
+        ref[i] = &imgs[i];
+    }
+    ok = ok && commitIfCurrent(ref, n) == ATM_OK;
+    if (imgs != local) free(imgs);
+    if (ref != localRef) free(ref);
+    return ok;
+}
+
+static bool backupRunning(void);
+
+static void walUnhold(bool emptied);
+
+/* Takes the log the way a leader does, so no batch is half written or half
+   applied while it is held. */
+static bool walHold(void) {
+    pthread_mutex_lock(&g_wal.mu);
+    while (g_wal.flushing) pthread_cond_wait(&g_wal.flushed, &g_wal.mu);
+    g_wal.flushing = true;
+    pthread_mutex_unlock(&g_wal.mu);
+    if (rangeLock(g_store.fd, F_WRLCK, LOCK_BYTE_WAL, 1)) return true;
+    walUnhold(false);
+    return false;
+}
+
+/* Lets go of walHold(); emptied if the holder truncated the log. */
+static void walUnhold(bool emptied) {
+    (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_WAL, 1);
+    pthread_mutex_lock(&g_wal.mu);
+    g_wal.flushing = false;
+    if (emptied) g_wal.logBytes = 0;
+    pthread_cond_broadcast(&g_wal.flushed);
+    pthread_mutex_unlock(&g_wal.mu);
+}
+
+/* Makes every applied commit durable in the account files and empties the log.
+   While a backup runs the log is left alone: the backup reads back the
+   records written since it started (see Backup and Restore). */
+bool walCheckpoint(void) {
+    if (!g_wal.running) return storeSync();
+    if (backupRunning()) return true;
+    if (!walHold()) return false;
+
+    // other processes' records are covered too: their pages are ours
+    bool kept = backupRunning();   // one may have started since the look above
+    bool ok = kept || (storeSync() && ftruncate(g_wal.fd, 0) == 0 && ioFdatasync(g_wal.fd) == 0);
+    walUnhold(ok && !kept);
+    return ok;
+}
+
+/* Absolute CLOCK_REALTIME time ms from now, for pthread_cond_timedwait. */
+static struct timespec deadlineAfter(long ms) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec  += ms / 1000;
+    until.tv_nsec += (ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) { until.tv_sec++; until.tv_nsec -= 1000000000L; }
+    return until;
+}
+
+static void* walCheckpointer(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_wal.mu);
+    while (!g_wal.stop) {
+        struct timespec until = deadlineAfter(WAL_CHECKPOINT_MS);
+        pthread_cond_timedwait(&g_wal.wake, &g_wal.mu, &until);
+
+        if (g_wal.stop || g_wal.logBytes == 0) continue;
+        pthread_mutex_unlock(&g_wal.mu);
+        (void)walCheckpoint();
+        pthread_mutex_lock(&g_wal.mu);
+    }
+    pthread_mutex_unlock(&g_wal.mu);
+    return NULL;
+}
+
+/* Re-applies every complete record; a torn or corrupt tail ends the replay. */
+static long walReplay(void) {
+    FILE *fp = fdopen(dup(g_wal.fd), "rb");
+    if (!fp) return -1;
+
+    long applied = 0;
+    Account *img = NULL;
+    size_t imgCap = 0;
+    WalRecord r;
+    while (ioFread(&r, sizeof(r), 1, fp) == 1) {
+        if (r.magic != WAL_MAGIC || r.count == 0 || r.count > WAL_MAX_IMAGES) break;
+        if (!growBuffer((char**)&img, &imgCap, (size_t)r.count * sizeof(Account))) break;
+        if (ioFread(img, sizeof(Account), r.count, fp) != r.count) break;
+        if (r.checksum != walChecksum(r.lsn, r.count, img, sizeof(Account))) break;
+
+        for (uint32_t i = 0; i < r.count; ++i) {
+            Account *a = accountRef(img[i].accountNumber);
+            if (a) *a = img[i];
+        }
+        applied++;
+    }
+    free(img);
+    fclose(fp);
+    return applied;
+}
+
+bool walOpen(void) {
+    if (g_wal.running) return true;
+    if (!storeOpen()) return false;
+
+    g_wal.fd = ioOpen(journalFile(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (g_wal.fd < 0) return false;
+
+    // Starting processes take turns on the journal lock. Only one that is
+    // alone replays: the replay passes through older images of the records,
+    // and another process could read one of them and commit on top of it.
+    // While others run, every record has been applied already.
+    if (!rangeLock(g_store.fd, F_WRLCK, LOCK_BYTE_WAL, 1)) {
+        close(g_wal.fd);
+        g_wal.fd = -1;
+        return false;
+    }
+    bool alone = rangeTryLock(g_store.fd, F_WRLCK, LOCK_BYTE_OWNER, 1);
+    if (!alone && !rangeTryLock(g_store.fd, F_RDLCK, LOCK_BYTE_OWNER, 1)) {
+        // a write-back cache or an end-of-day run needs the files to itself
+        printf("The accounts are in use by an atm process that needs them to itself.\n");
+        (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_WAL, 1);
+        close(g_wal.fd);
+        g_wal.fd = -1;
+        return false;
+    }
+    bool ok = true;
+    if (alone) {
+        long replayed = walReplay();
+        if (replayed > 0) printf("Recovered %ld journal record(s).\n", replayed);
+        long redone = replayed >= 0 ? bulkRecover() : -1;
+        if (redone > 0) printf("Recovered %ld bulk transfer batch(es).\n", redone);
+        ok = redone >= 0 && storeSync() && ftruncate(g_wal.fd, 0) == 0;
+        (void)rangeLock(g_store.fd, F_RDLCK, LOCK_BYTE_OWNER, 1);
+    }
+    (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_WAL, 1);
+    if (!alone) {
+        // wait until the writer threads of the others stop queueing (see Writer thread)
+        (void)rangeLock(g_store.fd, F_WRLCK, LOCK_BYTE_ASYNC, 1);
+        (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_ASYNC, 1);
+    }
+
+    g_wal.logBytes = 0;
+    g_wal.failed = false;
+    g_wal.stop = false;
+    if (!ok || pthread_create(&g_wal.thread, NULL, walCheckpointer, NULL) != 0) {
+        close(g_wal.fd);
+        g_wal.fd = -1;
+        (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_OWNER, 1);
+        return false;
+    }
+    g_wal.running = true;
+    cacheOpen();
+    return true;
+}
+
+void walClose(void) {
+    if (!g_wal.running) return;
+    cacheClose();   // its last flush still goes through the journal
+    pthread_mutex_lock(&g_wal.mu);
+    g_wal.stop = true;
+    pthread_cond_signal(&g_wal.wake);
+    pthread_mutex_unlock(&g_wal.mu);
+    pthread_join(g_wal.thread, NULL);
+
+    (void)walCheckpoint();
+    g_wal.running = false;
+    close(g_wal.fd);
+    g_wal.fd = -1;
+    free(g_wal.buf);   g_wal.buf = NULL;   g_wal.cap = 0;
+    free(g_wal.spare); g_wal.spare = NULL; g_wal.spareCap = 0;
+    (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_OWNER, 1);
+}
+
+/* ======================= Legacy Format ======================= */
+/*
+ * Before version 2, accounts.dat was a headerless dump of LegacyAccount (136
+ * bytes on the usual ABIs: hex PIN hash, double balance, padded name) and the
+ * journal ("WAL1") logged the same images. storeOpen() upgrades such a file
+ * once: it loads the records, replays the old journal onto them, writes the
+ * version 2 file next to the old one and renames it into place, so a crash
+ * part way leaves the legacy file untouched. Names longer than 15 characters
+ * are cut to fit the record, and each one cut is reported.
+ */
+#define WAL_MAGIC_LEGACY 0x314C4157u   /* "WAL1" */
+
+typedef struct {
+    int    accountNumber;
+    char   name[50];
+    char   pinHash[65];    // SHA-256 hex string (64 chars + null)
+    double balance;
+    int    failedAttempts;
+    int    locked;
+} LegacyAccount;
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* Returns false if the name had to be cut. */
+static bool legacyConvert(const LegacyAccount *o, Account *a) {
+    memset(a, 0, sizeof(*a));
+    a->accountNumber = o->accountNumber;
+    a->failedAttempts = o->failedAttempts < 0 ? 0 : o->failedAttempts > 15 ? 15 : (unsigned)o->failedAttempts;
+    a->locked = o->locked != 0;
+    a->balanceCents = toCents(o->balance);
+    size_t nameLen = strnlen(o->name, sizeof(o->name));
+    memcpy(a->name, o->name, nameLen < ACCOUNT_NAME_MAX ? nameLen : ACCOUNT_NAME_MAX);
+    for (int i = 0; i < 32; ++i) {
+        int hi = hexNibble(o->pinHash[2 * i]), lo = hexNibble(o->pinHash[2 * i + 1]);
+        if (hi < 0 || lo < 0) {
+            // unreadable hash: no PIN can match it, the admin has to reset it
+            memset(a->pinHash, 0, sizeof(a->pinHash));
+            break;
+        }
+        a->pinHash[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return nameLen <= ACCOUNT_NAME_MAX;
+}
+
+/* Applies the complete records of a legacy journal to recs[0..n). */
+static long legacyReplay(LegacyAccount *recs, size_t n) {
+    FILE *fp = ioFopen(journalFile(), "rb");
+    if (!fp) return 0;
+
+    uint64_t cap = idxCapacityFor(n + 1);
+    IndexSlot *slots = (IndexSlot*)calloc((size_t)cap, sizeof(IndexSlot));
+    long applied = slots ? 0 : -1;
+    for (size_t i = 0; slots && i < n; ++i) {
+        IndexSlot *sl = idxProbe(slots, cap, recs[i].accountNumber);
+        if (sl->used) continue;   // the first record wins, as in lookups
+        sl->accountNumber = recs[i].accountNumber;
+        sl->used = 1;
+        sl->offset = (int64_t)i;
+    }
+
+    LegacyAccount *img = NULL;
+    size_t imgCap = 0;
+    WalRecord r;
+    while (applied >= 0 && ioFread(&r, sizeof(r), 1, fp) == 1) {
+        if (r.magic != WAL_MAGIC_LEGACY || r.count == 0 || r.count > WAL_MAX_IMAGES) break;
+        if (!growBuffer((char**)&img, &imgCap, (size_t)r.count * sizeof(LegacyAccount))) break;
+        if (ioFread(img, sizeof(LegacyAccount), r.count, fp) != r.count) break;
+        if (r.checksum != walChecksum(r.lsn, r.count, img, sizeof(LegacyAccount))) break;
+        for (uint32_t i = 0; i < r.count; ++i) {
+            IndexSlot *sl = idxProbe(slots, cap, img[i].accountNumber);
+            if (sl->used) recs[sl->offset] = img[i];
+        }
+        applied++;
+    }
+    free(img);
+    free(slots);
+    fclose(fp);
+    return applied;
+}
+
+/* Upgrades a headerless accounts.dat in place; a no-op for any other file. */
+static bool storeMigrateLegacy(void) {
+    int fd = ioOpen(accountsFile(), O_RDWR);
+    if (fd < 0) return errno == ENOENT;
+
+    struct stat st, now;
+    uint32_t magic = 0;
+    bool ok = fstat(fd, &st) == 0;
+    if (!ok || st.st_size == 0 ||
+        (ioPread(fd, &magic, sizeof(magic), 0) == (ssize_t)sizeof(magic) && magic == STORE_MAGIC)) {
+        close(fd);
+        return ok;
+    }
+
+    // one process migrates; the others find the new file when they get the lock
+    ok = rangeLock(fd, F_WRLCK, LOCK_BYTE_APPEND, 1);
+    if (ok && (stat(accountsFile(), &now) != 0 || now.st_ino != st.st_ino)) {
+        close(fd);
+        return true;
+    }
+
+    size_t n = (size_t)st.st_size / sizeof(LegacyAccount);   // a torn tail is dropped
+    LegacyAccount *old = (LegacyAccount*)malloc(n ? n * sizeof(LegacyAccount) : 1);
+    Account *conv = (Account*)calloc(n + 1, sizeof(Account));   // header slot, then records
+    ok = ok && old && conv &&
+         ioPread(fd, old, n * sizeof(LegacyAccount), 0) == (ssize_t)(n * sizeof(LegacyAccount));
+    long replayed = ok ? legacyReplay(old, n) : -1;
+    ok = ok && replayed >= 0;
+
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.migrate", accountsFile());
+    if (ok) {
+        StoreHeader *h = (StoreHeader*)conv;
+        h->magic = STORE_MAGIC;
+        h->version = STORE_VERSION;
+        h->headerSize = sizeof(StoreHeader);
+        h->recordSize = sizeof(Account);
+        h->count = n;
+        for (size_t i = 0; i < n; ++i) {
+            if (legacyConvert(&old[i], &conv[i + 1])) continue;
+            printf("⚠️ A/C %d: name \"%.*s\" cut to \"%s\".\n", old[i].accountNumber,
+                   (int)strnlen(old[i].name, sizeof(old[i].name)), old[i].name, conv[i + 1].name);
+        }
+
+        int out = ioOpen(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        ok = out >= 0 && writeAll(out, (const char*)conv, (n + 1) * sizeof(Account)) && ioFsync(out) == 0;
+        if (out >= 0 && close(out) != 0) ok = false;
+        ok = ok && rename(tmp, accountsFile()) == 0;
+        if (!ok) remove(tmp);
+    }
+    if (ok) {
+        // both hold legacy offsets/images; the new store starts clean
+        remove(journalFile());
+        remove(indexFile());
+        printf("Migrated %zu account(s) to record format v%u", n, STORE_VERSION);
+        if (replayed > 0) printf(" (%ld journal record(s) applied)", replayed);
+        printf(".\n");
+    } else {
+        printf("Could not migrate the legacy accounts file.\n");
+    }
+    free(old);
+    free(conv);
+    close(fd);   // drops the lock with it
+    return ok;
+}
+
+/* ======================= Logging ======================= */
+/*
+ * Every transaction goes to one append-only binary log split into segments
+ * (txlog.000001.seg, txlog.000002.seg, ...). A segment is a 64-byte header
+ * followed by fixed-size 64-byte TxRecords, so the writer keeps the current
+ * segment open and a reader can seek straight to any record. The writer
+ * starts a new segment once the current one reaches TXLOG_SEGMENT_BYTES.
+ *
+ * Segments fill to exactly TXLOG_SEG_RECORDS records, so a record has a
+ * global position (segment, slot). Each record carries the position of the
+ * same account's previous record, and txlog.heads (a hash table built like
+ * accounts.idx) maps accountNumber -> position of its newest record.
+ * The last N entries of an account are N positioned reads, however long its
+ * history is.
+ *
+ * For date ranges, txlog.marks samples every TXMARK_EVERY-th record of each
+ * account: its timestamp and position, linked to the account's previous
+ * mark, with the newest mark named by the account's heads slot. A range
+ * query walks these sparse marks down to where the range starts and reads
+ * only the records from there on (see Statement queries).
+ *
+ * Appends and heads lookups hold the log's lock byte in accounts.dat, so
+ * processes sharing the log take turns; on taking it a process picks up what
+ * the others appended in the meantime. Appends come from a writer thread in
+ * batches (see Writer thread).
+ */
+#define TXLOG_MAGIC         0x474C5854u   /* "TXLG" */
+#define TXLOG_VERSION       2u
+#define TXLOG_SEGMENT_BYTES ((uint64_t)64 << 20)
+#define TXLOG_SCAN_CHUNK    256           /* records per backward read */
+#define TXLOG_SEG_RECORDS   ((int64_t)((TXLOG_SEGMENT_BYTES - sizeof(TxSegmentHeader)) / sizeof(TxRecord)))
+#define HEADS_MAGIC         0x53444854u   /* "THDS" */
+#define HEADS_VERSION       2u
+#define TXMARK_MAGIC        0x4B524D54u   /* "TMRK" */
+#define TXMARK_VERSION      1u
+#define TXMARK_EVERY        64            /* records of an account per time mark */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    uint32_t recordSize;
+    char     pad[48];
+} TxSegmentHeader;
+
+/* One txlog.marks entry: a sampled record of the account. */
+typedef struct {
+    int32_t  accountNumber;
+    uint32_t reserved;
+    int64_t  timestamp;
+    int64_t  pos;            // log position of the record
+    int64_t  prev;           // index of the account's previous mark, -1 if none
+} TxMark;
+
+/* One txlog.heads slot: an accounts.idx slot plus the account's marks. */
+typedef struct {
+    int32_t  accountNumber;
+    uint32_t used;
+    int64_t  offset;         // position of the newest record
+    int64_t  mark;           // index of the newest mark, -1 if none
+    uint32_t since;          // records after that mark
+    uint32_t pad;
+} HeadSlot;
+
+static const char *const txTypeNames[] = {
+    "?", "DEPOSIT", "WITHDRAW", "TRANSFER-", "TRANSFER+", "PIN-CHG", "INTEREST", "FEE"
+};
+
+static struct {
+    pthread_mutex_t mu;
+    int             fd;      // current segment, opened lazily
+    uint32_t        seq;
+    uint64_t        size;
+    int64_t         endPos;  // global position of the next record
+    IndexHeader    *heads;   // mapped txlog.heads; dataSize -1 while an append is under way
+    size_t          headsLen;
+    ino_t           headsIno;
+    int             marksFd;     // txlog.marks
+    int64_t         markCount;   // marks written
+    char           *pending;     // TxMarks headsPut() queued for the next marksFlush()
+    size_t          pendingCap;
+    size_t          pendingN;
+} g_txlog = { PTHREAD_MUTEX_INITIALIZER, -1, 0, 0, 0, NULL, 0, 0, -1, 0, NULL, 0, 0 };
+
+const char* headsFile(void) {
+    return "txlog.heads";
+}
+
+const char* marksFile(void) {
+    return "txlog.marks";
+}
+
+static uint32_t posSeq(int64_t pos) {
+    return (uint32_t)(pos / TXLOG_SEG_RECORDS) + 1;
+}
+
+static off_t posOffset(int64_t pos) {
+    return (off_t)(sizeof(TxSegmentHeader) + (uint64_t)(pos % TXLOG_SEG_RECORDS) * sizeof(TxRecord));
+}
+
+const char* txTypeName(int type) {
+    return (type > 0 && type <= TX_FEE) ? txTypeNames[type] : txTypeNames[0];
+}
+
+int64_t toCents(double amount) {
+    return (int64_t)(amount * 100.0 + (amount < 0 ? -0.5 : 0.5));
+}
+
+/* Writes cents as "1234.56" at p (at most 22 bytes, no NUL) and returns the
+   end, without going through floating point. */
+static char* putCents(char *p, int64_t cents) {
+    uint64_t v = cents < 0 ? (uint64_t)0 - (uint64_t)cents : (uint64_t)cents;
+    char tmp[24];
+    char *t = tmp + sizeof(tmp);
+    *--t = (char)('0' + v % 10); v /= 10;
+    *--t = (char)('0' + v % 10); v /= 10;
+    *--t = '.';
+    do { *--t = (char)('0' + v % 10); v /= 10; } while (v);
+    if (cents < 0) *--t = '-';
+
+    size_t n = (size_t)(tmp + sizeof(tmp) - t);
+    memcpy(p, t, n);
+    return p + n;
+}
+
+char* fmtCents(int64_t cents, char buf[24]) {
+    *putCents(buf, cents) = '\0';
+    return buf;
+}
+
+void txSegmentPath(uint32_t seq, char *buf, size_t n) {
+    snprintf(buf, n, "txlog.%06u.seg", seq);
+}
+
+/* Finds the oldest and newest segment numbers present on disk. */
+bool txlogSegmentRange(uint32_t *first, uint32_t *last) {
+    DIR *dir = opendir(".");
+    if (!dir) return false;
+
+    bool any = false;
+    struct dirent *e;
+    while ((e = readdir(dir)) != NULL) {
+        unsigned seq;
+        char tail[8];
+        if (sscanf(e->d_name, "txlog.%u.%7s", &seq, tail) != 2 || strcmp(tail, "seg") != 0) continue;
+        if (!any || seq < *first) *first = seq;
+        if (!any || seq > *last)  *last = seq;
+        any = true;
+    }
+    closedir(dir);
+    return any;
+}
+
+/* Opens (creating if needed) segment seq for appending; a torn trailing
+   record left by a crash is cut off. Called with g_txlog.mu held. */
+static bool txlogOpenSegment(uint32_t seq) {
+    char path[64];
+    txSegmentPath(seq, path, sizeof(path));
+    int fd = ioOpen(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return false; }
+
+    uint64_t size = (uint64_t)st.st_size;
+    if (size < sizeof(TxSegmentHeader)) {
+        TxSegmentHeader h = { TXLOG_MAGIC, TXLOG_VERSION, seq, sizeof(TxRecord), {0} };
+        if (ftruncate(fd, 0) != 0 || !writeAll(fd, (const char*)&h, sizeof(h))) { close(fd); return false; }
+        size = sizeof(h);
+    } else {
+        uint64_t whole = size - (size - sizeof(TxSegmentHeader)) % sizeof(TxRecord);
+        if (whole != size && ftruncate(fd, (off_t)whole) != 0) { close(fd); return false; }
+        size = whole;
+    }
+
+    g_txlog.fd = fd;
+    g_txlog.seq = seq;
+    g_txlog.size = size;
+    g_txlog.endPos = (int64_t)(seq - 1) * TXLOG_SEG_RECORDS +
+                     (int64_t)((size - sizeof(TxSegmentHeader)) / sizeof(TxRecord));
+    return true;
+}
+
+/* ---- Statement heads (txlog.heads) ----
+   The accounts.idx hash table with wider slots (HeadSlot); dataSize holds
+   the log position the table is complete up to. All helpers run with
+   g_txlog.mu held. */
+static HeadSlot* headsSlots(void) {
+    return (HeadSlot*)(g_txlog.heads + 1);
+}
+
+static HeadSlot* headsProbe(HeadSlot *slots, uint64_t cap, int32_t key) {
+    uint64_t mask = cap - 1;
+    for (uint64_t i = idxHash(key) & mask;; i = (i + 1) & mask) {
+        if (!slots[i].used || slots[i].accountNumber == key) return &slots[i];
+    }
+}
+
+static void headsUnmap(void) {
+    if (g_txlog.heads) munmap(g_txlog.heads, g_txlog.headsLen);
+    g_txlog.heads = NULL;
+    g_txlog.headsLen = 0;
+}
+
+static IndexHeader* headsCreate(const char *path, uint64_t cap, size_t *len, ino_t *ino) {
+    int fd = ioOpen(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return NULL;
+    size_t n = sizeof(IndexHeader) + (size_t)cap * sizeof(HeadSlot);
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, (off_t)n) == 0 && fstat(fd, &st) == 0) {
+        p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+
+    IndexHeader *h = (IndexHeader*)p;
+    h->magic = HEADS_MAGIC;
+    h->version = HEADS_VERSION;
+    h->capacity = cap;
+    h->count = 0;
+    h->dataSize = 0;
+    *len = n;
+    *ino = st.st_ino;
+    return h;
+}
+
+static bool headsMap(void) {
+    int fd = ioOpen(headsFile(), O_RDWR);
+    if (fd < 0) return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(IndexHeader)) {
+        p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (p == MAP_FAILED) return false;
+
+    IndexHeader *h = (IndexHeader*)p;
+    if (h->magic == HEADS_MAGIC && h->version == HEADS_VERSION &&
+        h->capacity >= IDX_MIN_CAP && (h->capacity & (h->capacity - 1)) == 0 &&
+        (size_t)st.st_size == sizeof(IndexHeader) + h->capacity * sizeof(HeadSlot)) {
+        g_txlog.heads = h;
+        g_txlog.headsLen = (size_t)st.st_size;
+        g_txlog.headsIno = st.st_ino;
+        return true;
+    }
+    munmap(p, (size_t)st.st_size);
+    return false;
+}
+
+/* Rehashes into a table of cap slots (a fresh empty one if none is mapped). */
+static bool headsResize(uint64_t cap) {
+    char tmp[64];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", headsFile());
+    size_t len;
+    ino_t ino;
+    IndexHeader *h = headsCreate(tmp, cap, &len, &ino);
+    if (!h) return false;
+
+    IndexHeader *old = g_txlog.heads;
+    if (old) {
+        HeadSlot *from = headsSlots(), *to = (HeadSlot*)(h + 1);
+        for (uint64_t i = 0; i < old->capacity; ++i) {
+            if (from[i].used) *headsProbe(to, cap, from[i].accountNumber) = from[i];
+        }
+        h->count = old->count;
+        h->dataSize = old->dataSize;
+    }
+    if (rename(tmp, headsFile()) != 0) { munmap(h, len); remove(tmp); return false; }
+    headsUnmap();
+    g_txlog.heads = h;
+    g_txlog.headsLen = len;
+    g_txlog.headsIno = ino;
+    return true;
+}
+
+/* Makes rec, at position pos, its account's newest record; every
+   TXMARK_EVERY-th one also gets a mark, queued for marksFlush(). */
+static bool headsPut(const TxRecord *rec, int64_t pos) {
+    if ((g_txlog.heads->count + 1) * 2 > g_txlog.heads->capacity &&
+        !headsResize(g_txlog.heads->capacity * 2)) {
+        return false;
+    }
+    HeadSlot *s = headsProbe(headsSlots(), g_txlog.heads->capacity, rec->accountNumber);
+    if (!s->used) {
+        s->accountNumber = rec->accountNumber;
+        s->used = 1;
+        s->mark = -1;
+        s->since = 0;
+        g_txlog.heads->count++;
+    }
+    s->offset = pos;
+    if (++s->since < TXMARK_EVERY) return true;
+
+    if (!growBuffer(&g_txlog.pending, &g_txlog.pendingCap, (g_txlog.pendingN + 1) * sizeof(TxMark))) {
+        return false;
+    }
+    TxMark *m = (TxMark*)g_txlog.pending + g_txlog.pendingN;
+    m->accountNumber = rec->accountNumber;
+    m->reserved = 0;
+    m->timestamp = rec->timestamp;
+    m->pos = pos;
+    m->prev = s->mark;
+    s->mark = g_txlog.markCount + (int64_t)g_txlog.pendingN++;
+    s->since = 0;
+    return true;
+}
+
+/* Opens txlog.marks; with reset set (the heads are being rebuilt) it is
+   emptied, otherwise it must already be a marks file. */
+static bool marksOpen(bool reset) {
+    if (g_txlog.marksFd >= 0) close(g_txlog.marksFd);
+    g_txlog.markCount = 0;
+    g_txlog.pendingN = 0;
+    int fd = g_txlog.marksFd = ioOpen(marksFile(), O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) return false;
+
+    TxSegmentHeader h;
+    if (!reset && (size_t)st.st_size >= sizeof(h) &&
+        ioPread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && h.magic == TXMARK_MAGIC &&
+        h.version == TXMARK_VERSION && h.recordSize == sizeof(TxMark)) {
+        // a torn last mark is written over by the next flush
+        g_txlog.markCount = (int64_t)(((uint64_t)st.st_size - sizeof(h)) / sizeof(TxMark));
+        return true;
+    }
+    if (!reset) return false;
+    TxSegmentHeader fresh = { TXMARK_MAGIC, TXMARK_VERSION, 0, sizeof(TxMark), {0} };
+    return ftruncate(fd, 0) == 0 && ioPwrite(fd, &fresh, sizeof(fresh), 0) == (ssize_t)sizeof(fresh);
+}
+
+/* Writes the marks headsPut() queued; done before dataSize moves past them. */
+static bool marksFlush(void) {
+    if (g_txlog.pendingN == 0) return true;
+    size_t bytes = g_txlog.pendingN * sizeof(TxMark);
+    off_t at = (off_t)(sizeof(TxSegmentHeader) + (uint64_t)g_txlog.markCount * sizeof(TxMark));
+    if (ioPwrite(g_txlog.marksFd, g_txlog.pending, bytes, at) != (ssize_t)bytes) return false;
+    g_txlog.markCount += (int64_t)g_txlog.pendingN;
+    g_txlog.pendingN = 0;
+    return true;
+}
+
+/* Feeds records [from, endPos) into the table. */
+static bool headsCatchUp(int64_t from) {
+    TxRecord *chunk = (TxRecord*)malloc(TXLOG_SCAN_CHUNK * sizeof(TxRecord));
+    if (!chunk) return false;
+
+    bool ok = true;
+    int64_t pos = from;
+    while (ok && pos < g_txlog.endPos) {
+        char path[64];
+        uint32_t seq = posSeq(pos);
+        int64_t segEnd = (int64_t)seq * TXLOG_SEG_RECORDS;
+        if (segEnd > g_txlog.endPos) segEnd = g_txlog.endPos;
+
+        txSegmentPath(seq, path, sizeof(path));
+        int fd = ioOpen(path, O_RDONLY);
+        if (fd < 0) { pos = segEnd; continue; }   // segment retired
+        while (ok && pos < segEnd) {
+            int64_t take = segEnd - pos < TXLOG_SCAN_CHUNK ? segEnd - pos : TXLOG_SCAN_CHUNK;
+            size_t bytes = (size_t)take * sizeof(TxRecord);
+            ok = ioPread(fd, chunk, bytes, posOffset(pos)) == (ssize_t)bytes;
+            for (int64_t i = 0; ok && i < take; ++i) ok = headsPut(&chunk[i], pos + i);
+            ok = ok && marksFlush();
+            pos += take;
+        }
+        close(fd);
+    }
+    free(chunk);
+    if (ok) g_txlog.heads->dataSize = g_txlog.endPos;
+    return ok;
+}
+
+static bool headsOpen(void) {
+    headsUnmap();
+    if (headsMap() && g_txlog.heads->dataSize >= 0 && g_txlog.heads->dataSize <= g_txlog.endPos &&
+        marksOpen(false)) {
+        return headsCatchUp(g_txlog.heads->dataSize);
+    }
+    // heads or marks missing or corrupt, torn by a crash inside an append, or
+    // ahead of a log that lost its tail: rebuild both
+    headsUnmap();
+    remove(headsFile());
+    return marksOpen(true) && headsResize(IDX_MIN_CAP) && headsCatchUp(0);
+}
+
+/* Called with g_txlog.mu held. */
+static bool txlogEnsureOpen(void) {
+    if (g_txlog.fd >= 0) return true;
+    uint32_t first, last;
+    if (!txlogOpenSegment(txlogSegmentRange(&first, &last) ? last : 1)) return false;
+    if (!headsOpen()) {
+        close(g_txlog.fd);
+        g_txlog.fd = -1;
+        return false;
+    }
+    return true;
+}
+
+/* Takes the log's lock byte (when the store is open to hold it) and, if
+   another process appended or replaced txlog.heads since we last looked,
+   reopens at the current end. Called with g_txlog.mu held. */
+static bool txlogAcquire(void) {
+    if (g_store.fd >= 0 && !rangeLock(g_store.fd, F_WRLCK, LOCK_BYTE_TXLOG, 1)) return false;
+    if (g_txlog.fd >= 0) {
+        struct stat st;
+        if (g_txlog.heads->dataSize != g_txlog.endPos ||
+            stat(headsFile(), &st) != 0 || st.st_ino != g_txlog.headsIno) {
+            close(g_txlog.fd);
+            g_txlog.fd = -1;
+            headsUnmap();
+        }
+    }
+    if (txlogEnsureOpen()) return true;
+    if (g_store.fd >= 0) (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_TXLOG, 1);
+    return false;
+}
+
+static void txlogRelease(void) {
+    if (g_store.fd >= 0) (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_TXLOG, 1);
+}
+
+/* Appends n records with one write per segment they land in, linking each
+   to its account's previous record (prev is filled in here). */
+static bool txlogAppendBatch(TxRecord *recs, int n) {
+    pthread_mutex_lock(&g_txlog.mu);
+    if (!txlogAcquire()) {
+        pthread_mutex_unlock(&g_txlog.mu);
+        return false;
+    }
+    g_txlog.heads->dataSize = -1;   // torn until the batch is in: a crash rebuilds the table
+    bool ok = true;
+    int done = 0;
+    while (ok && done < n) {
+        if (g_txlog.size + sizeof(TxRecord) > TXLOG_SEGMENT_BYTES) {
+            close(g_txlog.fd);
+            g_txlog.fd = -1;
+            if (!(ok = txlogOpenSegment(g_txlog.seq + 1))) break;
+        }
+        int take = (int)((TXLOG_SEGMENT_BYTES - g_txlog.size) / sizeof(TxRecord));
+        if (take > n - done) take = n - done;
+
+        // link and index first: a record may follow one of the same batch
+        for (int i = done; ok && i < done + take; ++i) {
+            HeadSlot *head = headsProbe(headsSlots(), g_txlog.heads->capacity, recs[i].accountNumber);
+            recs[i].prev = head->used ? head->offset : -1;
+            ok = headsPut(&recs[i], g_txlog.endPos + (i - done));
+        }
+        ok = ok && writeAll(g_txlog.fd, (const char*)&recs[done], (size_t)take * sizeof(TxRecord)) &&
+             marksFlush();
+        if (ok) {
+            g_txlog.endPos += take;
+            g_txlog.size += (uint64_t)take * sizeof(TxRecord);
+            done += take;
+        }
+    }
+    if (ok) {
+        g_txlog.heads->dataSize = g_txlog.endPos;
+    } else if (g_txlog.fd >= 0) {
+        // the table may name positions that never made it to disk: rebuild it on reopen
+        close(g_txlog.fd);
+        g_txlog.fd = -1;
+        headsUnmap();
+        remove(headsFile());
+    }
+    txlogRelease();
+    pthread_mutex_unlock(&g_txlog.mu);
+    return ok;
+}
+
+/* Appends rec straight away, without going through the writer thread. */
+bool txlogAppend(const TxRecord *rec) {
+    TxRecord r = *rec;
+    return txlogAppendBatch(&r, 1);
+}
+
+/* ---- Writer thread ----
+ * logTransaction() leaves the files alone. It copies its record into a
+ * bounded ring and returns. One writer thread per process drains the ring
+ * and appends what it finds with txlogAppendBatch(), so a burst of
+ * operations shares one lock byte round trip and one write().
+ *
+ * The ring is a fixed array of slots, each carrying a sequence number (a
+ * bounded MPMC queue after D. Vyukov, used here with a single consumer). A
+ * producer claims a position with one compare-and-swap on the tail, copies
+ * its record in, and publishes it by advancing the slot's sequence. A
+ * producer that finds the ring full waits for the writer rather than
+ * dropping a record; fullWaits counts those waits.
+ *
+ * Records still in the ring are lost if the process dies, although the
+ * account changes they describe are already in the journal. Readers call
+ * txlogDrain() first, so a statement shows every operation this process
+ * confirmed before it.
+ *
+ * Only a process that has the files to itself queues. With two rings, an
+ * account's records could reach the log in a different order than its
+ * operations committed. A queueing process holds the async lock byte
+ * shared and its writer looks every TXRING_IDLE_MS for other processes.
+ * When one shows up, the writer closes the ring (a flag bit in the tail),
+ * appends what is left and lets go of the byte, which the newcomer's
+ * walOpen() waits for. From then on, and in any process that starts its
+ * ring while others are attached, logTransaction() appends directly.
+ */
+#define TXRING_SLOTS   8192   /* power of two */
+#define TXRING_BATCH   512    /* records per append */
+#define TXRING_IDLE_MS 50
+#define TXRING_CLOSED  (1ull << 63)   /* in tail: pushes fail */
+
+typedef struct {
+    uint64_t seq;    // == position: free for it; position + 1: holds its record
+    TxRecord rec;
+} TxRingSlot;
+
+static struct {
+    TxRingSlot      slots[TXRING_SLOTS];
+    uint64_t        tail;        // next position to claim (producers), | TXRING_CLOSED
+    uint64_t        head;        // next position to take (writer only)
+    uint64_t        written;     // every position below has been appended
+    uint64_t        fullWaits;   // pushes that found the ring full
+    uint64_t        failed;      // records whose append failed
+    int             sleeping;    // the writer waits for work
+    pthread_mutex_t mu;
+    pthread_cond_t  work;        // writer: records to take, or stop
+    pthread_cond_t  progress;    // written advanced
+    bool            ready;       // slots initialised
+    bool            running;
+    bool            stop;
+    bool            shared;      // others had the files open when the ring started
+    bool            async;       // holds the async lock byte
+    pthread_t       thread;
+} g_txring = {
+    .mu = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .progress = PTHREAD_COND_INITIALIZER,
+};
+
+/* True once stopping, or when another process has opened the files (looked
+   at no more than every TXRING_IDLE_MS). */
+static bool txringShouldClose(uint64_t *lastLook) {
+    if (__atomic_load_n(&g_txring.stop, __ATOMIC_ACQUIRE)) return true;
+    if (g_store.fd < 0) return false;
+    uint64_t now = monoNs();
+    if (now - *lastLook < TXRING_IDLE_MS * 1000000ull) return false;
+    *lastLook = now;
+    return !rangeFree(g_store.fd, F_WRLCK, LOCK_BYTE_OWNER, 1);
+}
+
+static void* txringWriter(void *arg) {
+    (void)arg;
+    TxRecord batch[TXRING_BATCH];
+    uint64_t lastLook = monoNs();
+    bool closed = false;
+    for (;;) {
+        if (!closed && txringShouldClose(&lastLook)) {
+            __atomic_fetch_or(&g_txring.tail, TXRING_CLOSED, __ATOMIC_SEQ_CST);
+            closed = true;
+        }
+        int n = 0;
+        while (n < TXRING_BATCH) {
+            TxRingSlot *s = &g_txring.slots[g_txring.head & (TXRING_SLOTS - 1)];
+            if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != g_txring.head + 1) break;
+            batch[n++] = s->rec;
+            __atomic_store_n(&s->seq, g_txring.head + TXRING_SLOTS, __ATOMIC_RELEASE);
+            g_txring.head++;
+        }
+        if (n > 0) {
+            if (!txlogAppendBatch(batch, n)) __atomic_add_fetch(&g_txring.failed, (uint64_t)n, __ATOMIC_RELAXED);
+            pthread_mutex_lock(&g_txring.mu);
+            __atomic_store_n(&g_txring.written, g_txring.head, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&g_txring.progress);
+            pthread_mutex_unlock(&g_txring.mu);
+            continue;
+        }
+
+        pthread_mutex_lock(&g_txring.mu);
+        if (closed && g_txring.head == (__atomic_load_n(&g_txring.tail, __ATOMIC_ACQUIRE) & ~TXRING_CLOSED)) {
+            // every claimed position has been appended: nothing can be queued any more
+            if (g_txring.async) (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_ASYNC, 1);
+            g_txring.async = false;
+            pthread_mutex_unlock(&g_txring.mu);
+            return NULL;
+        }
+        // announce the nap, then look once more: a producer either sees the
+        // flag or published before the second look
+        __atomic_store_n(&g_txring.sleeping, 1, __ATOMIC_SEQ_CST);
+        const TxRingSlot *s = &g_txring.slots[g_txring.head & (TXRING_SLOTS - 1)];
+        if (__atomic_load_n(&s->seq, __ATOMIC_SEQ_CST) != g_txring.head + 1) {
+            struct timespec until = deadlineAfter(closed ? 1 : TXRING_IDLE_MS);
+            pthread_cond_timedwait(&g_txring.work, &g_txring.mu, &until);
+        }
+        __atomic_store_n(&g_txring.sleeping, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&g_txring.mu);
+    }
+}
+
+/* Starts the writer on first use. False if it cannot run, or if other
+   processes have the files open. */
+static bool txringStart(void) {
+    if (__atomic_load_n(&g_txring.running, __ATOMIC_ACQUIRE)) return true;
+    if (__atomic_load_n(&g_txring.shared, __ATOMIC_ACQUIRE)) return false;
+    pthread_mutex_lock(&g_txring.mu);
+    if (!g_txring.running && !g_txring.shared) {
+        if (!g_txring.ready) {
+            for (uint64_t i = 0; i < TXRING_SLOTS; ++i) g_txring.slots[i].seq = i;
+            g_txring.ready = true;
+        }
+        // the byte first, then the look: a newcomer either waits for the
+        // byte or is already seen here
+        g_txring.async = g_store.fd >= 0 && rangeTryLock(g_store.fd, F_RDLCK, LOCK_BYTE_ASYNC, 1);
+        bool alone = g_store.fd < 0 || (g_txring.async && rangeFree(g_store.fd, F_WRLCK, LOCK_BYTE_OWNER, 1));
+        g_txring.stop = false;
+        if (alone) {
+            // the previous writer left the ring empty
+            __atomic_and_fetch(&g_txring.tail, ~TXRING_CLOSED, __ATOMIC_RELEASE);
+            if (pthread_create(&g_txring.thread, NULL, txringWriter, NULL) == 0) {
+                __atomic_store_n(&g_txring.running, true, __ATOMIC_RELEASE);
+            }
+        } else {
+            __atomic_store_n(&g_txring.shared, true, __ATOMIC_RELEASE);
+        }
+        if (!g_txring.running && g_txring.async) {
+            (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_ASYNC, 1);
+            g_txring.async = false;
+        }
+    }
+    bool running = g_txring.running;
+    pthread_mutex_unlock(&g_txring.mu);
+    return running;
+}
+
+/* Queues rec for the writer; false if there is no writer to take it or the
+   ring has been closed. */
+static bool txringPush(const TxRecord *rec) {
+    if (!txringStart()) return false;
+
+    bool counted = false;
+    uint64_t pos = __atomic_load_n(&g_txring.tail, __ATOMIC_RELAXED);
+    for (;;) {
+        if (pos & TXRING_CLOSED) return false;
+        TxRingSlot *s = &g_txring.slots[pos & (TXRING_SLOTS - 1)];
+        int64_t diff = (int64_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&g_txring.tail, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                s->rec = *rec;
+                __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+                break;
+            }
+        } else if (diff < 0) {
+            // full: the slot still holds a record from one lap ago
+            if (!counted) __atomic_add_fetch(&g_txring.fullWaits, 1, __ATOMIC_RELAXED);
+            counted = true;
+            pthread_mutex_lock(&g_txring.mu);
+            pthread_cond_signal(&g_txring.work);
+            struct timespec until = deadlineAfter(1);
+            pthread_cond_timedwait(&g_txring.progress, &g_txring.mu, &until);
+            pthread_mutex_unlock(&g_txring.mu);
+            pos = __atomic_load_n(&g_txring.tail, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&g_txring.tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&g_txring.sleeping, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&g_txring.mu);
+        pthread_cond_signal(&g_txring.work);
+        pthread_mutex_unlock(&g_txring.mu);
+    }
+    return true;
+}
+
+/* Returns once every record queued before the call has been appended. */
+void txlogDrain(void) {
+    if (!__atomic_load_n(&g_txring.running, __ATOMIC_ACQUIRE)) return;
+    uint64_t target = __atomic_load_n(&g_txring.tail, __ATOMIC_ACQUIRE) & ~TXRING_CLOSED;
+    if (__atomic_load_n(&g_txring.written, __ATOMIC_ACQUIRE) >= target) return;
+    pthread_mutex_lock(&g_txring.mu);
+    pthread_cond_signal(&g_txring.work);
+    while (g_txring.written < target && g_txring.running) {
+        pthread_cond_wait(&g_txring.progress, &g_txring.mu);
+    }
+    pthread_mutex_unlock(&g_txring.mu);
+}
+
+/* Writes out what is queued and stops the writer (started again on demand). */
+static void txlogStopWriter(void) {
+    pthread_mutex_lock(&g_txring.mu);
+    g_txring.shared = false;   // the next start looks again
+    if (!g_txring.running) {
+        pthread_mutex_unlock(&g_txring.mu);
+        return;
+    }
+    g_txring.stop = true;
+    pthread_cond_signal(&g_txring.work);
+    pthread_mutex_unlock(&g_txring.mu);
+    pthread_join(g_txring.thread, NULL);
+
+    pthread_mutex_lock(&g_txring.mu);
+    g_txring.running = false;
+    pthread_cond_broadcast(&g_txring.progress);
+    pthread_mutex_unlock(&g_txring.mu);
+}
+
+void txlogClose(void) {
+    txlogStopWriter();
+    pthread_mutex_lock(&g_txlog.mu);
+    if (g_txlog.fd >= 0) close(g_txlog.fd);
+    g_txlog.fd = -1;
+    headsUnmap();
+    if (g_txlog.marksFd >= 0) close(g_txlog.marksFd);
+    g_txlog.marksFd = -1;
+    free(g_txlog.pending);
+    g_txlog.pending = NULL;
+    g_txlog.pendingCap = g_txlog.pendingN = 0;
+    pthread_mutex_unlock(&g_txlog.mu);
+}
+
+void txlogRingCounters(uint64_t *fullWaits, uint64_t *failed) {
+    *fullWaits = __atomic_load_n(&g_txring.fullWaits, __ATOMIC_RELAXED);
+    *failed = __atomic_load_n(&g_txring.failed, __ATOMIC_RELAXED);
+}
+
+void logTransaction(const Account *user, TxType type, int64_t amountCents, const char *note) {
+    STAT_SCOPE(ST_LOG);
+    TxRecord r;
+    memset(&r, 0, sizeof(r));
+    r.accountNumber = user->accountNumber;
+    r.type = (uint16_t)type;
+    r.timestamp = (int64_t)time(NULL);
+    r.amountCents = amountCents;
+    r.balanceCents = user->balanceCents;
+    r.prev = -1;
+    if (note) memcpy(r.note, note, strnlen(note, sizeof(r.note)));
+    if (!txringPush(&r)) {
+        txlogDrain();   // records queued before the ring closed go first
+        (void)txlogAppend(&r);
+    }
+}
+
+/* ---- Reader API ---- */
+static bool txlogReaderOpenSeq(TxLogReader *r) {
+    for (; r->seq <= r->lastSeq; r->seq++) {
+        char path[64];
+        txSegmentPath(r->seq, path, sizeof(path));
+        r->fp = ioFopen(path, "rb");
+        if (!r->fp) continue;
+
+        TxSegmentHeader h;
+        if (ioFread(&h, sizeof(h), 1, r->fp) == 1 && h.magic == TXLOG_MAGIC &&
+            h.version == TXLOG_VERSION && h.recordSize == sizeof(TxRecord)) {
+            return true;
+        }
+        fclose(r->fp);
+        r->fp = NULL;
+    }
+    return false;
+}
+
+/* Positions a reader on the oldest record of the log. */
+bool txlogReaderOpen(TxLogReader *r) {
+    txlogDrain();
+    memset(r, 0, sizeof(*r));
+    if (!txlogSegmentRange(&r->seq, &r->lastSeq)) return false;
+    return txlogReaderOpenSeq(r);
+}
+
+bool txlogNext(TxLogReader *r, TxRecord *out) {
+    while (r->fp) {
+        if (ioFread(out, sizeof(*out), 1, r->fp) == 1) return true;
+        fclose(r->fp);
+        r->fp = NULL;
+        r->seq++;
+        (void)txlogReaderOpenSeq(r);
+    }
+    return false;
+}
+
+void txlogReaderClose(TxLogReader *r) {
+    if (r->fp) fclose(r->fp);
+    r->fp = NULL;
+}
+
+/* Visits records newest first until visit() returns false. */
+bool txlogScanBackward(bool (*visit)(const TxRecord *rec, void *ctx), void *ctx) {
+    txlogDrain();
+    uint32_t first, last;
+    if (!txlogSegmentRange(&first, &last)) return false;
+
+    TxRecord *chunk = (TxRecord*)malloc(TXLOG_SCAN_CHUNK * sizeof(TxRecord));
+    if (!chunk) return false;
+
+    bool more = true;
+    for (uint32_t seq = last; more && seq >= first && seq > 0; --seq) {
+        char path[64];
+        txSegmentPath(seq, path, sizeof(path));
+        int fd = ioOpen(path, O_RDONLY);
+        if (fd < 0) continue;
+
+        struct stat st;
+        uint64_t n = 0;
+        if (fstat(fd, &st) == 0 && (uint64_t)st.st_size > sizeof(TxSegmentHeader)) {
+            n = ((uint64_t)st.st_size - sizeof(TxSegmentHeader)) / sizeof(TxRecord);
+        }
+        while (more && n > 0) {
+            uint64_t take = n < TXLOG_SCAN_CHUNK ? n : TXLOG_SCAN_CHUNK;
+            n -= take;
+            off_t at = (off_t)(sizeof(TxSegmentHeader) + n * sizeof(TxRecord));
+            size_t bytes = (size_t)take * sizeof(TxRecord);
+            if (ioPread(fd, chunk, bytes, at) != (ssize_t)bytes) break;
+            for (uint64_t i = take; more && i-- > 0;) more = visit(&chunk[i], ctx);
+        }
+        close(fd);
+    }
+    free(chunk);
+    return true;
+}
+
+/* localtime_r() and strftime() cost more than the rest of a line, and records
+   come in runs from the same second, so each thread keeps the last one. */
+static __thread int64_t t_whenSec = INT64_MIN;
+static __thread char    t_when[32];
+
+/* timestamp as local "YYYY-MM-DD HH:MM:SS", from the thread's cache. */
+static const char* txWhen(int64_t timestamp) {
+    if (timestamp != t_whenSec) {
+        time_t ts = (time_t)timestamp;
+        struct tm tm_info;
+        localtime_r(&ts, &tm_info);
+        strftime(t_when, sizeof(t_when), "%Y-%m-%d %H:%M:%S", &tm_info);
+        t_whenSec = timestamp;
+    }
+    return t_when;
+}
+
+/* One human-readable line, same layout the old per-account text logs used.
+   Returns the full length like snprintf, even when buf was too small. */
+int txFormatLine(const TxRecord *rec, char *buf, size_t n) {
+    char amt[24], bal[24];
+    int len = snprintf(buf, n, "[%s] %-10s Amount: %s  Balance: %s", txWhen(rec->timestamp), txTypeName(rec->type),
+                       fmtCents(rec->amountCents, amt), fmtCents(rec->balanceCents, bal));
+    if (rec->note[0] && len >= 0) {
+        // keep counting past a full buffer so callers learn the whole length
+        bool fits = (size_t)len < n;
+        len += snprintf(fits ? buf + len : NULL, fits ? n - (size_t)len : 0,
+                        "  Note: %.*s", (int)sizeof(rec->note), rec->note);
+    }
+    return len;
+}
+
+/* Writes the log as text; accountNumber 0 exports every account. */
+long txlogExportText(FILE *out, int accountNumber) {
+    TxLogReader r;
+    if (!txlogReaderOpen(&r)) return 0;
+
+    long n = 0;
+    char line[256];
+    TxRecord rec;
+    while (txlogNext(&r, &rec)) {
+        if (accountNumber != 0 && rec.accountNumber != accountNumber) continue;
+        txFormatLine(&rec, line, sizeof(line));
+        if (accountNumber == 0) fprintf(out, "A/C %-6d ", rec.accountNumber);
+        fprintf(out, "%s\n", line);
+        n++;
+    }
+    txlogReaderClose(&r);
+    return n;
+}
+
+/* ---- Statement engine ---- */
+typedef struct {
+    uint32_t seq;
+    int      fd;
+} TxCursor;
+
+static bool txlogReadAt(TxCursor *c, int64_t pos, TxRecord *out) {
+    uint32_t seq = posSeq(pos);
+    if (c->fd < 0 || c->seq != seq) {
+        char path[64];
+        if (c->fd >= 0) close(c->fd);
+        txSegmentPath(seq, path, sizeof(path));
+        c->fd = ioOpen(path, O_RDONLY);
+        c->seq = seq;
+        if (c->fd < 0) return false;
+    }
+    return ioPread(c->fd, out, sizeof(*out), posOffset(pos)) == (ssize_t)sizeof(*out);
+}
+
+/* Fills out[] with up to n records of the account, newest first, by following
+   the per-account back links from its head. */
+int txlogLastN(int accountNumber, int n, TxRecord *out) {
+    txlogDrain();
+    int64_t pos = -1;
+    pthread_mutex_lock(&g_txlog.mu);
+    if (txlogAcquire()) {
+        HeadSlot *head = headsProbe(headsSlots(), g_txlog.heads->capacity, accountNumber);
+        if (head->used) pos = head->offset;
+        txlogRelease();
+    }
+    pthread_mutex_unlock(&g_txlog.mu);
+
+    TxCursor c = { 0, -1 };
+    int got = 0;
+    while (got < n && pos >= 0) {
+        if (!txlogReadAt(&c, pos, &out[got]) || out[got].accountNumber != accountNumber) break;
+        pos = out[got].prev;
+        got++;
+    }
+    if (c.fd >= 0) close(c.fd);
+    return got;
+}
+
+/* Per-thread scratch reused by every statement: the records, then the text
+   of the line being printed. Grows as needed, so long lines are not cut. */
+static __thread char  *t_stmtBuf;
+static __thread size_t t_stmtCap;
+
+/* Prints the last lastN entries oldest first, each line starting with prefix. */
+void writeMiniStatement(FILE *out, const char *prefix, int accountNumber, int lastN) {
+    STAT_SCOPE(ST_STATEMENT);
+    if (lastN <= 0) return;
+    size_t recBytes = (size_t)lastN * sizeof(TxRecord);
+    if (!growBuffer(&t_stmtBuf, &t_stmtCap, recBytes + 256)) return;
+
+    int found = txlogLastN(accountNumber, lastN, (TxRecord*)t_stmtBuf);
+    if (found == 0) {
+        fprintf(out, "%sNo transactions to show.\n", prefix);
+        return;
+    }
+
+    fprintf(out, "%s--- Last %d transactions ---\n", prefix, found);
+    for (int i = found; i-- > 0;) {
+        const TxRecord *rec = (const TxRecord*)t_stmtBuf + i;
+        size_t room = t_stmtCap - recBytes;
+        int len = txFormatLine(rec, t_stmtBuf + recBytes, room);
+        if (len >= 0 && (size_t)len >= room) {
+            if (!growBuffer(&t_stmtBuf, &t_stmtCap, recBytes + (size_t)len + 1)) break;
+            rec = (const TxRecord*)t_stmtBuf + i;
+            len = txFormatLine(rec, t_stmtBuf + recBytes, t_stmtCap - recBytes);
+        }
+        fputs(prefix, out);
+        if (len > 0) fwrite(t_stmtBuf + recBytes, 1, (size_t)len, out);
+        fputc('\n', out);
+    }
+    fprintf(out, "%s---------------------------\n", prefix);
+}
+
+void showMiniStatement(const Account *user, int lastN) {
+    putchar('\n');
+    writeMiniStatement(stdout, "", user->accountNumber, lastN);
+}
+
+/* ---- Statement queries ----
+   An account's records between two times, oldest first. The account's marks
+   are followed in memory down to the range, and the marks inside it cut the
+   range into runs of at most TXMARK_EVERY records. Each run is read newest
+   first along the back links into a run-sized buffer and written reversed,
+   so however long the range, a query holds one run and one position per
+   mark in it. Records reach the log in the order their operations
+   committed, so along the links the timestamps only go down. */
+#define STMT_ROW_MAX 384   /* a CSV or JSON row; a note escaped to \u00XX takes 144 */
+
+static char* putText(char *p, const char *s) {
+    size_t n = strlen(s);
+    memcpy(p, s, n);
+    return p + n;
+}
+
+/* note (len bytes) as a CSV field, quoted only if it must be, or as a JSON string. */
+static char* putNote(char *p, const char *note, size_t len, StmtFormat format) {
+    static const char hex[] = "0123456789abcdef";
+    bool json = format == STMT_JSON, quote = json;
+    for (size_t i = 0; !quote && i < len; ++i) quote = strchr(",\"\r\n", note[i]) != NULL;
+
+    if (quote) *p++ = '"';
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)note[i];
+        if (c == '"') {
+            *p++ = json ? '\\' : '"';
+            *p++ = '"';
+        } else if (json && c == '\\') {
+            *p++ = '\\';
+            *p++ = '\\';
+        } else if (json && c < 0x20) {
+            p = putText(p, "\\u00");
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 15];
+        } else {
+            *p++ = (char)c;
+        }
+    }
+    if (quote) *p++ = '"';
+    return p;
+}
+
+/* rec as a CSV row or a JSON object, with no line end; returns the length. */
+static size_t stmtRow(const TxRecord *rec, StmtFormat format, char buf[STMT_ROW_MAX]) {
+    bool json = format == STMT_JSON;
+    char *p = buf;
+    p = putText(p, json ? "{\"time\":\"" : "");
+    p = putText(p, txWhen(rec->timestamp));
+    p = putText(p, json ? "\",\"type\":\"" : ",");
+    p = putText(p, txTypeName(rec->type));
+    p = putText(p, json ? "\",\"amount\":" : ",");
+    p = putCents(p, rec->amountCents);
+    p = putText(p, json ? ",\"balance\":" : ",");
+    p = putCents(p, rec->balanceCents);
+    p = putText(p, json ? ",\"note\":" : ",");
+    p = putNote(p, rec->note, strnlen(rec->note, sizeof(rec->note)), format);
+    if (json) *p++ = '}';
+    return (size_t)(p - buf);
+}
+
+static bool markOk(const TxMark *marks, int64_t count, int64_t m, int accountNumber) {
+    return m >= 0 && m < count && marks[m].accountNumber == accountNumber;
+}
+
+/* Writes the account's records matching q, oldest first, each line starting
+   with prefix: text lines like a mini statement, CSV with a header row, or
+   a JSON array with one object per line. */
+AtmStatus writeStatementRange(FILE *out, const char *prefix, int accountNumber, const StmtQuery *q, long *count) {
+    STAT_SCOPE(ST_STATEMENT);
+    *count = 0;
+    if (q->from > q->to) return ATM_ERR_INPUT;
+    if (!accountExists(accountNumber)) return ATM_ERR_NOT_FOUND;
+
+    txlogDrain();
+    HeadSlot head;
+    memset(&head, 0, sizeof(head));
+    pthread_mutex_lock(&g_txlog.mu);
+    bool locked = txlogAcquire();
+    if (locked) {
+        head = *headsProbe(headsSlots(), g_txlog.heads->capacity, accountNumber);
+        txlogRelease();
+    }
+    pthread_mutex_unlock(&g_txlog.mu);
+    if (!locked) return ATM_ERR_IO;
+    if (!head.used) head.offset = head.mark = -1;
+
+    const TxMark *marks = NULL;
+    int64_t markCount = 0;
+    void *map = MAP_FAILED;
+    size_t mapLen = 0;
+    if (head.mark >= 0) {
+        int fd = ioOpen(marksFile(), O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(TxSegmentHeader)) {
+            mapLen = (size_t)st.st_size;
+            map = mmap(NULL, mapLen, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        if (fd >= 0) close(fd);
+        if (map != MAP_FAILED) {
+            marks = (const TxMark*)((const char*)map + sizeof(TxSegmentHeader));
+            markCount = (int64_t)((mapLen - sizeof(TxSegmentHeader)) / sizeof(TxMark));
+        }
+    }
+
+    // stops[0] is where the newest run starts, then one per mark in the range
+    int64_t *stops = NULL;
+    size_t stopsCap = 0, nStops = 0;
+    int64_t entry = head.offset, m = head.mark;
+    while (markOk(marks, markCount, m, accountNumber) && marks[m].timestamp > q->to) {
+        entry = marks[m].pos;
+        m = marks[m].prev < m ? marks[m].prev : -1;
+    }
+    bool ok = growBuffer((char**)&stops, &stopsCap, sizeof(int64_t));
+    if (ok) stops[nStops++] = entry;
+    while (ok && markOk(marks, markCount, m, accountNumber) && marks[m].timestamp >= q->from) {
+        ok = growBuffer((char**)&stops, &stopsCap, (nStops + 1) * sizeof(int64_t));
+        if (ok) stops[nStops++] = marks[m].pos;
+        m = marks[m].prev < m ? marks[m].prev : -1;
+    }
+    if (map != MAP_FAILED) munmap(map, mapLen);
+    if (!ok) { free(stops); return ATM_ERR_IO; }
+
+    char row[STMT_ROW_MAX];
+    if (q->format == STMT_CSV) {
+        fprintf(out, "%stime,type,amount,balance,note\n", prefix);
+    } else if (q->format == STMT_JSON) {
+        fprintf(out, "%s[", prefix);
+    } else {
+        snprintf(row, sizeof(row), "%.10s", txWhen(q->from));
+        fprintf(out, "%s--- Transactions %s to %.10s ---\n", prefix, row, txWhen(q->to));
+    }
+
+    TxRecord run[TXMARK_EVERY];
+    TxCursor c = { 0, -1 };
+    for (size_t i = nStops; i-- > 0;) {
+        int64_t pos = stops[i], stop = i + 1 < nStops ? stops[i + 1] : -1;
+        int n = 0;
+        while (n < TXMARK_EVERY && pos >= 0 && pos != stop) {
+            if (!txlogReadAt(&c, pos, &run[n]) || run[n].accountNumber != accountNumber ||
+                run[n].timestamp < q->from) {
+                break;
+            }
+            pos = run[n++].prev;
+        }
+        while (n-- > 0) {
+            const TxRecord *rec = &run[n];
+            if (rec->timestamp > q->to) continue;
+            if (q->types && (rec->type >= 32 || !(q->types >> rec->type & 1u))) continue;
+
+            if (q->format == STMT_TEXT) {
+                int len = txFormatLine(rec, row, sizeof(row));
+                fputs(prefix, out);
+                if (len > 0) fwrite(row, 1, (size_t)len < sizeof(row) ? (size_t)len : sizeof(row) - 1, out);
+                fputc('\n', out);
+            } else {
+                size_t len = stmtRow(rec, q->format, row);
+                if (q->format == STMT_JSON) fputs(*count ? ",\n" : "\n", out);
+                fputs(prefix, out);
+                fwrite(row, 1, len, out);
+                if (q->format == STMT_CSV) fputc('\n', out);
+            }
+            (*count)++;
+        }
+    }
+    if (c.fd >= 0) close(c.fd);
+    free(stops);
+
+    if (q->format == STMT_JSON) {
+        fprintf(out, "\n%s]\n", prefix);
+    } else if (q->format == STMT_TEXT) {
+        if (*count == 0) fprintf(out, "%sNo transactions to show.\n", prefix);
+        fprintf(out, "%s---------------------------\n", prefix);
+    }
+    return ATM_OK;
+}
+
+/* YYYY-MM-DD or YYYY-MM as the first second of that day or month, or with
+   end set, its last. */
+static bool parseStmtDate(const char *s, bool end, int64_t *out) {
+    int y, mon, day = 1, used = 0, more = 0;
+    if (!s || sscanf(s, "%4d-%2d%n", &y, &mon, &used) != 2) return false;
+    bool hasDay = s[used] == '-';
+    if (hasDay && (sscanf(s + used, "-%2d%n", &day, &more) != 1 || day < 1)) return false;
+    if (s[used + more] || y < 1970 || mon < 1 || mon > 12) return false;
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = y - 1900;
+    tm.tm_mon = mon - 1;
+    tm.tm_mday = day;
+    tm.tm_isdst = -1;
+    if (mktime(&tm) == (time_t)-1 || tm.tm_mday != day) return false;   // 2026-02-30
+    if (end) {
+        // the start of the next day or month, less a second
+        if (hasDay) tm.tm_mday++;
+        else tm.tm_mon++;
+        tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        tm.tm_isdst = -1;
+    }
+    time_t t = mktime(&tm);
+    if (t == (time_t)-1) return false;
+    *out = (int64_t)t - (end ? 1 : 0);
+    return true;
+}
+
+/* "DEPOSIT,TRANSFER+" and the like, any case; TRANSFER takes both legs. */
+static bool parseTxTypes(const char *list, unsigned *types) {
+    *types = 0;
+    while (*list) {
+        char word[16];
+        size_t n = strcspn(list, ",");
+        if (n == 0 || n >= sizeof(word)) return false;
+        for (size_t i = 0; i < n; ++i) word[i] = (char)toupper((unsigned char)list[i]);
+        word[n] = '\0';
+
+        unsigned bit = strcmp(word, "TRANSFER") == 0 ? 1u << TX_TRANSFER_OUT | 1u << TX_TRANSFER_IN : 0;
+        for (int t = 1; !bit && t <= TX_FEE; ++t) {
+            if (strcmp(word, txTypeNames[t]) == 0) bit = 1u << t;
+        }
+        if (!bit) return false;
+        *types |= bit;
+        list += n + (list[n] == ',');
+    }
+    return true;
+}
+
+/* A query from its words: dates as for parseStmtDate() (to NULL or empty
+   for the same day or month as from), format text|csv|json (NULL for text),
+   types as for parseTxTypes() (NULL for all). A format word that is none of
+   the three is taken as the types. */
+bool parseStmtQuery(const char *from, const char *to, const char *format, const char *types, StmtQuery *q) {
+    static const char *const formats[] = { "text", "csv", "json" };
+    memset(q, 0, sizeof(*q));
+    q->format = STMT_TEXT;
+    if (format && *format) {
+        int f = -1;
+        for (int i = 0; i < 3; ++i) {
+            if (strcmp(format, formats[i]) == 0) f = i;
+        }
+        if (f >= 0) q->format = (StmtFormat)f;
+        else if (!types) types = format;
+        else return false;
+    }
+    if (!to || !*to) to = from;
+    return parseStmtDate(from, false, &q->from) && parseStmtDate(to, true, &q->to) &&
+           (!types || parseTxTypes(types, &q->types)) && q->from <= q->to;
+}
+
+/* ======================= Account Locks ======================= */
+/*
+ * Striped per-account mutexes for the threads of one process, and an fcntl
+ * write lock on the account's own record bytes for other processes. An
+ * operation locks every account it touches, so sessions on unrelated accounts
+ * almost never wait on each other. Two-account operations take their stripes
+ * in ascending order and then their records in ascending account order; no
+ * one waits for a stripe while holding a record lock, so concurrent transfers
+ * cannot deadlock, in one process or across several.
+ */
+#define ACCOUNT_LOCK_STRIPES 1024
+
+static pthread_mutex_t g_accountLocks[ACCOUNT_LOCK_STRIPES];
+static pthread_once_t  g_accountLocksOnce = PTHREAD_ONCE_INIT;
+
+static void accountLocksInit(void) {
+    for (int i = 0; i < ACCOUNT_LOCK_STRIPES; ++i) pthread_mutex_init(&g_accountLocks[i], NULL);
+}
+
+static unsigned lockStripe(int accountNumber) {
+    return (unsigned)(idxHash(accountNumber) % ACCOUNT_LOCK_STRIPES);
+}
+
+/* Locks or unlocks the record of an existing account. An account that does
+   not exist yet has no record to lock; appendAccount() settles races between
+   processes creating it. */
+static void recordLock(int accountNumber, short type) {
+    StoreShard *sh;
+    Account *a = shardRef(accountNumber, &sh);
+    if (a) (void)rangeLock(sh->fd, type, (off_t)((char*)a - sh->base), (off_t)sizeof(Account));
+}
+
+void lockAccount(int accountNumber) {
+    pthread_once(&g_accountLocksOnce, accountLocksInit);
+    pthread_mutex_lock(&g_accountLocks[lockStripe(accountNumber)]);
+    recordLock(accountNumber, F_WRLCK);
+}
+
+void unlockAccount(int accountNumber) {
+    recordLock(accountNumber, F_UNLCK);
+    pthread_mutex_unlock(&g_accountLocks[lockStripe(accountNumber)]);
+}
+
+void lockAccountPair(int a, int b) {
+    unsigned sa = lockStripe(a), sb = lockStripe(b);
+    pthread_once(&g_accountLocksOnce, accountLocksInit);
+    pthread_mutex_lock(&g_accountLocks[sa < sb ? sa : sb]);
+    if (sb != sa) pthread_mutex_lock(&g_accountLocks[sa < sb ? sb : sa]);
+    recordLock(a < b ? a : b, F_WRLCK);
+    if (b != a) recordLock(a < b ? b : a, F_WRLCK);
+}
+
+void unlockAccountPair(int a, int b) {
+    unsigned sa = lockStripe(a), sb = lockStripe(b);
+    recordLock(a, F_UNLCK);
+    if (b != a) recordLock(b, F_UNLCK);
+    pthread_mutex_unlock(&g_accountLocks[sa]);
+    if (sb != sa) pthread_mutex_unlock(&g_accountLocks[sb]);
+}
+
+/* ======================= Account Cache ======================= */
+/*
+ * Optional write-back cache in front of the journal, sized by ATM_CACHE_KB
+ * (KiB; unset or 0 leaves it off). Records are already read and written in
+ * memory through the mapping. The per-update disk cost is the journal's
+ * fdatasync, and that is what the cache saves. With it on, commitAccounts()
+ * only stores the new image here and marks it dirty. Every dirty image then
+ * reaches the journal as a single record with one fdatasync:
+ *   - when a session ends
+ *   - every CACHE_FLUSH_MS
+ *   - when the budget is used up
+ * A hot account that takes thousands of updates between flushes is written
+ * once.
+ *
+ * The trade-off is durability. An operation is confirmed before it is on
+ * disk, so a crash loses up to one flush interval of account changes, while
+ * their transaction log records survive.
+ *
+ * Only dirty images are kept: a clean record is read straight from the
+ * mapping, so holding a copy of it would buy nothing. Flushes write every
+ * dirty image at once, so no LRU order is needed. Evicting one entry would
+ * cost the same fdatasync as evicting them all.
+ *
+ * Other processes would read the store behind the cache's back, so the cache
+ * needs the files to itself. It takes the owner lock byte exclusively, and
+ * every process holds that byte shared while its journal is open. When
+ * another atm already has the files open, the cache stays off.
+ */
+#define CACHE_FLUSH_MS    200
+#define CACHE_MIN_ENTRIES 16
+
+typedef struct {
+    Account  img;
+    uint32_t seq;     // bumped by every write, so a flush drops only what it wrote
+    bool     dirty;
+} CacheEntry;
+
+static struct {
+    pthread_mutex_t  mu;
+    pthread_mutex_t  flushMu;    // one flush at a time
+    pthread_cond_t   wake;       // flusher: stop
+    CacheEntry      *entries;
+    uint32_t         used, capacity;
+    uint32_t        *table;      // open addressing: entry index + 1, 0 = empty
+    uint32_t         tableCap;   // power of two, at least twice capacity
+    Account         *snap;       // images being flushed
+    const Account  **snapRef;
+    uint32_t        *snapIdx, *snapSeq;
+    bool             enabled;
+    bool             failed;     // a flush failed: refuse further commits
+    bool             stop;
+    pthread_t        thread;
+} g_cache = {
+    .mu = PTHREAD_MUTEX_INITIALIZER,
+    .flushMu = PTHREAD_MUTEX_INITIALIZER,
+    .wake = PTHREAD_COND_INITIALIZER,
+};
+
+static bool cacheEnabled(void) {
+    return g_cache.enabled;
+}
+
+/* Caller holds g_cache.mu. On a miss *slot (if given) is the empty table slot
+   where the key belongs. */
+static CacheEntry* cacheFind(int32_t key, uint32_t **slot) {
+    uint32_t mask = g_cache.tableCap - 1;
+    for (uint32_t i = (uint32_t)idxHash(key) & mask;; i = (i + 1) & mask) {
+        uint32_t v = g_cache.table[i];
+        if (v == 0) {
+            if (slot) *slot = &g_cache.table[i];
+            return NULL;
+        }
+        CacheEntry *e = &g_cache.entries[v - 1];
+        if (e->img.accountNumber == key) return e;
+    }
+}
+
+/* Caller holds g_cache.mu: drops clean entries and rebuilds the table. */
+static void cacheCompact(void) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < g_cache.used; ++i) {
+        if (g_cache.entries[i].dirty) g_cache.entries[kept++] = g_cache.entries[i];
+    }
+    g_cache.used = kept;
+    memset(g_cache.table, 0, (size_t)g_cache.tableCap * sizeof(uint32_t));
+    for (uint32_t i = 0; i < kept; ++i) {
+        uint32_t *slot;
+        (void)cacheFind(g_cache.entries[i].img.accountNumber, &slot);
+        *slot = i + 1;
+    }
+}
+
+/* Writes every dirty image to the journal as one record. */
+bool cacheFlush(void) {
+    if (!g_cache.enabled) return true;
+    pthread_mutex_lock(&g_cache.flushMu);
+
+    pthread_mutex_lock(&g_cache.mu);
+    uint32_t n = g_cache.used;
+    for (uint32_t i = 0; i < n; ++i) {
+        g_cache.snap[i] = g_cache.entries[i].img;
+        g_cache.snapRef[i] = &g_cache.snap[i];
+        g_cache.snapIdx[i] = i;
+        g_cache.snapSeq[i] = g_cache.entries[i].seq;
+    }
+    pthread_mutex_unlock(&g_cache.mu);
+
+    // the entries stay in place meanwhile, so readers still find the new images
+    bool ok = n == 0 || walCommit(g_cache.snapRef, (int)n);
+
+    pthread_mutex_lock(&g_cache.mu);
+    if (ok) {
+        for (uint32_t i = 0; i < n; ++i) {
+            CacheEntry *e = &g_cache.entries[g_cache.snapIdx[i]];
+            if (e->seq == g_cache.snapSeq[i]) e->dirty = false;   // else written again since
+        }
+        cacheCompact();
+    } else {
+        g_cache.failed = true;
+    }
+    pthread_mutex_unlock(&g_cache.mu);
+
+    pthread_mutex_unlock(&g_cache.flushMu);
+    return ok;
+}
+
+/* commitAccounts() with the cache on. The caller holds the accounts' locks. */
+static bool cacheCommit(const Account *const *accs, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (!accountRef(accs[i]->accountNumber)) return false;
+    }
+
+    pthread_mutex_lock(&g_cache.mu);
+    while (!g_cache.failed && g_cache.used + (uint32_t)n > g_cache.capacity) {
+        pthread_mutex_unlock(&g_cache.mu);
+        (void)cacheFlush();
+        pthread_mutex_lock(&g_cache.mu);
+    }
+    bool ok = !g_cache.failed;
+    for (int i = 0; ok && i < n; ++i) {
+        uint32_t *slot;
+        CacheEntry *e = cacheFind(accs[i]->accountNumber, &slot);
+        if (!e) {
+            e = &g_cache.entries[g_cache.used++];
+            e->seq = 0;
+            *slot = g_cache.used;
+        }
+        e->img = *accs[i];
+        e->seq++;
+        e->dirty = true;
+    }
+    pthread_mutex_unlock(&g_cache.mu);
+    return ok;
+}
+
+static bool cacheGet(int accountNumber, Account *out) {
+    if (!g_cache.enabled) return false;
+    pthread_mutex_lock(&g_cache.mu);
+    const CacheEntry *e = cacheFind(accountNumber, NULL);
+    if (e) *out = e->img;
+    pthread_mutex_unlock(&g_cache.mu);
+    return e != NULL;
+}
+
+static void* cacheFlusher(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_cache.mu);
+    while (!g_cache.stop) {
+        struct timespec until = deadlineAfter(CACHE_FLUSH_MS);
+        pthread_cond_timedwait(&g_cache.wake, &g_cache.mu, &until);
+
+        if (g_cache.stop || g_cache.used == 0) continue;
+        pthread_mutex_unlock(&g_cache.mu);
+        (void)cacheFlush();
+        pthread_mutex_lock(&g_cache.mu);
+    }
+    pthread_mutex_unlock(&g_cache.mu);
+    return NULL;
+}
+
+static void cacheFree(void) {
+    free(g_cache.entries); g_cache.entries = NULL;
+    free(g_cache.table);   g_cache.table = NULL;
+    free(g_cache.snap);    g_cache.snap = NULL;
+    free(g_cache.snapRef); g_cache.snapRef = NULL;
+    free(g_cache.snapIdx); g_cache.snapIdx = NULL;
+    free(g_cache.snapSeq); g_cache.snapSeq = NULL;
+}
+
+/* Called by walOpen() with the owner byte held shared. */
+static void cacheOpen(void) {
+    const char *p = getenv("ATM_CACHE_KB");
+    long kb = p ? strtol(p, NULL, 10) : 0;
+    if (g_cache.enabled || kb <= 0) return;
+    if (!rangeTryLock(g_store.fd, F_WRLCK, LOCK_BYTE_OWNER, 1)) {
+        printf("⚠️ Other atm processes have the accounts open; write-back cache is off.\n");
+        return;
+    }
+
+    // an entry, its share of the table and its flush snapshot
+    size_t per = sizeof(CacheEntry) + 2 * sizeof(uint32_t) +
+                 sizeof(Account) + sizeof(Account*) + 2 * sizeof(uint32_t);
+    size_t cap = (size_t)kb * 1024 / per;
+    if (cap < CACHE_MIN_ENTRIES) cap = CACHE_MIN_ENTRIES;
+    if (cap > WAL_MAX_IMAGES) cap = WAL_MAX_IMAGES;
+    uint32_t tableCap = 1;
+    while (tableCap < 2 * cap) tableCap <<= 1;
+
+    g_cache.entries = (CacheEntry*)malloc(cap * sizeof(CacheEntry));
+    g_cache.table = (uint32_t*)calloc(tableCap, sizeof(uint32_t));
+    g_cache.snap = (Account*)malloc(cap * sizeof(Account));
+    g_cache.snapRef = (const Account**)malloc(cap * sizeof(Account*));
+    g_cache.snapIdx = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    g_cache.snapSeq = (uint32_t*)malloc(cap * sizeof(uint32_t));
+    bool ok = g_cache.entries && g_cache.table && g_cache.snap && g_cache.snapRef &&
+              g_cache.snapIdx && g_cache.snapSeq;
+    if (ok) {
+        g_cache.capacity = (uint32_t)cap;
+        g_cache.tableCap = tableCap;
+        g_cache.used = 0;
+        g_cache.failed = g_cache.stop = false;
+        ok = pthread_create(&g_cache.thread, NULL, cacheFlusher, NULL) == 0;
+    }
+    if (!ok) {
+        cacheFree();
+        (void)rangeLock(g_store.fd, F_RDLCK, LOCK_BYTE_OWNER, 1);
+        return;
+    }
+    g_cache.enabled = true;
+}
+
+/* Called by walClose(): a last flush while the journal still runs. */
+static void cacheClose(void) {
+    if (!g_cache.enabled) return;
+    pthread_mutex_lock(&g_cache.mu);
+    g_cache.stop = true;
+    pthread_cond_signal(&g_cache.wake);
+    pthread_mutex_unlock(&g_cache.mu);
+    pthread_join(g_cache.thread, NULL);
+
+    if (!cacheFlush()) printf("⚠️ Failed to write cached account changes to disk.\n");
+    g_cache.enabled = false;
+    cacheFree();
+}
+
+/* ======================= Operations ======================= */
+/*
+ * The ATM operations without any terminal I/O, shared by the interactive
+ * menus and the server. Each one re-reads the account and applies the change
+ * to that fresh copy, so a session's private Account never overwrites a
+ * concurrent change; on success the session copy is refreshed.
+ *
+ * The read and the checks run without the account's lock. The lock is only
+ * taken to commit, and the commit is a compare-and-swap on the record's
+ * version (commitIfCurrent()). An operation that loses the race runs again
+ * on a fresh copy. After OPT_RETRIES lost races it holds the lock from the
+ * read on, so a hot account cannot starve it. An outcome that writes
+ * nothing, such as a login without earlier failed attempts, takes no lock.
+ */
+#define OPT_RETRIES 3
+
+/* Decides an operation's outcome on a fresh copy of the account; sets
+   *write when the copy is to be committed. */
+typedef AtmStatus (*AccountChange)(Account *a, const void *arg, bool *write);
+
+/* Runs change() on the account and commits the result as described above.
+   A committed ATM_OK outcome is logged (unless type is 0) under the lock.
+   *out gets the copy the outcome was decided on, if the account exists. */
+static AtmStatus changeAccount(int accountNumber, AccountChange change, const void *arg,
+                               TxType type, int64_t cents, const char *note, Account *out) {
+    Account a;
+    AtmStatus st;
+    bool found;
+    for (int attempt = 0;; ++attempt) {
+        bool held = attempt >= OPT_RETRIES;
+        if (held) lockAccount(accountNumber);
+        bool write = false;
+        found = loadAccount(accountNumber, &a);
+        st = found ? change(&a, arg, &write) : ATM_ERR_NOT_FOUND;
+        if (!write) {
+            if (held) unlockAccount(accountNumber);
+            break;
+        }
+        if (!held) lockAccount(accountNumber);
+        Account *img = &a;
+        AtmStatus cs = commitIfCurrent(&img, 1);
+        if (cs == ATM_OK && st == ATM_OK && type) logTransaction(&a, type, cents, note);
+        unlockAccount(accountNumber);
+        if (cs == ATM_ERR_CONFLICT) continue;
+        if (cs != ATM_OK) st = cs == ATM_ERR_NOT_FOUND ? cs : ATM_ERR_IO;
+        break;
+    }
+    if (found && out) *out = a;
+    return st;
+}
+const char* atmStatusText(AtmStatus st) {
+    switch (st) {
+        case ATM_OK:                return "OK";
+        case ATM_ERR_INPUT:         return "Invalid input.";
+        case ATM_ERR_NOT_FOUND:     return "Account not found.";
+        case ATM_ERR_LOCKED:        return "❌ Account is LOCKED due to multiple wrong PIN attempts. Contact admin.";
+        case ATM_ERR_BAD_PIN:       return "❌ Invalid PIN.";
+        case ATM_ERR_NOW_LOCKED:    return "❌ Invalid PIN. Account LOCKED after 3 failed attempts.";
+        case ATM_ERR_WRONG_PIN:     return "❌ Incorrect current PIN.";
+        case ATM_ERR_PIN_SHORT:     return "❌ PIN too short (min 4 digits recommended).";
+        case ATM_ERR_AMOUNT:        return "❌ Amount must be positive.";
+        case ATM_ERR_FUNDS:         return "❌ Insufficient funds.";
+        case ATM_ERR_SAME_ACCOUNT:  return "❌ Cannot transfer to the same account.";
+        case ATM_ERR_NO_TARGET:     return "❌ Target account not found.";
+        case ATM_ERR_TARGET_LOCKED: return "❌ Target account is locked.";
+        case ATM_ERR_EXISTS:        return "❌ Account number already exists.";
+        case ATM_ERR_HASH:          return "Hash error.";
+        case ATM_ERR_IO:            return "⚠️ Failed to update account on disk.";
+        case ATM_ERR_FILE:          return "❌ Cannot write the output file.";
+        case ATM_ERR_NO_FILE:       return "❌ Cannot read the input file.";
+        case ATM_ERR_BUSY:          return "❌ Other atm processes are using the accounts.";
+        case ATM_ERR_POSTED:        return "❌ End-of-day posting already ran today.";
+        case ATM_ERR_CONFLICT:      return "❌ The account changed meanwhile; please try again.";
+        case ATM_ERR_NOT_BACKUP:    return "❌ That file is not an atm backup.";
+        case ATM_ERR_SHARDS:        return "❌ The shard count must be a power of two from 2 to 64.";
+        case ATM_ERR_NAME_LONG:     return "❌ Name too long (max 15 characters).";
+    }
+    return "Unknown error.";
+}
+
+static bool pinMatches(const char *pin, const uint8_t pinHash[32]) {
+    uint8_t h[32];
+    return sha256_digest(pin, h) && memcmp(h, pinHash, sizeof(h)) == 0;
+}
+
+/* Can this account log in (exists, not locked)? Checked before asking for the PIN. */
+AtmStatus opCheckLogin(int accountNumber) {
+    Account a;
+    if (!loadAccount(accountNumber, &a)) return ATM_ERR_NOT_FOUND;
+    return a.locked ? ATM_ERR_LOCKED : ATM_OK;
+}
+
+/* On ATM_OK, ATM_ERR_BAD_PIN and ATM_ERR_NOW_LOCKED *out holds the account
+   (with the updated attempt counter). */
+static AtmStatus loginChange(Account *a, const void *pinHash, bool *write) {
+    if (a->locked) return ATM_ERR_LOCKED;
+    if (memcmp(pinHash, a->pinHash, sizeof(a->pinHash)) != 0) {
+        a->failedAttempts++;
+        if (a->failedAttempts >= 3) a->locked = 1;
+        *write = true;
+        return a->locked ? ATM_ERR_NOW_LOCKED : ATM_ERR_BAD_PIN;
+    }
+    *write = a->failedAttempts != 0;
+    a->failedAttempts = 0;
+    return ATM_OK;
+}
+
+AtmStatus opLogin(int accountNumber, const char *pin, Account *out) {
+    STAT_SCOPE(ST_LOGIN);
+    uint8_t pinHash[32];
+    if (!sha256_digest(pin, pinHash)) return ATM_ERR_HASH;
+
+    Account user;
+    AtmStatus st = changeAccount(accountNumber, loginChange, pinHash, 0, 0, NULL, &user);
+    if (st == ATM_OK || st == ATM_ERR_BAD_PIN || st == ATM_ERR_NOW_LOCKED) *out = user;
+    return st;
+}
+
+AtmStatus opBalance(Account *user) {
+    Account cur;
+    if (!loadAccount(user->accountNumber, &cur)) return ATM_ERR_NOT_FOUND;
+    *user = cur;
+    return ATM_OK;
+}
+
+static AtmStatus depositChange(Account *a, const void *cents, bool *write) {
+    a->balanceCents += *(const int64_t*)cents;
+    *write = true;
+    return ATM_OK;
+}
+
+AtmStatus opDeposit(Account *user, double amount) {
+    STAT_SCOPE(ST_DEPOSIT);
+    if (!(amount > 0) || amount > MAX_AMOUNT) return ATM_ERR_AMOUNT;
+    int64_t cents = toCents(amount);
+
+    Account cur;
+    AtmStatus st = changeAccount(user->accountNumber, depositChange, &cents, TX_DEPOSIT, cents, "", &cur);
+    if (st == ATM_OK) *user = cur;
+    return st;
+}
+
+static AtmStatus withdrawChange(Account *a, const void *cents, bool *write) {
+    if (*(const int64_t*)cents > a->balanceCents) return ATM_ERR_FUNDS;
+    a->balanceCents -= *(const int64_t*)cents;
+    *write = true;
+    return ATM_OK;
+}
+
+AtmStatus opWithdraw(Account *user, double amount) {
+    STAT_SCOPE(ST_WITHDRAW);
+    if (!(amount > 0) || amount > MAX_AMOUNT) return ATM_ERR_AMOUNT;
+    int64_t cents = toCents(amount);
+
+    Account cur;
+    AtmStatus st = changeAccount(user->accountNumber, withdrawChange, &cents, TX_WITHDRAW, cents, "", &cur);
+    if (st == ATM_OK) *user = cur;
+    return st;
+}
+
+typedef struct {
+    uint8_t oldHash[32], newHash[32];
+} PinChange;
+
+static AtmStatus pinChange(Account *a, const void *arg, bool *write) {
+    const PinChange *c = (const PinChange*)arg;
+    if (memcmp(c->oldHash, a->pinHash, sizeof(a->pinHash)) != 0) return ATM_ERR_WRONG_PIN;
+    memcpy(a->pinHash, c->newHash, sizeof(a->pinHash));
+    *write = true;
+    return ATM_OK;
+}
+
+AtmStatus opChangePin(Account *user, const char *oldPin, const char *newPin) {
+    if (strlen(newPin) < 4) return ATM_ERR_PIN_SHORT;
+    PinChange c;
+    if (!sha256_digest(oldPin, c.oldHash) || !sha256_digest(newPin, c.newHash)) return ATM_ERR_HASH;
+
+    Account cur;
+    AtmStatus st = changeAccount(user->accountNumber, pinChange, &c, TX_PIN_CHANGE, 0, "PIN updated", &cur);
+    if (st == ATM_OK) *user = cur;
+    return st;
+}
+
+/* Is toAcc a valid transfer target? Checked before asking for the amount. */
+AtmStatus opCheckTarget(const Account *user, int toAcc) {
+    if (toAcc == user->accountNumber) return ATM_ERR_SAME_ACCOUNT;
+    Account target;
+    if (!loadAccount(toAcc, &target)) return ATM_ERR_NO_TARGET;
+    return target.locked ? ATM_ERR_TARGET_LOCKED : ATM_OK;
+}
+
+AtmStatus opTransfer(Account *user, int toAcc, double amount) {
+    STAT_SCOPE(ST_TRANSFER);
+    if (toAcc == user->accountNumber) return ATM_ERR_SAME_ACCOUNT;
+    if (!(amount > 0) || amount > MAX_AMOUNT) return ATM_ERR_AMOUNT;
+    int64_t cents = toCents(amount);
+
+    // optimistic like changeAccount(), over both accounts
+    Account sender, target;
+    AtmStatus st;
+    for (int attempt = 0;; ++attempt) {
+        bool held = attempt >= OPT_RETRIES;
+        if (held) lockAccountPair(user->accountNumber, toAcc);
+        if (!loadAccount(user->accountNumber, &sender)) {
+            st = ATM_ERR_NOT_FOUND;
+        } else if (!loadAccount(toAcc, &target)) {
+            st = ATM_ERR_NO_TARGET;
+        } else if (target.locked) {
+            st = ATM_ERR_TARGET_LOCKED;
+        } else if (cents > sender.balanceCents) {
+            st = ATM_ERR_FUNDS;
+        } else {
+            st = ATM_OK;
+        }
+        if (st != ATM_OK) {
+            if (held) unlockAccountPair(user->accountNumber, toAcc);
+            break;
+        }
+        sender.balanceCents -= cents;
+        target.balanceCents += cents;
+
+        // both legs go to the journal as one record
+        if (!held) lockAccountPair(user->accountNumber, toAcc);
+        Account *legs[2] = { &sender, &target };
+        st = commitIfCurrent(legs, 2);
+        if (st == ATM_OK) {
+            char note1[64], note2[64];
+            snprintf(note1, sizeof(note1), "to %d", target.accountNumber);
+            snprintf(note2, sizeof(note2), "from %d", sender.accountNumber);
+            logTransaction(&sender, TX_TRANSFER_OUT, cents, note1);
+            logTransaction(&target, TX_TRANSFER_IN,  cents, note2);
+        }
+        unlockAccountPair(user->accountNumber, toAcc);
+        if (st != ATM_ERR_CONFLICT) break;
+    }
+
+    if (st == ATM_OK) *user = sender;
+    return st;
+}
+
+/* Super simple admin auth (demo only).
+   Admin password: "admin123" (hashed here at runtime for compare). */
+bool adminPasswordOk(const char *pass) {
+    uint8_t targetHash[32];
+    // precompute hash of "admin123"
+    if (!sha256_digest("admin123", targetHash)) return false;
+    return pinMatches(pass, targetHash);
+}
+
+AtmStatus opCreateAccount(int accountNumber, const char *name, const char *pin, double balance, Account *out) {
+    if (!*name) return ATM_ERR_INPUT;
+    if (strlen(name) > ACCOUNT_NAME_MAX) return ATM_ERR_NAME_LONG;
+    if (strlen(pin) < 4) return ATM_ERR_PIN_SHORT;
+    if (!(balance >= 0) || balance > MAX_AMOUNT) return ATM_ERR_INPUT;
+
+    Account a;
+    memset(&a, 0, sizeof(a));
+    a.accountNumber = accountNumber;
+    snprintf(a.name, sizeof(a.name), "%s", name);
+    if (!sha256_digest(pin, a.pinHash)) return ATM_ERR_HASH;
+    a.balanceCents = toCents(balance);
+    a.failedAttempts = 0;
+    a.locked = 0;
+
+    AtmStatus st = ATM_OK;
+    lockAccount(accountNumber);
+    if (accountExists(accountNumber)) st = ATM_ERR_EXISTS;
+    else if (!appendAccount(&a))      st = accountExists(accountNumber) ? ATM_ERR_EXISTS : ATM_ERR_IO;
+    unlockAccount(accountNumber);
+
+    if (st == ATM_OK && out) *out = a;
+    return st;
+}
+
+static AtmStatus unlockChange(Account *a, const void *arg, bool *write) {
+    (void)arg;
+    a->locked = 0;
+    a->failedAttempts = 0;
+    *write = true;
+    return ATM_OK;
+}
+
+AtmStatus opUnlockAccount(int accountNumber) {
+    return changeAccount(accountNumber, unlockChange, NULL, 0, 0, NULL, NULL);
+}
+
+static AtmStatus resetPinChange(Account *a, const void *hash, bool *write) {
+    memcpy(a->pinHash, hash, sizeof(a->pinHash));
+    a->failedAttempts = 0;
+    a->locked = 0;
+    *write = true;
+    return ATM_OK;
+}
+
+AtmStatus opResetPin(int accountNumber, const char *newPin) {
+    if (strlen(newPin) < 4) return ATM_ERR_PIN_SHORT;
+    uint8_t hash[32];
+    if (!sha256_digest(newPin, hash)) return ATM_ERR_HASH;
+    return changeAccount(accountNumber, resetPinChange, hash, 0, 0, NULL, NULL);
+}
+
+AtmStatus opExportLog(int accountNumber, const char *path, long *count) {
+    FILE *out = fopen(path, "w");
+    if (!out) return ATM_ERR_FILE;
+    *count = txlogExportText(out, accountNumber);
+    return fclose(out) == 0 ? ATM_OK : ATM_ERR_FILE;
+}
+
+/* ---- Bulk import ----
+   CSV rows "number,name,pin,balance" (an optional header line is skipped;
+   names cannot contain commas). Rows are validated and checked for duplicate
+   numbers within the file while reading, PINs are hashed on every core, and
+   the accepted accounts go to the store in one append. */
+#define IMPORT_PIN_MAX     64
+#define IMPORT_MAX_THREADS 64
+
+typedef struct {
+    Account *accs;
+    char   (*pins)[IMPORT_PIN_MAX];
+    long     from, to;
+    bool     ok;
+} HashJob;
+
+static void* importHashWorker(void *arg) {
+    HashJob *job = (HashJob*)arg;
+    job->ok = true;
+    for (long i = job->from; i < job->to && job->ok; ++i) {
+        job->ok = sha256_digest(job->pins[i], job->accs[i].pinHash);
+    }
+    return NULL;
+}
+
+static bool importHashAll(Account *accs, char (*pins)[IMPORT_PIN_MAX], long n) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long threads = n / 1024 + 1;
+    if (threads > cores) threads = cores;
+    if (threads > IMPORT_MAX_THREADS) threads = IMPORT_MAX_THREADS;
+    if (threads < 1) threads = 1;
+
+    HashJob jobs[IMPORT_MAX_THREADS];
+    pthread_t tids[IMPORT_MAX_THREADS];
+    bool started[IMPORT_MAX_THREADS];
+    for (long t = 0; t < threads; ++t) {
+        jobs[t] = (HashJob){ accs, pins, n * t / threads, n * (t + 1) / threads, false };
+        // a thread that cannot start does its share on this one
+        started[t] = t > 0 && pthread_create(&tids[t], NULL, importHashWorker, &jobs[t]) == 0;
+    }
+    for (long t = 0; t < threads; ++t) {
+        if (!started[t]) importHashWorker(&jobs[t]);
+    }
+    bool ok = true;
+    for (long t = 0; t < threads; ++t) {
+        if (started[t]) pthread_join(tids[t], NULL);
+        ok = ok && jobs[t].ok;
+    }
+    return ok;
+}
+
+static char* trimField(char *f) {
+    while (*f == ' ' || *f == '\t') f++;
+    size_t n = strlen(f);
+    while (n > 0 && (f[n - 1] == ' ' || f[n - 1] == '\t')) f[--n] = '\0';
+    return f;
+}
+
+/* Validates one CSV line into a; returns NULL or why the row is rejected. */
+static const char* importParseRow(char *line, Account *a, char pin[IMPORT_PIN_MAX]) {
+    char *field[4];
+    int nf = 0;
+    char *save = NULL;
+    for (char *f = strtok_r(line, ",", &save); f; f = strtok_r(NULL, ",", &save)) {
+        if (nf == 4) return "expected 4 fields";
+        field[nf++] = trimField(f);
+    }
+    if (nf != 4) return "expected 4 fields";
+
+    double balance;
+    memset(a, 0, sizeof(*a));
+    if (!parseInt(field[0], &a->accountNumber)) return "bad account number";
+    if (!*field[1]) return "empty name";
+    if (strlen(field[1]) > ACCOUNT_NAME_MAX) return "name too long (max 15 characters)";
+    if (strlen(field[2]) < 4) return "PIN too short (min 4)";
+    if (strlen(field[2]) >= IMPORT_PIN_MAX) return "PIN too long";
+    if (!parseAmount(field[3], &balance) || !(balance >= 0) || balance > MAX_AMOUNT) return "bad balance";
+
+    snprintf(a->name, sizeof(a->name), "%s", field[1]);
+    memcpy(pin, field[2], strlen(field[2]) + 1);
+    a->balanceCents = toCents(balance);
+    return NULL;
+}
+
+AtmStatus opImportAccounts(const char *path, FILE *report, const char *prefix, long *accepted, long *rejected) {
+    *accepted = *rejected = 0;
+    FILE *in = fopen(path, "r");
+    if (!in) return ATM_ERR_NO_FILE;
+
+    Account *accs = NULL;
+    char (*pins)[IMPORT_PIN_MAX] = NULL;
+    long *lines = NULL;
+    size_t accsCap = 0, pinsCap = 0, linesCap = 0;
+    long n = 0;
+
+    // numbers seen so far in the file -> line of their first row
+    uint64_t seenCap = IDX_MIN_CAP;
+    IndexSlot *seen = (IndexSlot*)calloc((size_t)seenCap, sizeof(IndexSlot));
+    uint64_t seenCount = 0;
+
+    AtmStatus st = seen ? ATM_OK : ATM_ERR_IO;
+    char *line = NULL;
+    size_t cap = 0;
+    long lineNo = 0;
+    while (st == ATM_OK && getline(&line, &cap, in) != -1) {
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!*trimField(line)) continue;
+        if (lineNo == 1 && !isdigit((unsigned char)*trimField(line))) continue;   // header
+
+        if (!growBuffer((char**)&accs, &accsCap, (size_t)(n + 1) * sizeof(Account)) ||
+            !growBuffer((char**)&pins, &pinsCap, (size_t)(n + 1) * IMPORT_PIN_MAX) ||
+            !growBuffer((char**)&lines, &linesCap, (size_t)(n + 1) * sizeof(long))) {
+            st = ATM_ERR_IO;
+            break;
+        }
+        const char *why = importParseRow(line, &accs[n], pins[n]);
+        if (why) {
+            fprintf(report, "%sline %ld: rejected, %s\n", prefix, lineNo, why);
+            (*rejected)++;
+            continue;
+        }
+
+        if ((seenCount + 1) * 2 > seenCap) {
+            uint64_t bigger = seenCap * 2;
+            IndexSlot *t = (IndexSlot*)calloc((size_t)bigger, sizeof(IndexSlot));
+            if (!t) { st = ATM_ERR_IO; break; }
+            for (uint64_t i = 0; i < seenCap; ++i) {
+                if (seen[i].used) *idxProbe(t, bigger, seen[i].accountNumber) = seen[i];
+            }
+            free(seen);
+            seen = t;
+            seenCap = bigger;
+        }
+        IndexSlot *slot = idxProbe(seen, seenCap, accs[n].accountNumber);
+        if (slot->used) {
+            fprintf(report, "%sline %ld: rejected, account %d repeats line %ld\n",
+                    prefix, lineNo, accs[n].accountNumber, (long)slot->offset);
+            (*rejected)++;
+            continue;
+        }
+        slot->accountNumber = accs[n].accountNumber;
+        slot->used = 1;
+        slot->offset = lineNo;
+        seenCount++;
+        lines[n++] = lineNo;
+    }
+    free(line);
+    free(seen);
+    fclose(in);
+
+    if (st == ATM_OK && n > 0 && !importHashAll(accs, pins, n)) st = ATM_ERR_HASH;
+    if (st == ATM_OK && n > 0) {
+        bool *taken = (bool*)malloc((size_t)n * sizeof(bool));
+        long kept = taken ? appendAccounts(accs, n, taken) : -1;
+        if (kept < 0) {
+            st = ATM_ERR_IO;
+        } else {
+            for (long i = 0; i < n; ++i) {
+                if (!taken[i]) continue;
+                fprintf(report, "%sline %ld: rejected, account already exists\n", prefix, lines[i]);
+                (*rejected)++;
+            }
+            *accepted = kept;
+        }
+        free(taken);
+    }
+    free(accs);
+    free(pins);
+    free(lines);
+    return st;
+}
+
+/* Page `page` (from 1) of the accounts whose names start with name, ignoring
+   case, in name order; out must hold SEARCH_PAGE records. */
+AtmStatus opSearchAccounts(const char *name, int page, Account *out, int *n, long *total) {
+    STAT_SCOPE(ST_SEARCH);
+    *n = 0;
+    *total = 0;
+    if (!name || page < 1) return ATM_ERR_INPUT;
+
+    int32_t numbers[SEARCH_PAGE];
+    long found = nameSearch(name, (long)(page - 1) * SEARCH_PAGE, SEARCH_PAGE, numbers, total);
+    if (found < 0) return ATM_ERR_IO;
+    for (long i = 0; i < found; ++i) {
+        if (loadAccount(numbers[i], &out[*n])) (*n)++;   // current balance and lock state
+    }
+    return ATM_OK;
+}
+
+static void writeAccountLine(FILE *out, const char *prefix, const Account *a) {
+    char bal[24];
+    fprintf(out, "%sA/C %-6d | %-20s | Bal: %10s | Locked: %d | Attempts: %d\n",
+            prefix, a->accountNumber, a->name, fmtCents(a->balanceCents, bal),
+            (int)a->locked, (int)a->failedAttempts);
+}
+
+/* Listings shared by the menus and the server; every line starts with prefix. */
+void writeAccountList(FILE *out, const char *prefix) {
+    (void)cacheFlush();   // the listing reads the store
+    fprintf(out, "%s--- All Accounts ---\n", prefix);
+    pthread_rwlock_rdlock(&g_layoutLock);   // one shard layout from start to end
+    const StoreLayout *l = storeLayout();
+    size_t n = 0;
+    for (unsigned k = 0; k < l->shards; ++k) {
+        const StoreShard *sh = l->shard[k];
+        size_t count = shardCount(sh);
+        for (size_t i = 0; i < count; ++i) writeAccountLine(out, prefix, shardAt(sh, i));
+        n += count;
+    }
+    pthread_rwlock_unlock(&g_layoutLock);
+    if (n == 0) fprintf(out, "%s(none)\n", prefix);
+}
+
+/* One page of a name search in the listing's layout; *total gets the number
+   of matches. */
+AtmStatus writeAccountSearch(FILE *out, const char *prefix, const char *name, int page, long *total) {
+    Account accs[SEARCH_PAGE];
+    int n;
+    AtmStatus st = opSearchAccounts(name, page, accs, &n, total);
+    if (st != ATM_OK) return st;
+    fprintf(out, "%s--- Accounts named \"%s...\" ---\n", prefix, name);
+    for (int i = 0; i < n; ++i) writeAccountLine(out, prefix, &accs[i]);
+    if (n == 0) fprintf(out, "%s(none)\n", prefix);
+    return ATM_OK;
+}
+
+/* ======================= Auth ======================= */
+void resetFailedAttempts(Account *user) {
+    if (user->failedAttempts != 0) {
+        user->failedAttempts = 0;
+        (void)updateAccount(user);
+    }
+}
+
+bool login(Account *outUser) {
+    int accNo;
+    printf("\nEnter Account Number: ");
+    if (scanf("%d", &accNo) != 1) { printf("Invalid input.\n"); return false; }
+    flush_line();
+
+    AtmStatus st = opCheckLogin(accNo);
+    if (st != ATM_OK) {
+        printf("%s\n", atmStatusText(st));
+        return false;
+    }
+
+    char pin[64];
+    printf("Enter PIN (hidden): ");
+    get_hidden_input(pin, sizeof(pin));
+
+    Account user;
+    st = opLogin(accNo, pin, &user);
+    if (st == ATM_ERR_BAD_PIN) {
+        printf("❌ Invalid PIN. Attempts: %d/3\n", (int)user.failedAttempts);
+        return false;
+    }
+    if (st != ATM_OK) {
+        printf("%s\n", atmStatusText(st));
+        return false;
+    }
+
+    *outUser = user;
+    printf("\n✅ Login successful! Welcome, %s (A/C %d)\n", user.name, user.accountNumber);
+    return true;
+}
+
+/* ======================= Features ======================= */
+void balanceInquiry(Account *user) {
+    AtmStatus st = opBalance(user);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    char bal[24];
+    printf("💰 Current Balance: %s\n", fmtCents(user->balanceCents, bal));
+}
+
+void deposit(Account *user) {
+    double amount;
+    printf("Enter deposit amount: ");
+    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    AtmStatus st = opDeposit(user, amount);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    char bal[24];
+    printf("✅ Deposit successful. New Balance: %s\n", fmtCents(user->balanceCents, bal));
+}
+
+void withdraw(Account *user) {
+    double amount;
+    printf("Enter withdrawal amount: ");
+    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    AtmStatus st = opWithdraw(user, amount);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    char bal[24];
+    printf("✅ Withdrawal successful. New Balance: %s\n", fmtCents(user->balanceCents, bal));
 }
 
 void changePin(Account *user) {
     char oldpin[64], newpin1[64], newpin2[64];
 
-    printf("Enter current PIN (hidden): ");
-    get_hidden_input(oldpin, sizeof(oldpin));
+    printf("Enter current PIN (hidden): ");
+    get_hidden_input(oldpin, sizeof(oldpin));
+    if (!pinMatches(oldpin, user->pinHash)) { printf("%s\n", atmStatusText(ATM_ERR_WRONG_PIN)); return; }
+
+    printf("Enter new PIN (hidden): ");
+    get_hidden_input(newpin1, sizeof(newpin1));
+    printf("Confirm new PIN (hidden): ");
+    get_hidden_input(newpin2, sizeof(newpin2));
+
+    if (strcmp(newpin1, newpin2) != 0) {
+        printf("❌ PINs do not match.\n");
+        return;
+    }
+
+    AtmStatus st = opChangePin(user, oldpin, newpin1);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    printf("✅ PIN changed successfully.\n");
+}
+
+void transferFunds(Account *user) {
+    int toAcc;
+    double amount;
+    printf("Enter target Account Number: ");
+    if (scanf("%d", &toAcc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    AtmStatus st = opCheckTarget(user, toAcc);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+
+    printf("Enter amount to transfer: ");
+    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    st = opTransfer(user, toAcc, amount);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    char amt[24], bal[24];
+    printf("✅ Transferred %s to A/C %d. New Balance: %s\n",
+           fmtCents(toCents(amount), amt), toAcc, fmtCents(user->balanceCents, bal));
+}
+
+static bool promptLine(const char *prompt, char *buf, size_t n) {
+    printf("%s", prompt);
+    if (!fgets(buf, (int)n, stdin)) { printf("Input error.\n"); return false; }
+    buf[strcspn(buf, "\r\n")] = '\0';
+    return true;
+}
+
+/* Asks for the period, types and format of a date-range statement. */
+static bool promptStmtQuery(StmtQuery *q) {
+    static const char *const formats[] = { "text", "csv", "json" };
+    char from[32], to[32], types[96], format[16];
+    if (!promptLine("From (YYYY-MM-DD, or YYYY-MM for a whole month): ", from, sizeof(from)) ||
+        !promptLine("To (Enter = same as From): ", to, sizeof(to)) ||
+        !promptLine("Types, e.g. DEPOSIT,WITHDRAW,TRANSFER,PIN-CHG (Enter = all): ", types, sizeof(types)) ||
+        !promptLine("Format: 1. Text  2. CSV  3. JSON (Enter = text): ", format, sizeof(format))) {
+        return false;
+    }
+    int f = format[0] ? atoi(format) : 1;
+    if (f < 1 || f > 3 || !parseStmtQuery(from, to, formats[f - 1], types, q)) {
+        printf("%s\n", atmStatusText(ATM_ERR_INPUT));
+        return false;
+    }
+    return true;
+}
+
+void statementByDate(Account *user) {
+    StmtQuery q;
+    long n;
+    if (!promptStmtQuery(&q)) return;
+    putchar('\n');
+    AtmStatus st = writeStatementRange(stdout, "", user->accountNumber, &q, &n);
+    if (st != ATM_OK) printf("%s\n", atmStatusText(st));
+}
+
+/* ======================= Menus ======================= */
+void atmMenu(Account *user) {
+    for (;;) {
+        int choice;
+        printf("\n--- ATM Menu ---\n");
+        printf("1. Balance Inquiry\n");
+        printf("2. Deposit\n");
+        printf("3. Withdraw\n");
+        printf("4. Change PIN\n");
+        printf("5. Transfer Funds\n");
+        printf("6. Mini Statement (last 5)\n");
+        printf("7. Statement by Date\n");
+        printf("8. Exit\n");
+        printf("Enter choice: ");
+        if (scanf("%d", &choice) != 1) { printf("Invalid input.\n"); flush_line(); continue; }
+        flush_line();
+
+        switch (choice) {
+            case 1: balanceInquiry(user); break;
+            case 2: deposit(user); break;
+            case 3: withdraw(user); break;
+            case 4: changePin(user); break;
+            case 5: transferFunds(user); break;
+            case 6: showMiniStatement(user, 5); break;
+            case 7: statementByDate(user); break;
+            case 8: (void)cacheFlush(); printf("👋 Thank you for using ATM.\n"); return;
+            default: printf("Invalid choice.\n");
+        }
+    }
+}
+
+/* ======================= Admin ======================= */
+bool adminLogin(void) {
+    char pass[64];
+
+    printf("\n--- Admin Login ---\nPassword (hidden): ");
+    get_hidden_input(pass, sizeof(pass));
+
+    if (adminPasswordOk(pass)) {
+        printf("✅ Admin authenticated.\n");
+        return true;
+    }
+    printf("❌ Wrong admin password.\n");
+    return false;
+}
+
+void adminCreateAccount(void) {
+    int accNo;
+    char name[50], pin[64];
+    double balance;
+
+    printf("\n--- Create Account ---\n");
+    printf("Enter new Account Number: ");
+    if (scanf("%d", &accNo) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    if (accountExists(accNo)) {
+        printf("%s\n", atmStatusText(ATM_ERR_EXISTS));
+        return;
+    }
+
+    printf("Enter name (max %d characters): ", ACCOUNT_NAME_MAX);
+    if (!fgets(name, sizeof(name), stdin)) { printf("Input error.\n"); return; }
+    name[strcspn(name, "\r\n")] = '\0';
+    if (!name[0]) { printf("%s\n", atmStatusText(ATM_ERR_INPUT)); return; }
+    if (strlen(name) > ACCOUNT_NAME_MAX) { printf("%s\n", atmStatusText(ATM_ERR_NAME_LONG)); return; }
+
+    printf("Enter initial PIN (hidden, min 4): ");
+    get_hidden_input(pin, sizeof(pin));
+    if (strlen(pin) < 4) { printf("%s\n", atmStatusText(ATM_ERR_PIN_SHORT)); return; }
+
+    printf("Enter initial balance: ");
+    if (scanf("%lf", &balance) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    Account a;
+    AtmStatus st = opCreateAccount(accNo, name, pin, balance, &a);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    char bal[24];
+    printf("✅ Account created: %d (%s) with balance %s\n", a.accountNumber, a.name, fmtCents(a.balanceCents, bal));
+}
+
+void adminListAccounts(void) {
+    if (!storeOpen()) { printf("No accounts file.\n"); return; }
+    putchar('\n');
+    writeAccountList(stdout, "");
+}
+
+void adminSearchAccounts(void) {
+    char name[50], line[32];
+
+    printf("Name starts with (max %d characters, Enter = all): ", ACCOUNT_NAME_MAX);
+    if (!fgets(name, sizeof(name), stdin)) { printf("Input error.\n"); return; }
+    name[strcspn(name, "\r\n")] = '\0';
+
+    for (int page = 1; page > 0;) {
+        long total;
+        putchar('\n');
+        AtmStatus st = writeAccountSearch(stdout, "", name, page, &total);
+        if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+        long pages = (total + SEARCH_PAGE - 1) / SEARCH_PAGE;
+        printf("🔎 %ld match(es); page %d of %ld.\n", total, page, pages ? pages : 1);
+        if (pages <= 1) return;
+        printf("Page to show (Enter = done): ");
+        if (!fgets(line, sizeof(line), stdin)) return;
+        page = atoi(line);
+    }
+}
+
+void adminReports(void) {
+    int which, order;
+    long pages;
+    char line[32];
+
+    putchar('\n');
+    AtmStatus st = writeReport(stdout, "", REPORT_ALL, REPORT_BY_BALANCE, 0, 0, &pages);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+
+    printf("\nList: 1. All accounts  2. Locked  3. Failed PIN attempts  0. Done\nChoose: ");
+    if (scanf("%d", &which) != 1 || which < 1 || which > 3) { flush_line(); return; }
+    flush_line();
+    printf("Order: 1. Highest balance  2. Lowest balance  3. Most failed attempts  4. Number\nChoose: ");
+    if (scanf("%d", &order) != 1 || order < 1 || order > 4) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    for (int page = 1; page > 0;) {
+        putchar('\n');
+        st = writeReport(stdout, "", (ReportFilter)(which - 1), (ReportSort)(order - 1), page, 0, &pages);
+        if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+        if (pages <= 1) return;
+        printf("Page to show (Enter = done): ");
+        if (!fgets(line, sizeof(line), stdin)) return;
+        page = atoi(line);
+    }
+}
+
+void adminUnlockAccount(void) {
+    int acc;
+    printf("Enter account to unlock: ");
+    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    AtmStatus st = opUnlockAccount(acc);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    printf("✅ Account %d unlocked.\n", acc);
+}
+
+void adminResetPin(void) {
+    int acc;
+    char newpin[64];
+
+    printf("Enter account to reset PIN: ");
+    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    if (!accountExists(acc)) { printf("%s\n", atmStatusText(ATM_ERR_NOT_FOUND)); return; }
+
+    printf("Enter new PIN (hidden, min 4): ");
+    get_hidden_input(newpin, sizeof(newpin));
+
+    AtmStatus st = opResetPin(acc, newpin);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    printf("✅ PIN reset for A/C %d.\n", acc);
+}
+
+void adminExportLog(void) {
+    int acc;
+    char path[128];
+
+    printf("Account to export (0 = all): ");
+    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    printf("Output file: ");
+    if (!fgets(path, sizeof(path), stdin)) { printf("Input error.\n"); return; }
+    path[strcspn(path, "\r\n")] = '\0';
+    if (!path[0]) { printf("❌ No file name given.\n"); return; }
+
+    long n = 0;
+    AtmStatus st = opExportLog(acc, path, &n);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    printf("✅ Exported %ld transaction(s) to %s.\n", n, path);
+}
+
+void adminAccountHistory(void) {
+    int acc;
+    char path[128];
+    StmtQuery q;
+
+    printf("Account: ");
+    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    if (!accountExists(acc)) { printf("%s\n", atmStatusText(ATM_ERR_NOT_FOUND)); return; }
+    if (!promptStmtQuery(&q) || !promptLine("Output file (Enter = screen): ", path, sizeof(path))) return;
+
+    FILE *out = path[0] ? fopen(path, "w") : stdout;
+    if (!out) { printf("%s\n", atmStatusText(ATM_ERR_FILE)); return; }
+    if (!path[0]) putchar('\n');
+    long n = 0;
+    AtmStatus st = writeStatementRange(out, "", acc, &q, &n);
+    if (path[0] && fclose(out) != 0 && st == ATM_OK) st = ATM_ERR_FILE;
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    if (path[0]) printf("✅ Wrote %ld transaction(s) to %s.\n", n, path);
+}
+
+void adminImportAccounts(void) {
+    char path[128];
+
+    printf("CSV file (number,name,pin,balance per line): ");
+    if (!fgets(path, sizeof(path), stdin)) { printf("Input error.\n"); return; }
+    path[strcspn(path, "\r\n")] = '\0';
+    if (!path[0]) { printf("❌ No file name given.\n"); return; }
+
+    long accepted, rejected;
+    AtmStatus st = opImportAccounts(path, stdout, "", &accepted, &rejected);
+    if (st != ATM_OK) { printf("%s\n", atmStatusText(st)); return; }
+    printf("✅ Imported %ld account(s), %ld row(s) rejected.\n", accepted, rejected);
+}
+
+void adminShowStats(void) {
+    putchar('\n');
+    writeStats(stdout, "");
+    printf("📊 Also written to %s on exit and on SIGUSR1.\n", statsFile());
+}
+
+void adminBackup(void) {
+    char path[128];
+
+    printf("Backup file: ");
+    if (!fgets(path, sizeof(path), stdin)) { printf("Input error.\n"); return; }
+    path[strcspn(path, "\r\n")] = '\0';
+    if (!path[0]) { printf("❌ No file name given.\n"); return; }
+    (void)runBackup(path);
+}
+
+void adminReshard(void) {
+    int shards;
+
+    printf("Current shards: %u\n", storeLayout()->shards);
+    printf("New shard count: ");
+    if (scanf("%d", &shards) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    (void)runReshard((unsigned)shards);
+}
+
+void adminMenu(void) {
+    if (!adminLogin()) return;
+
+    for (;;) {
+        int ch;
+        printf("\n--- Admin Menu ---\n");
+        printf("1. Create Account\n");
+        printf("2. List Accounts\n");
+        printf("3. Unlock Account\n");
+        printf("4. Reset PIN\n");
+        printf("5. Export Transaction Log\n");
+        printf("6. Import Accounts (CSV)\n");
+        printf("7. Statistics\n");
+        printf("8. Backup Accounts\n");
+        printf("9. Reshard Accounts\n");
+        printf("10. Search Accounts by Name\n");
+        printf("11. Reports\n");
+        printf("12. Account History (CSV/JSON)\n");
+        printf("13. Exit Admin\n");
+        printf("Enter choice: ");
+        if (scanf("%d", &ch) != 1) { printf("Invalid input.\n"); flush_line(); continue; }
+        flush_line();
+
+        switch (ch) {
+            case 1: adminCreateAccount();  break;
+            case 2: adminListAccounts();   break;
+            case 3: adminUnlockAccount();  break;
+            case 4: adminResetPin();       break;
+            case 5: adminExportLog();      break;
+            case 6: adminImportAccounts(); break;
+            case 7: adminShowStats();      break;
+            case 8: adminBackup();         break;
+            case 9: adminReshard();        break;
+            case 10: adminSearchAccounts(); break;
+            case 11: adminReports();       break;
+            case 12: adminAccountHistory(); break;
+            case 13: (void)cacheFlush(); return;
+            default: printf("Invalid choice.\n");
+        }
+    }
+}
+
+/* ======================= Server ======================= */
+/*
+ * `atm --server [socket] [workers]` serves sessions over a Unix domain socket.
+ * The main thread accepts connections into a bounded queue and a fixed pool
+ * of worker threads each runs one session at a time. One command per line:
+ *
+ *   CHECK <acct>                      may this account log in?
+ *   LOGIN <acct> <pin>                start a customer session
+ *   BALANCE | DEPOSIT <amt> | WITHDRAW <amt> | CHPIN <old> <new>
+ *   TARGET <acct> | TRANSFER <acct> <amt> | STATEMENT [n]
+ *   HISTORY <from> <to> [fmt] [types]
+ *                                     entries of a period, oldest first; dates are
+ *                                     YYYY-MM-DD or YYYY-MM, fmt text|csv|json,
+ *                                     types e.g. DEPOSIT,TRANSFER (default all)
+ *   ADMIN <password>                  start an admin session
+ *   FREE <acct> | CREATE <acct> <pin> <balance> <name...> | LIST
+ *   SEARCH <page> [name prefix...]    accounts by name prefix, 20 per page
+ *   REPORT                            totals and balance histogram
+ *   REPORT <which> [<order> [page]]   a page of a listing; which: all|locked|attempts,
+ *                                     order: top|bottom|attempts|number
+ *   UNLOCK <acct> | RESETPIN <acct> <pin> | EXPORT <acct> <file> | IMPORT <file>
+ *   HISTORY <acct> <from> <to> ...    HISTORY for any account
+ *   STATS                             latency histograms and I/O counters
+ *   BACKUP <file>                     point-in-time copy of the accounts
+ *   RESHARD <shards>                  move the accounts into that many shard files
+ *   LOGOUT | QUIT
+ *
+ * A reply is any number of "+ " listing lines followed by one "OK <message>"
+ * or "ERR <message>" line, where message is what the menus would print.
+ */
+#define SERVER_SOCKET_DEFAULT  "atm.sock"
+#define SERVER_WORKERS_DEFAULT 8
+#define SERVER_WORKERS_MAX     256
+#define SERVER_QUEUE           64
+
+typedef struct {
+    FILE    *out;
+    Account  user;
+    bool     loggedIn;
+    bool     admin;
+    bool     ok;        // outcome of the last reply
+} Session;
+
+static struct {
+    pthread_mutex_t mu;
+    pthread_cond_t  ready;                       // a connection was queued
+    int             queue[SERVER_QUEUE];
+    int             head, count;
+    int             active[SERVER_WORKERS_MAX];  // session fd per worker, -1 when idle
+    bool            stopping;
+} g_server = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, {0}, 0, 0, {0}, false };
+
+static volatile sig_atomic_t g_serverStop;
+
+static void serverSignal(int sig) {
+    (void)sig;
+    g_serverStop = 1;
+}
+
+static void reply(Session *s, bool ok, const char *fmt, ...) {
+    va_list ap;
+    s->ok = ok;
+    fputs(ok ? "OK " : "ERR ", s->out);
+    va_start(ap, fmt);
+    vfprintf(s->out, fmt, ap);
+    va_end(ap);
+    fputc('\n', s->out);
+}
+
+static void replyStatus(Session *s, AtmStatus st) {
+    reply(s, st == ATM_OK, "%s", atmStatusText(st));
+}
+
+static void serverCustomerCommand(Session *s, const char *cmd, char *a1, char *a2, char *a3, char *rest) {
+    int acc;
+    double amt;
+    char bal[24], amtText[24];
+    AtmStatus st;
+
+    if (strcmp(cmd, "BALANCE") == 0) {
+        st = opBalance(&s->user);
+        if (st == ATM_OK) reply(s, true, "💰 Current Balance: %s", fmtCents(s->user.balanceCents, bal));
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "DEPOSIT") == 0) {
+        if (!parseAmount(a1, &amt)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opDeposit(&s->user, amt);
+        if (st == ATM_OK) reply(s, true, "✅ Deposit successful. New Balance: %s", fmtCents(s->user.balanceCents, bal));
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "WITHDRAW") == 0) {
+        if (!parseAmount(a1, &amt)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opWithdraw(&s->user, amt);
+        if (st == ATM_OK) reply(s, true, "✅ Withdrawal successful. New Balance: %s", fmtCents(s->user.balanceCents, bal));
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "CHPIN") == 0) {
+        if (!a1 || !a2) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opChangePin(&s->user, a1, a2);
+        if (st == ATM_OK) reply(s, true, "✅ PIN changed successfully.");
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "TARGET") == 0) {
+        if (!parseInt(a1, &acc)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        replyStatus(s, opCheckTarget(&s->user, acc));
+    } else if (strcmp(cmd, "TRANSFER") == 0) {
+        if (!parseInt(a1, &acc) || !parseAmount(a2, &amt)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opTransfer(&s->user, acc, amt);
+        if (st == ATM_OK) reply(s, true, "✅ Transferred %s to A/C %d. New Balance: %s",
+                                fmtCents(toCents(amt), amtText), acc, fmtCents(s->user.balanceCents, bal));
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "STATEMENT") == 0) {
+        int n = 5;
+        if (a1 && (!parseInt(a1, &n) || n <= 0 || n > 1000)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        writeMiniStatement(s->out, "+ ", s->user.accountNumber, n);
+        reply(s, true, "End of statement.");
+    } else if (strcmp(cmd, "HISTORY") == 0) {
+        StmtQuery q;
+        long n;
+        char *save = NULL;
+        char *types = rest ? strtok_r(rest, " \t", &save) : NULL;
+        if (!a2 || !parseStmtQuery(a1, a2, a3, types, &q)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = writeStatementRange(s->out, "+ ", s->user.accountNumber, &q, &n);
+        if (st == ATM_OK) reply(s, true, "End of statement: %ld transaction(s).", n);
+        else replyStatus(s, st);
+    } else {
+        reply(s, false, "Unknown command.");
+    }
+}
+
+/* REPORT <which> [<order> [page]]: the listing's words to their values. */
+static bool parseReport(const char *which, const char *order, const char *pageText,
+                        ReportFilter *filter, ReportSort *sort, int *page) {
+    static const char *const filters[] = { "all", "locked", "attempts" };
+    static const char *const sorts[] = { "top", "bottom", "attempts", "number" };
+    static const ReportSort defaults[] = { REPORT_BY_BALANCE, REPORT_BY_NUMBER, REPORT_BY_ATTEMPTS };
+    int f = -1, o = -1;
+    for (int i = 0; i < 3; ++i) {
+        if (strcmp(which, filters[i]) == 0) f = i;
+    }
+    for (int i = 0; order && i < 4; ++i) {
+        if (strcmp(order, sorts[i]) == 0) o = i;
+    }
+    if (f < 0 || (order && o < 0)) return false;
+    *filter = (ReportFilter)f;
+    *sort = order ? (ReportSort)o : defaults[f];
+    *page = 1;
+    return !pageText || (parseInt(pageText, page) && *page >= 1);
+}
+
+static void serverAdminCommand(Session *s, const char *cmd, char *a1, char *a2, char *a3, char *rest) {
+    int acc;
+    double amt;
+    AtmStatus st;
+
+    if (strcmp(cmd, "FREE") == 0) {
+        if (!parseInt(a1, &acc)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        if (accountExists(acc)) replyStatus(s, ATM_ERR_EXISTS);
+        else reply(s, true, "Account number is free.");
+    } else if (strcmp(cmd, "CREATE") == 0) {
+        Account a;
+        if (!parseInt(a1, &acc) || !a2 || !parseAmount(a3, &amt) || !rest || !*rest) {
+            replyStatus(s, ATM_ERR_INPUT);
+            return;
+        }
+        st = opCreateAccount(acc, rest, a2, amt, &a);
+        char bal[24];
+        if (st == ATM_OK) reply(s, true, "✅ Account created: %d (%s) with balance %s", a.accountNumber, a.name, fmtCents(a.balanceCents, bal));
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "LIST") == 0) {
+        writeAccountList(s->out, "+ ");
+        reply(s, true, "%zu account(s).", storeCount());
+    } else if (strcmp(cmd, "SEARCH") == 0) {
+        int page;
+        long total;
+        char name[64];
+        if (!parseInt(a1, &page)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        snprintf(name, sizeof(name), "%s%s%s%s%s", a2 ? a2 : "", a3 ? " " : "", a3 ? a3 : "",
+                 rest && *rest ? " " : "", rest ? rest : "");
+        st = writeAccountSearch(s->out, "+ ", name, page, &total);
+        long pages = (total + SEARCH_PAGE - 1) / SEARCH_PAGE;
+        if (st == ATM_OK) reply(s, true, "🔎 %ld match(es); page %d of %ld.", total, page, pages ? pages : 1);
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "REPORT") == 0) {
+        ReportFilter filter = REPORT_ALL;
+        ReportSort sort = REPORT_BY_BALANCE;
+        int page = 0;
+        long pages;
+        if (a1 && !parseReport(a1, a2, a3, &filter, &sort, &page)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = writeReport(s->out, "+ ", filter, sort, page, 0, &pages);
+        if (st == ATM_OK) reply(s, true, "End of report.");
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "UNLOCK") == 0) {
+        if (!parseInt(a1, &acc)) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opUnlockAccount(acc);
+        if (st == ATM_OK) reply(s, true, "✅ Account %d unlocked.", acc);
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "RESETPIN") == 0) {
+        if (!parseInt(a1, &acc) || !a2) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opResetPin(acc, a2);
+        if (st == ATM_OK) reply(s, true, "✅ PIN reset for A/C %d.", acc);
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "EXPORT") == 0) {
+        long n = 0;
+        if (!parseInt(a1, &acc) || !a2) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opExportLog(acc, a2, &n);
+        if (st == ATM_OK) reply(s, true, "✅ Exported %ld transaction(s) to %s.", n, a2);
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "HISTORY") == 0) {
+        StmtQuery q;
+        long n;
+        char *save = NULL;
+        char *format = rest ? strtok_r(rest, " \t", &save) : NULL;
+        char *types = format ? strtok_r(NULL, " \t", &save) : NULL;
+        if (!parseInt(a1, &acc) || !a3 || !parseStmtQuery(a2, a3, format, types, &q)) {
+            replyStatus(s, ATM_ERR_INPUT);
+            return;
+        }
+        st = writeStatementRange(s->out, "+ ", acc, &q, &n);
+        if (st == ATM_OK) reply(s, true, "End of statement: %ld transaction(s).", n);
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "IMPORT") == 0) {
+        long accepted, rejected;
+        if (!a1) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opImportAccounts(a1, s->out, "+ ", &accepted, &rejected);
+        if (st == ATM_OK) reply(s, true, "✅ Imported %ld account(s), %ld row(s) rejected.", accepted, rejected);
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "STATS") == 0) {
+        writeStats(s->out, "+ ");
+        reply(s, true, "📊 Statistics of this server process.");
+    } else if (strcmp(cmd, "BACKUP") == 0) {
+        uint64_t accounts;
+        int64_t logPos;
+        long redone;
+        if (!a1) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opBackup(a1, &accounts, &logPos, &redone);
+        if (st == ATM_OK) reply(s, true, "✅ Backed up %llu account(s) to %s at log position %lld.",
+                                (unsigned long long)accounts, a1, (long long)logPos);
+        else replyStatus(s, st);
+    } else if (strcmp(cmd, "RESHARD") == 0) {
+        uint64_t accounts;
+        long redone;
+        if (!a1) { replyStatus(s, ATM_ERR_INPUT); return; }
+        st = opReshard((unsigned)atoi(a1), &accounts, &redone);
+        if (st == ATM_OK) reply(s, true, "✅ %llu account(s) now in %u shard(s).",
+                                (unsigned long long)accounts, storeLayout()->shards);
+        else replyStatus(s, st);
+    } else {
+        reply(s, false, "Unknown command.");
+    }
+}
+
+/* Runs one command line; returns false once the client is done. */
+static bool serverCommand(Session *s, char *line) {
+    char *save = NULL;
+    char *cmd = strtok_r(line, " \t", &save);
+    char *a1 = cmd ? strtok_r(NULL, " \t", &save) : NULL;
+    char *a2 = a1 ? strtok_r(NULL, " \t", &save) : NULL;
+    char *a3 = a2 ? strtok_r(NULL, " \t", &save) : NULL;
+    char *rest = a3 ? save : NULL;   // CREATE: the name may contain spaces
+    if (rest) rest += strspn(rest, " \t");
+
+    if (!cmd) {
+        reply(s, false, "Empty command.");
+    } else if (strcmp(cmd, "QUIT") == 0) {
+        reply(s, true, "Bye!");
+        return false;
+    } else if (strcmp(cmd, "LOGOUT") == 0) {
+        if (s->loggedIn || s->admin) (void)cacheFlush();
+        reply(s, true, s->loggedIn ? "👋 Thank you for using ATM." : "Logged out.");
+        s->loggedIn = s->admin = false;
+    } else if (strcmp(cmd, "CHECK") == 0) {
+        int acc;
+        if (!parseInt(a1, &acc)) replyStatus(s, ATM_ERR_INPUT);
+        else replyStatus(s, opCheckLogin(acc));
+    } else if (strcmp(cmd, "LOGIN") == 0) {
+        int acc;
+        if (s->loggedIn || s->admin) { reply(s, false, "Already in a session; LOGOUT first."); return true; }
+        if (!parseInt(a1, &acc) || !a2) { replyStatus(s, ATM_ERR_INPUT); return true; }
+        Account user;
+        AtmStatus st = opLogin(acc, a2, &user);
+        if (st == ATM_OK) {
+            s->user = user;
+            s->loggedIn = true;
+            reply(s, true, "✅ Login successful! Welcome, %s (A/C %d)", user.name, user.accountNumber);
+        } else if (st == ATM_ERR_BAD_PIN) {
+            reply(s, false, "❌ Invalid PIN. Attempts: %d/3", (int)user.failedAttempts);
+        } else {
+            replyStatus(s, st);
+        }
+    } else if (strcmp(cmd, "ADMIN") == 0) {
+        if (s->loggedIn || s->admin) { reply(s, false, "Already in a session; LOGOUT first."); return true; }
+        s->admin = a1 && adminPasswordOk(a1);
+        if (s->admin) reply(s, true, "✅ Admin authenticated.");
+        else reply(s, false, "❌ Wrong admin password.");
+    } else if (s->loggedIn) {
+        serverCustomerCommand(s, cmd, a1, a2, a3, rest);
+    } else if (s->admin) {
+        serverAdminCommand(s, cmd, a1, a2, a3, rest);
+    } else {
+        reply(s, false, "Please LOGIN or ADMIN first.");
+    }
+    return true;
+}
+
+static void serveSession(int fd) {
+    int infd = dup(fd), outfd = dup(fd);
+    FILE *in = infd >= 0 ? fdopen(infd, "r") : NULL;
+    FILE *out = outfd >= 0 ? fdopen(outfd, "w") : NULL;
+    if (!in || !out) {
+        if (in) fclose(in); else if (infd >= 0) close(infd);
+        if (out) fclose(out); else if (outfd >= 0) close(outfd);
+        return;
+    }
+
+    Session s;
+    memset(&s, 0, sizeof(s));
+    s.out = out;
+    reply(&s, true, "🏦 ATM System (C + OpenSSL)");
+
+    char line[1024];
+    while (fflush(out) == 0 && fgets(line, sizeof(line), in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!serverCommand(&s, line)) {
+            fflush(out);
+            break;
+        }
+    }
+    if (s.loggedIn || s.admin) (void)cacheFlush();
+    fclose(in);
+    fclose(out);
+}
+
+static void* serverWorker(void *arg) {
+    int id = (int)(intptr_t)arg;
+    for (;;) {
+        pthread_mutex_lock(&g_server.mu);
+        while (g_server.count == 0 && !g_server.stopping) pthread_cond_wait(&g_server.ready, &g_server.mu);
+        if (g_server.stopping) {
+            pthread_mutex_unlock(&g_server.mu);
+            return NULL;
+        }
+        int fd = g_server.queue[g_server.head];
+        g_server.head = (g_server.head + 1) % SERVER_QUEUE;
+        g_server.count--;
+        g_server.active[id] = fd;
+        pthread_mutex_unlock(&g_server.mu);
+
+        serveSession(fd);
+
+        // the fd stays open until it is no longer listed, so shutdown never hits a reused fd
+        pthread_mutex_lock(&g_server.mu);
+        g_server.active[id] = -1;
+        pthread_mutex_unlock(&g_server.mu);
+        close(fd);
+    }
+}
+
+int runServer(const char *path, int workers) {
+    if (workers < 1) workers = 1;
+    if (workers > SERVER_WORKERS_MAX) workers = SERVER_WORKERS_MAX;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { printf("Socket path too long.\n"); return 1; }
+    strcpy(addr.sun_path, path);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) { perror("socket"); return 1; }
+    unlink(path);
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(lfd, SOMAXCONN) != 0) {
+        perror("bind/listen");
+        close(lfd);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serverSignal;   // no SA_RESTART: poll() must return
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t threads[SERVER_WORKERS_MAX];
+    for (int i = 0; i < workers; ++i) {
+        g_server.active[i] = -1;
+        if (pthread_create(&threads[i], NULL, serverWorker, (void*)(intptr_t)i) != 0) {
+            workers = i;
+            break;
+        }
+    }
+    printf("🏦 ATM server listening on %s with %d worker(s)\n", path, workers);
+    fflush(stdout);
+
+    while (!g_serverStop) {
+        struct pollfd p = { lfd, POLLIN, 0 };
+        if (poll(&p, 1, 500) <= 0) continue;
+        int cfd = accept(lfd, NULL, NULL);
+        if (cfd < 0) continue;
+
+        pthread_mutex_lock(&g_server.mu);
+        if (g_server.count == SERVER_QUEUE) {
+            pthread_mutex_unlock(&g_server.mu);
+            static const char busy[] = "ERR Server busy, try again later.\n";
+            (void)!write(cfd, busy, sizeof(busy) - 1);
+            close(cfd);
+            continue;
+        }
+        g_server.queue[(g_server.head + g_server.count) % SERVER_QUEUE] = cfd;
+        g_server.count++;
+        pthread_cond_signal(&g_server.ready);
+        pthread_mutex_unlock(&g_server.mu);
+    }
+
+    // wake every worker: sessions in progress see EOF, queued ones are dropped
+    pthread_mutex_lock(&g_server.mu);
+    g_server.stopping = true;
+    for (int i = 0; i < workers; ++i) {
+        if (g_server.active[i] >= 0) shutdown(g_server.active[i], SHUT_RDWR);
+    }
+    for (; g_server.count > 0; g_server.count--) {
+        close(g_server.queue[g_server.head]);
+        g_server.head = (g_server.head + 1) % SERVER_QUEUE;
+    }
+    pthread_cond_broadcast(&g_server.ready);
+    pthread_mutex_unlock(&g_server.mu);
+
+    for (int i = 0; i < workers; ++i) pthread_join(threads[i], NULL);
+    close(lfd);
+    unlink(path);
+    printf("Server stopped.\n");
+    return 0;
+}
+
+/* ======================= Batch ======================= */
+/*
+ * `atm --batch [file]` runs the server command set (see Server above) from a
+ * file, or from stdin when the file is "-" or missing, with no terminal
+ * interaction. Blank lines and lines starting with '#' are skipped, and QUIT
+ * ends the run early. Every command's reply is printed prefixed with its line
+ * number, then a summary with the command count and throughput. The exit
+ * status is 1 if any command failed.
+ */
+int runBatch(const char *path) {
+    FILE *in = (!path || strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+    if (!in) {
+        printf("Cannot open batch file %s.\n", path);
+        return 1;
+    }
+
+    Session s;
+    memset(&s, 0, sizeof(s));
+    s.out = stdout;
+
+    char *line = NULL;
+    size_t cap = 0;
+    long lineNo = 0, ran = 0, failed = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    while (getline(&line, &cap, in) != -1) {
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *cmd = line + strspn(line, " \t");
+        if (!*cmd || *cmd == '#') continue;
+
+        printf("[%ld] ", lineNo);
+        bool more = serverCommand(&s, cmd);
+        ran++;
+        if (!s.ok) failed++;
+        if (!more) break;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("\n📊 Batch: %ld command(s), %ld ok, %ld failed in %.3f s (%.0f ops/sec)\n",
+           ran, ran - failed, failed, secs, secs > 0 ? (double)ran / secs : 0.0);
+
+    free(line);
+    if (in != stdin) fclose(in);
+    return failed ? 1 : 0;
+}
+
+/* ======================= End of Day ======================= */
+/*
+ * `atm --eod <rules> [threads]` posts interest and fees to every account in
+ * one streaming pass over the mapped store. The rules file holds lines like:
+ *
+ *   interest <min balance> <percent>    tier: balances from min earn percent
+ *   fee <amount> <waived from balance>  charged below the waiver balance
+ *
+ * The highest tier a balance reaches applies; '#' starts a comment. Interest
+ * is computed on the balance before posting and the fee is then taken from
+ * what is left, never below zero.
+ *
+ * The record range is split into one contiguous slice per thread. Each thread
+ * commits its new images to the journal EOD_CHUNK at a time and logs one
+ * entry per posting. The job needs the files to itself, so other atm
+ * processes make it refuse to start.
+ *
+ * A run flips the header's eodMark and sets the same bit in every record it
+ * writes. A run that was cut short is resumed by the next start, which
+ * skips the records that already carry the mark, so nothing is posted twice.
+ * appendAccounts() stamps new records with the header's current mark, as if
+ * the latest run had posted them: the next run flips the mark and takes them,
+ * and a resumed run leaves accounts opened after its day started for the next.
+ */
+#define EOD_CHUNK       16384   // images per journal commit
+#define EOD_MAX_TIERS   16
+#define EOD_MAX_THREADS 64
+
+typedef struct {
+    int      tiers;
+    int64_t  tierMin[EOD_MAX_TIERS];    // sorted, highest minimum first
+    int64_t  tierPpm[EOD_MAX_TIERS];    // interest in millionths of the balance
+    bool     hasFee;
+    int64_t  feeCents, waiveCents;
+} EodRules;
+
+typedef struct {
+    long     accounts;                  // records written
+    long     credited, charged, waived;
+    int64_t  interestCents, feeCents;
+} EodTotals;
+
+typedef struct {
+    const EodRules *rules;
+    size_t    from, to;                 // record range
+    unsigned  mark;
+    char      note[24];
+    EodTotals sum;
+    bool      ok;
+} EodJob;
+
+/* Reads a rules file; problems are reported with their line number. */
+static bool eodParseRules(const char *path, EodRules *r, FILE *report, const char *prefix) {
+    FILE *in = fopen(path, "r");
+    if (!in) return false;
+    memset(r, 0, sizeof(*r));
+
+    char line[256];
+    long lineNo = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), in)) {
+        lineNo++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        char word[16];
+        double x, y;
+        int n = sscanf(line, "%15s %lf %lf", word, &x, &y);
+        if (n <= 0) continue;
+
+        if (n == 3 && strcmp(word, "interest") == 0 && x >= 0 && x <= MAX_AMOUNT && y >= 0 && y <= 100) {
+            if (r->tiers == EOD_MAX_TIERS) {
+                fprintf(report, "%srules line %ld: more than %d interest tiers\n", prefix, lineNo, EOD_MAX_TIERS);
+                ok = false;
+                break;
+            }
+            int i = r->tiers++;
+            int64_t min = toCents(x);
+            for (; i > 0 && r->tierMin[i - 1] < min; --i) {
+                r->tierMin[i] = r->tierMin[i - 1];
+                r->tierPpm[i] = r->tierPpm[i - 1];
+            }
+            r->tierMin[i] = min;
+            r->tierPpm[i] = (int64_t)(y * 10000.0 + 0.5);
+        } else if (n == 3 && strcmp(word, "fee") == 0 && !r->hasFee &&
+                   x > 0 && x <= MAX_AMOUNT && y >= 0 && y <= MAX_AMOUNT) {
+            r->hasFee = true;
+            r->feeCents = toCents(x);
+            r->waiveCents = toCents(y);
+        } else {
+            fprintf(report, "%srules line %ld: expected \"interest <min> <percent>\" or one \"fee <amount> <waive at>\"\n",
+                    prefix, lineNo);
+            ok = false;
+        }
+    }
+    fclose(in);
+    if (ok && r->tiers == 0 && !r->hasFee) {
+        fprintf(report, "%s%s has no rules\n", prefix, path);
+        ok = false;
+    }
+    return ok;
+}
+
+/* Applies the rules to a; returns the interest and fee it posted. */
+static void eodPost(const EodRules *r, Account *a, int64_t *interest, int64_t *fee) {
+    int64_t bal = a->balanceCents;
+    *interest = *fee = 0;
+    for (int i = 0; i < r->tiers && bal > 0; ++i) {
+        if (bal < r->tierMin[i]) continue;
+        *interest = (int64_t)(((__int128)bal * r->tierPpm[i] + 500000) / 1000000);
+        break;
+    }
+    if (r->hasFee && bal < r->waiveCents) {
+        int64_t left = bal + *interest;
+        *fee = r->feeCents < left ? r->feeCents : left;
+    }
+    a->balanceCents = bal + *interest - *fee;
+}
+
+static void* eodWorker(void *arg) {
+    EodJob *job = (EodJob*)arg;
+    Account *img = (Account*)malloc(EOD_CHUNK * sizeof(Account));
+    const Account **ref = (const Account**)malloc(EOD_CHUNK * sizeof(Account*));
+    int64_t (*posted)[2] = malloc(EOD_CHUNK * sizeof(*posted));
+    job->ok = img && ref && posted;
+
+    for (size_t i = job->from; job->ok && i < job->to;) {
+        int n = 0;
+        for (; i < job->to && n < EOD_CHUNK; ++i) {
+            const Account *a = storeAt(i);
+            if (a->eodMark == job->mark) continue;   // posted before the last run stopped
+            img[n] = *a;
+            eodPost(job->rules, &img[n], &posted[n][0], &posted[n][1]);
+            img[n].eodMark = job->mark;
+            img[n].version++;
+            ref[n] = &img[n];
+            n++;
+        }
+        if (n == 0) continue;
+        job->ok = walCommit(ref, n);
+        if (!job->ok) break;
+
+        job->sum.accounts += n;
+        for (int k = 0; k < n; ++k) {
+            int64_t interest = posted[k][0], fee = posted[k][1];
+            if (interest > 0) {
+                Account mid = img[k];
+                mid.balanceCents += fee;   // balance right after the interest
+                logTransaction(&mid, TX_INTEREST, interest, job->note);
+                job->sum.credited++;
+                job->sum.interestCents += interest;
+            }
+            if (fee > 0) {
+                logTransaction(&img[k], TX_FEE, fee, job->note);
+                job->sum.charged++;
+                job->sum.feeCents += fee;
+            } else if (job->rules->hasFee && img[k].balanceCents - interest >= job->rules->waiveCents) {
+                job->sum.waived++;
+            }
+        }
+    }
+    free(img);
+    free(ref);
+    free(posted);
+    return NULL;
+}
+
+AtmStatus opEndOfDay(const char *rulesPath, int threads, FILE *report, const char *prefix, EodTotals *out) {
+    memset(out, 0, sizeof(*out));
+    EodRules rules;
+    if (access(rulesPath, R_OK) != 0) return ATM_ERR_NO_FILE;
+    if (!eodParseRules(rulesPath, &rules, report, prefix)) return ATM_ERR_INPUT;
+
+    // no other process may touch the accounts while the pass runs
+    bool owned = cacheEnabled();
+    if (!owned && !rangeTryLock(g_store.fd, F_WRLCK, LOCK_BYTE_OWNER, 1)) return ATM_ERR_BUSY;
+    AtmStatus st = cacheFlush() ? ATM_OK : ATM_ERR_IO;
+
+    time_t now = time(NULL);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    int32_t today = (tm_info.tm_year + 1900) * 10000 + (tm_info.tm_mon + 1) * 100 + tm_info.tm_mday;
+
+    StoreHeader *h = storeHeader();
+    if (st != ATM_OK) {
+        // nothing started; the lock is given back below
+    } else if (h->eodRunning) {
+        fprintf(report, "%sResuming the unfinished end-of-day run of %d.\n", prefix, (int)h->eodDay);
+    } else if (h->eodDay == today) {
+        st = ATM_ERR_POSTED;
+    } else {
+        h->eodDay = today;
+        h->eodMark ^= 1;
+        h->eodRunning = 1;
+        if (ioMsync(g_store.header, sizeof(StoreHeader), MS_SYNC) != 0) st = ATM_ERR_IO;
+    }
+
+    pthread_rwlock_rdlock(&g_layoutLock);   // the pass walks one shard layout
+    if (st == ATM_OK) {
+        size_t n = storeCount();
+        if (threads < 1) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        if ((size_t)threads > n / EOD_CHUNK + 1) threads = (int)(n / EOD_CHUNK + 1);
+        if (threads > EOD_MAX_THREADS) threads = EOD_MAX_THREADS;
+        if (threads < 1) threads = 1;
+
+        EodJob jobs[EOD_MAX_THREADS];
+        pthread_t tids[EOD_MAX_THREADS];
+        bool started[EOD_MAX_THREADS];
+        for (int t = 0; t < threads; ++t) {
+            jobs[t] = (EodJob){ .rules = &rules, .from = n * (size_t)t / (size_t)threads,
+                                .to = n * (size_t)(t + 1) / (size_t)threads, .mark = h->eodMark };
+            snprintf(jobs[t].note, sizeof(jobs[t].note), "EOD %d", (int)h->eodDay);
+            // a thread that cannot start does its share on this one
+            started[t] = t > 0 && pthread_create(&tids[t], NULL, eodWorker, &jobs[t]) == 0;
+        }
+        for (int t = 0; t < threads; ++t) {
+            if (!started[t]) eodWorker(&jobs[t]);
+        }
+        for (int t = 0; t < threads; ++t) {
+            if (started[t]) pthread_join(tids[t], NULL);
+            if (!jobs[t].ok) st = ATM_ERR_IO;
+            out->accounts += jobs[t].sum.accounts;
+            out->credited += jobs[t].sum.credited;
+            out->charged += jobs[t].sum.charged;
+            out->waived += jobs[t].sum.waived;
+            out->interestCents += jobs[t].sum.interestCents;
+            out->feeCents += jobs[t].sum.feeCents;
+        }
+    }
+    pthread_rwlock_unlock(&g_layoutLock);
+
+    // every image is in the journal by now, so the run can be marked done
+    if (st == ATM_OK && h->eodRunning) {
+        h->eodRunning = 0;
+        if (ioMsync(g_store.header, sizeof(StoreHeader), MS_SYNC) != 0) st = ATM_ERR_IO;
+    }
+    if (!owned) (void)rangeLock(g_store.fd, F_RDLCK, LOCK_BYTE_OWNER, 1);
+    return st;
+}
+
+int runEndOfDay(const char *rulesPath, int threads) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    EodTotals sum;
+    AtmStatus st = opEndOfDay(rulesPath, threads, stdout, "", &sum);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (st != ATM_OK) {
+        printf("%s\n", atmStatusText(st));
+        return 1;
+    }
+
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    char interest[24], fees[24];
+    printf("✅ End of day: %ld account(s) posted, interest %s to %ld, fees %s from %ld, %ld waived.\n",
+           sum.accounts, fmtCents(sum.interestCents, interest), sum.credited,
+           fmtCents(sum.feeCents, fees), sum.charged, sum.waived);
+    printf("📊 %.3f s (%.0f accounts/sec)\n", secs, secs > 0 ? (double)sum.accounts / secs : 0.0);
+    return 0;
+}
+
+/* ======================= Reconciliation ======================= */
+/*
+ * `atm --reconcile [threads]` checks the transaction log against the stored
+ * balances and prints every discrepancy. Every record states the balance
+ * after it, and its amount and type give the balance before. That must match
+ * the balance of the account's previous record, found through the back link.
+ * The newest record of each account (from txlog.heads) must match the
+ * balance in accounts.dat. A failure between a commit and its log entry
+ * shows up as one of these two kinds of drift.
+ *
+ * The log segments are mapped read-only and the record positions split into
+ * one contiguous range per thread; a record's checks need only the record and
+ * its predecessor, so threads share nothing. The stored-balance check is
+ * split the same way over the heads table. Each mismatch found there is
+ * looked at again under the account's lock, after the writer thread has
+ * drained, so an operation still in flight is not reported.
+ */
+#define RECON_MAX_THREADS 64
+
+typedef enum { RECON_GAP, RECON_LINK, RECON_TYPE, RECON_BALANCE, RECON_NO_ACCOUNT } ReconKind;
+
+typedef struct {
+    int32_t   accountNumber;
+    ReconKind kind;
+    int64_t   pos;        // log position of the record concerned
+    int64_t   expected;   // what the log implies
+    int64_t   actual;     // what was found instead
+} ReconIssue;
+
+typedef struct {
+    long records;         // log records checked
+    long accounts;        // accounts with a history
+    long quiet;           // accounts without one
+    long issues;
+} ReconTotals;
+
+typedef struct {
+    const TxRecord **seg;   // seg[seq - 1]: first record of segment seq, or NULL
+    size_t          *len;   // mapped bytes per segment
+    uint32_t         segs;
+    int64_t          endPos;
+} LogView;
+
+typedef struct {
+    const LogView   *view;
+    const HeadSlot  *heads;
+    int64_t          from, to;     // log positions, then heads slots
+    ReconIssue      *issues;
+    size_t           n, cap;
+    long             accounts;
+    bool             ok;
+} ReconJob;
+
+static const TxRecord* viewAt(const LogView *v, int64_t pos) {
+    if (pos < 0 || pos >= v->endPos) return NULL;
+    uint32_t seq = posSeq(pos);
+    if (seq > v->segs || !v->seg[seq - 1]) return NULL;   // segment retired
+    return v->seg[seq - 1] + pos % TXLOG_SEG_RECORDS;
+}
+
+static void viewClose(LogView *v) {
+    for (uint32_t i = 0; v->seg && i < v->segs; ++i) {
+        if (v->seg[i]) munmap((char*)v->seg[i] - sizeof(TxSegmentHeader), v->len[i]);
+    }
+    free(v->seg);
+    free(v->len);
+    memset(v, 0, sizeof(*v));
+}
+
+/* Maps every segment holding records below endPos. */
+static bool viewOpen(LogView *v, int64_t endPos) {
+    memset(v, 0, sizeof(*v));
+    v->endPos = endPos;
+    v->segs = endPos > 0 ? posSeq(endPos - 1) : 0;
+    v->seg = (const TxRecord**)calloc(v->segs + 1, sizeof(TxRecord*));
+    v->len = (size_t*)calloc(v->segs + 1, sizeof(size_t));
+    if (!v->seg || !v->len) { viewClose(v); return false; }
+
+    for (uint32_t seq = 1; seq <= v->segs; ++seq) {
+        char path[64];
+        txSegmentPath(seq, path, sizeof(path));
+        int fd = ioOpen(path, O_RDONLY);
+        if (fd < 0) continue;
+        struct stat st;
+        int64_t want = seq < v->segs ? TXLOG_SEG_RECORDS : endPos - (int64_t)(seq - 1) * TXLOG_SEG_RECORDS;
+        size_t bytes = sizeof(TxSegmentHeader) + (size_t)want * sizeof(TxRecord);
+        void *p = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size >= bytes) {
+            p = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (p == MAP_FAILED) { viewClose(v); return false; }
+        (void)madvise(p, bytes, MADV_SEQUENTIAL);
+        v->seg[seq - 1] = (const TxRecord*)((char*)p + sizeof(TxSegmentHeader));
+        v->len[seq - 1] = bytes;
+    }
+    return true;
+}
+
+static void reconAdd(ReconJob *job, int32_t acc, ReconKind kind, int64_t pos, int64_t expected, int64_t actual) {
+    if (!growBuffer((char**)&job->issues, &job->cap, (job->n + 1) * sizeof(ReconIssue))) {
+        job->ok = false;
+        return;
+    }
+    job->issues[job->n++] = (ReconIssue){ acc, kind, pos, expected, actual };
+}
+
+/* Signed effect of a record on its account's balance; false for an unknown type. */
+static bool txDelta(const TxRecord *r, int64_t *delta) {
+    switch (r->type) {
+        case TX_DEPOSIT: case TX_TRANSFER_IN: case TX_INTEREST:  *delta = r->amountCents;  return true;
+        case TX_WITHDRAW: case TX_TRANSFER_OUT: case TX_FEE:     *delta = -r->amountCents; return true;
+        case TX_PIN_CHANGE:                                      *delta = 0;               return true;
+    }
+    return false;
+}
+
+static void* reconChainWorker(void *arg) {
+    ReconJob *job = (ReconJob*)arg;
+    job->ok = true;
+    for (int64_t pos = job->from; pos < job->to && job->ok; ++pos) {
+        const TxRecord *r = viewAt(job->view, pos);
+        if (!r) {   // retired segment: skip to the next one
+            pos = (int64_t)posSeq(pos) * TXLOG_SEG_RECORDS - 1;
+            continue;
+        }
+        int64_t delta;
+        if (!txDelta(r, &delta)) {
+            reconAdd(job, r->accountNumber, RECON_TYPE, pos, 0, r->type);
+            continue;
+        }
+        if (r->prev < 0) continue;   // the account's first entry: its opening balance is not logged
+        const TxRecord *p = viewAt(job->view, r->prev);
+        if (r->prev >= pos) {
+            reconAdd(job, r->accountNumber, RECON_LINK, pos, 0, r->prev);
+        } else if (!p) {
+            continue;
+        } else if (p->accountNumber != r->accountNumber) {
+            reconAdd(job, r->accountNumber, RECON_LINK, pos, 0, r->prev);
+        } else if (p->balanceCents != r->balanceCents - delta) {
+            reconAdd(job, r->accountNumber, RECON_GAP, pos, p->balanceCents, r->balanceCents - delta);
+        }
+    }
+    return NULL;
+}
+
+static void* reconBalanceWorker(void *arg) {
+    ReconJob *job = (ReconJob*)arg;
+    job->ok = true;
+    for (int64_t i = job->from; i < job->to && job->ok; ++i) {
+        const HeadSlot *s = &job->heads[i];
+        if (!s->used) continue;
+        job->accounts++;
+        const TxRecord *r = viewAt(job->view, s->offset);
+        const Account *a = accountRef(s->accountNumber);
+        if (!a) reconAdd(job, s->accountNumber, RECON_NO_ACCOUNT, s->offset, 0, 0);
+        else if (r && a->balanceCents != r->balanceCents) {
+            reconAdd(job, s->accountNumber, RECON_BALANCE, s->offset, r->balanceCents, a->balanceCents);
+        }
+    }
+    return NULL;
+}
+
+/* Runs fn over [0, n) split across threads; returns false if a job failed. */
+static bool reconRun(void *(*fn)(void*), ReconJob *jobs, int threads, int64_t n) {
+    pthread_t tids[RECON_MAX_THREADS];
+    bool started[RECON_MAX_THREADS];
+    for (int t = 0; t < threads; ++t) {
+        jobs[t].from = n * t / threads;
+        jobs[t].to = n * (t + 1) / threads;
+        started[t] = t > 0 && pthread_create(&tids[t], NULL, fn, &jobs[t]) == 0;
+    }
+    for (int t = 0; t < threads; ++t) {
+        if (!started[t]) fn(&jobs[t]);
+    }
+    bool ok = true;
+    for (int t = 0; t < threads; ++t) {
+        if (started[t]) pthread_join(tids[t], NULL);
+        ok = ok && jobs[t].ok;
+    }
+    return ok;
+}
+
+/* A stored balance that disagrees may belong to an operation between its
+   commit and its log entry; look again once it has finished. */
+static bool reconStillDiffers(ReconIssue *is) {
+    bool differs = false;
+    lockAccount(is->accountNumber);
+    txlogDrain();
+    TxRecord last;
+    Account a;
+    if (txlogLastN(is->accountNumber, 1, &last) == 1 && loadAccount(is->accountNumber, &a) &&
+        a.balanceCents != last.balanceCents) {
+        differs = true;
+        is->expected = last.balanceCents;
+        is->actual = a.balanceCents;
+    }
+    unlockAccount(is->accountNumber);
+    return differs;
+}
+
+static int cmpIssue(const void *x, const void *y) {
+    const ReconIssue *a = (const ReconIssue*)x, *b = (const ReconIssue*)y;
+    if (a->accountNumber != b->accountNumber) return a->accountNumber < b->accountNumber ? -1 : 1;
+    return (a->pos > b->pos) - (a->pos < b->pos);
+}
+
+static void reconPrint(FILE *out, const char *prefix, const ReconIssue *is) {
+    char e[24], a[24], d[24];
+    switch (is->kind) {
+        case RECON_GAP:
+            fprintf(out, "%sA/C %-6d entry %lld: previous entry left %s, this one starts from %s (drift %s)\n",
+                    prefix, is->accountNumber, (long long)is->pos, fmtCents(is->expected, e),
+                    fmtCents(is->actual, a), fmtCents(is->actual - is->expected, d));
+            break;
+        case RECON_LINK:
+            fprintf(out, "%sA/C %-6d entry %lld: back link to %lld is not an earlier entry of this account\n",
+                    prefix, is->accountNumber, (long long)is->pos, (long long)is->actual);
+            break;
+        case RECON_TYPE:
+            fprintf(out, "%sA/C %-6d entry %lld: unknown transaction type %lld\n",
+                    prefix, is->accountNumber, (long long)is->pos, (long long)is->actual);
+            break;
+        case RECON_BALANCE:
+            fprintf(out, "%sA/C %-6d stored balance %s, log ends at %s (drift %s)\n",
+                    prefix, is->accountNumber, fmtCents(is->actual, a), fmtCents(is->expected, e),
+                    fmtCents(is->actual - is->expected, d));
+            break;
+        case RECON_NO_ACCOUNT:
+            fprintf(out, "%sA/C %-6d has log entries but no account\n", prefix, is->accountNumber);
+            break;
+    }
+}
+
+AtmStatus opReconcile(int threads, FILE *report, const char *prefix, ReconTotals *out) {
+    memset(out, 0, sizeof(*out));
+    if (!cacheFlush()) return ATM_ERR_IO;
+    txlogDrain();
+
+    // a snapshot of the log's end and of the heads table
+    int64_t endPos = 0;
+    uint64_t headsCap = 0;
+    HeadSlot *heads = NULL;
+    pthread_mutex_lock(&g_txlog.mu);
+    if (txlogAcquire()) {
+        endPos = g_txlog.endPos;
+        headsCap = g_txlog.heads->capacity;
+        heads = (HeadSlot*)malloc((size_t)headsCap * sizeof(HeadSlot));
+        if (heads) memcpy(heads, headsSlots(), (size_t)headsCap * sizeof(HeadSlot));
+        txlogRelease();
+    }
+    pthread_mutex_unlock(&g_txlog.mu);
+    if (!heads && endPos > 0) return ATM_ERR_IO;
+
+    LogView view;
+    if (!viewOpen(&view, endPos)) { free(heads); return ATM_ERR_NO_FILE; }
+
+    if (threads < 1) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > RECON_MAX_THREADS) threads = RECON_MAX_THREADS;
+    if (threads < 1) threads = 1;
+    ReconJob jobs[RECON_MAX_THREADS];
+    memset(jobs, 0, sizeof(jobs));
+    for (int t = 0; t < threads; ++t) {
+        jobs[t].view = &view;
+        jobs[t].heads = heads;
+    }
+
+    bool ok = reconRun(reconChainWorker, jobs, threads, endPos) &&
+              reconRun(reconBalanceWorker, jobs, threads, (int64_t)headsCap);
+
+    // gather, drop what was only in flight, and print in account order
+    ReconIssue *all = NULL;
+    size_t n = 0, cap = 0;
+    for (int t = 0; t < threads; ++t) {
+        out->accounts += jobs[t].accounts;
+        for (size_t i = 0; ok && i < jobs[t].n; ++i) {
+            ReconIssue is = jobs[t].issues[i];
+            if (is.kind == RECON_BALANCE && !reconStillDiffers(&is)) continue;
+            ok = growBuffer((char**)&all, &cap, (n + 1) * sizeof(ReconIssue));
+            if (ok) all[n++] = is;
+        }
+        free(jobs[t].issues);
+    }
+    if (ok) {
+        qsort(all, n, sizeof(ReconIssue), cmpIssue);
+        for (size_t i = 0; i < n; ++i) reconPrint(report, prefix, &all[i]);
+    }
+    out->records = (long)endPos;
+    out->issues = (long)n;
+    long stored = (long)storeCount();
+    out->quiet = stored > out->accounts ? stored - out->accounts : 0;
+
+    free(all);
+    free(heads);
+    viewClose(&view);
+    return ok ? ATM_OK : ATM_ERR_IO;
+}
+
+int runReconcile(int threads) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ReconTotals sum;
+    AtmStatus st = opReconcile(threads, stdout, "", &sum);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (st != ATM_OK) {
+        printf("%s\n", atmStatusText(st));
+        return 1;
+    }
+
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%s Reconciled %ld log entries over %ld account(s) (%ld without history): %ld discrepancy(ies).\n",
+           sum.issues ? "⚠️" : "✅", sum.records, sum.accounts, sum.quiet, sum.issues);
+    printf("📊 %.3f s (%.0f entries/sec)\n", secs, secs > 0 ? (double)sum.records / secs : 0.0);
+    return sum.issues ? 1 : 0;
+}
+
+/* ======================= Reports ======================= */
+/*
+ * Admin reports (REPORT, the admin menu's Reports) work on a columnar
+ * snapshot of the store: account numbers, balances, lock flags and failed
+ * attempts, copied out of the mapped records into one array each. Each
+ * thread copies one contiguous range of records and then runs the kernels
+ * over its own range of the columns, REPORT_BLOCK rows at a time so that a
+ * block stays in cache while each kernel passes over it. The kernels are
+ * vector loops over one column. They compute the total held, the lowest and
+ * highest balance, a histogram (counts of balances at or above each bucket's
+ * floor), and the number of locked accounts and of those one wrong PIN short
+ * of the lock.
+ *
+ * A listing (every account, the locked ones, or those with failed attempts)
+ * is sorted by balance, attempts or number and cut into pages. Each thread
+ * keeps only the rows up to the end of the requested page in a bounded
+ * heap, so the first pages of a large store cost about as much as the
+ * totals. The snapshot is copied record by record without account locks,
+ * like LIST, and a page shows each account's current record.
+ */
+#define REPORT_MAX_THREADS 64
+#define REPORT_BLOCK       4096   // rows per kernel call: 32 KiB of balances
+#define REPORT_PAGE        20
+#define REPORT_ATTEMPTS    2      // failed attempts that leave one try before the lock
+#define REPORT_BUCKETS     9
+
+/* Floors of the histogram buckets above "below zero", in cents. */
+static const int64_t reportFloors[REPORT_BUCKETS - 1] = {
+    0, 1, 1000, 10000, 100000, 1000000, 10000000, 100000000
+};
+
+static const char *const reportFilterNames[] = { "All accounts", "Locked accounts", "Accounts with failed PIN attempts" };
+static const char *const reportSortNames[] = { "highest balance first", "lowest balance first",
+                                               "most failed attempts first", "by number" };
+
+static const char *const reportBucketNames[REPORT_BUCKETS] = {
+    "below 0", "0", "0.01 - 9.99", "10 - 99.99", "100 - 999.99",
+    "1,000 - 9,999.99", "10,000 - 99,999.99", "100,000 - 999,999.99", "1,000,000 and up"
+};
+
+typedef struct {
+    int32_t *number;
+    int64_t *balance;
+    uint8_t *locked;
+    uint8_t *attempts;
+} AccountColumns;
+
+typedef struct {
+    int64_t key;      // ascending; the sort's column, negated for descending orders
+    int32_t number;   // ties
+} ReportRow;
+
+typedef struct {
+    const StoreLayout *layout;
+    const size_t      *starts;     // first row of each shard
+    AccountColumns    *cols;
+    size_t             from, to;   // rows
+    ReportFilter       filter;
+    ReportSort         sort;
+    size_t             keep;       // listing rows to keep, 0 for none
+    ReportRow         *rows;       // bounded max-heap of the first rows in order
+    size_t             nrows;
+    long               matches, locked, attempted;
+    int64_t            total, min, max;
+    long               atLeast[REPORT_BUCKETS - 1];   // balances >= each floor
+    bool               ok;
+} ReportJob;
+
+typedef struct {
+    long    accounts, locked, attempted, matches;
+    int64_t total, min, max;
+    long    hist[REPORT_BUCKETS];
+    int     n;
+    Account page[REPORT_PAGE];
+    double  ms;                   // snapshot and kernels
+} ReportTotals;
+
+/* Kernels over n rows of one column (REPORT_BLOCK but at the end), four
+   balances or 32 flags per step using GCC vector types, with a scalar loop
+   for the rest. On x86-64 each also gets an AVX2 build, picked at load time. */
+typedef int64_t I64x4 __attribute__((vector_size(32)));
+typedef uint8_t U8x32 __attribute__((vector_size(32)));
+
+#if defined(__x86_64__) && defined(__has_attribute)
+  #if __has_attribute(target_clones)
+    #define REPORT_KERNEL __attribute__((target_clones("avx2", "default")))
+  #endif
+#endif
+#ifndef REPORT_KERNEL
+  #define REPORT_KERNEL
+#endif
+
+REPORT_KERNEL
+static int64_t kernelSum(const int64_t *v, size_t n) {
+    I64x4 acc = { 0, 0, 0, 0 };
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        I64x4 x;
+        memcpy(&x, v + i, sizeof(x));
+        acc += x;
+    }
+    int64_t s = acc[0] + acc[1] + acc[2] + acc[3];
+    for (; i < n; ++i) s += v[i];
+    return s;
+}
+
+/* Lowest (max false) or highest (max true) of v and m. */
+REPORT_KERNEL
+static int64_t kernelExtreme(const int64_t *v, size_t n, int64_t m, bool max) {
+    I64x4 acc = { m, m, m, m };
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        I64x4 x;
+        memcpy(&x, v + i, sizeof(x));
+        I64x4 take = max ? x > acc : x < acc;   // all ones where x wins
+        acc = (x & take) | (acc & ~take);
+    }
+    for (int k = 0; k < 4; ++k) m = (max ? acc[k] > m : acc[k] < m) ? acc[k] : m;
+    for (; i < n; ++i) m = (max ? v[i] > m : v[i] < m) ? v[i] : m;
+    return m;
+}
+
+REPORT_KERNEL
+static long kernelCountAtLeast(const int64_t *v, size_t n, int64_t floor) {
+    I64x4 acc = { 0, 0, 0, 0 }, f = { floor, floor, floor, floor };
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        I64x4 x;
+        memcpy(&x, v + i, sizeof(x));
+        acc -= x >= f;   // a true comparison is -1
+    }
+    long c = (long)(acc[0] + acc[1] + acc[2] + acc[3]);
+    for (; i < n; ++i) c += v[i] >= floor;
+    return c;
+}
+
+REPORT_KERNEL
+static long kernelCountAtLeast8(const uint8_t *v, size_t n, uint8_t floor) {
+    long c = 0;
+    size_t i = 0;
+    U8x32 f;
+    memset(&f, floor, sizeof(f));
+    while (i + 32 <= n) {
+        U8x32 acc;   // per-lane counts; flushed before they can wrap
+        memset(&acc, 0, sizeof(acc));
+        for (size_t end = i + 32 * 255 < n ? i + 32 * 255 : n; i + 32 <= end; i += 32) {
+            U8x32 x;
+            memcpy(&x, v + i, sizeof(x));
+            acc -= (U8x32)(x >= f);
+        }
+        for (int k = 0; k < 32; ++k) c += acc[k];
+    }
+    for (; i < n; ++i) c += v[i] >= floor;
+    return c;
+}
+
+/* Runs the summary kernels over rows [from, to). */
+static void reportSummarize(ReportJob *job) {
+    const AccountColumns *c = job->cols;
+    job->min = INT64_MAX;
+    job->max = INT64_MIN;
+    for (size_t at = job->from; at < job->to; at += REPORT_BLOCK) {
+        size_t n = job->to - at < REPORT_BLOCK ? job->to - at : REPORT_BLOCK;
+        const int64_t *bal = c->balance + at;
+        job->total += kernelSum(bal, n);
+        job->min = kernelExtreme(bal, n, job->min, false);
+        job->max = kernelExtreme(bal, n, job->max, true);
+        for (int b = 0; b < REPORT_BUCKETS - 1; ++b) job->atLeast[b] += kernelCountAtLeast(bal, n, reportFloors[b]);
+        job->locked += kernelCountAtLeast8(c->locked + at, n, 1);
+        job->attempted += kernelCountAtLeast8(c->attempts + at, n, REPORT_ATTEMPTS);
+    }
+}
+
+static int cmpReportRow(const ReportRow *a, const ReportRow *b) {
+    if (a->key != b->key) return a->key < b->key ? -1 : 1;
+    return (a->number > b->number) - (a->number < b->number);
+}
+
+static int cmpReportRowQsort(const void *a, const void *b) {
+    return cmpReportRow((const ReportRow*)a, (const ReportRow*)b);
+}
+
+/* Offers a row to the job's heap, which holds the first `keep` rows seen so
+   far in order, the last of them on top. */
+static void reportKeep(ReportJob *job, ReportRow r) {
+    ReportRow *h = job->rows;
+    size_t i;
+    if (job->nrows < job->keep) {
+        i = job->nrows++;
+        while (i > 0 && cmpReportRow(&h[(i - 1) / 2], &r) < 0) {
+            h[i] = h[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        h[i] = r;
+        return;
+    }
+    if (cmpReportRow(&r, &h[0]) >= 0) return;
+    i = 0;
+    for (;;) {   // replace the top and sift down
+        size_t child = 2 * i + 1;
+        if (child >= job->nrows) break;
+        if (child + 1 < job->nrows && cmpReportRow(&h[child + 1], &h[child]) > 0) child++;
+        if (cmpReportRow(&h[child], &r) <= 0) break;
+        h[i] = h[child];
+        i = child;
+    }
+    h[i] = r;
+}
+
+static void reportList(ReportJob *job) {
+    const AccountColumns *c = job->cols;
+    for (size_t i = job->from; i < job->to; ++i) {
+        if (job->filter == REPORT_LOCKED && !c->locked[i]) continue;
+        if (job->filter == REPORT_ATTEMPTS && c->attempts[i] < REPORT_ATTEMPTS) continue;
+        job->matches++;
+        if (job->keep == 0) continue;
+        ReportRow r = { 0, c->number[i] };
+        switch (job->sort) {
+            case REPORT_BY_BALANCE:     r.key = -c->balance[i];  break;
+            case REPORT_BY_BALANCE_ASC: r.key = c->balance[i];   break;
+            case REPORT_BY_ATTEMPTS:    r.key = -c->attempts[i]; break;
+            case REPORT_BY_NUMBER:      r.key = c->number[i];    break;
+        }
+        reportKeep(job, r);
+    }
+}
+
+static void* reportWorker(void *arg) {
+    ReportJob *job = (ReportJob*)arg;
+    AccountColumns *c = job->cols;
+
+    // copy this job's records into the columns
+    unsigned k = 0;
+    while (k + 1 < job->layout->shards && job->starts[k + 1] <= job->from) ++k;
+    for (size_t i = job->from; i < job->to; ++i) {
+        while (i >= job->starts[k + 1]) ++k;
+        Account a;
+        recordRead(&a, shardAt(job->layout->shard[k], i - job->starts[k]));
+        c->number[i] = a.accountNumber;
+        c->balance[i] = a.balanceCents;
+        c->locked[i] = (uint8_t)a.locked;
+        c->attempts[i] = (uint8_t)a.failedAttempts;
+    }
+
+    reportSummarize(job);
+    if (job->keep > 0) {
+        job->rows = (ReportRow*)malloc(job->keep * sizeof(ReportRow));
+        if (!job->rows) return NULL;
+    }
+    reportList(job);
+    job->ok = true;
+    return NULL;
+}
+
+/* The summary, and with page >= 1 that page of the listing, over a fresh
+   snapshot taken with `threads` threads (0: one per core). */
+AtmStatus opReport(ReportFilter filter, ReportSort sort, int page, int threads, ReportTotals *out) {
+    memset(out, 0, sizeof(*out));
+    if (page < 0) return ATM_ERR_INPUT;
+    if (!storeOpen()) return ATM_ERR_NO_FILE;
+    if (!cacheFlush()) return ATM_ERR_IO;   // the snapshot reads the store
+    uint64_t t0 = monoNs();
+
+    pthread_rwlock_rdlock(&g_layoutLock);   // one shard layout throughout
+    const StoreLayout *l = storeLayout();
+    size_t starts[STORE_MAX_SHARDS + 1];
+    starts[0] = 0;
+    for (unsigned k = 0; k < l->shards; ++k) starts[k + 1] = starts[k] + shardCount(l->shard[k]);
+    size_t n = starts[l->shards];
+
+    AccountColumns cols;
+    cols.number = (int32_t*)malloc((n ? n : 1) * sizeof(int32_t));
+    cols.balance = (int64_t*)malloc((n ? n : 1) * sizeof(int64_t));
+    cols.locked = (uint8_t*)malloc(n ? n : 1);
+    cols.attempts = (uint8_t*)malloc(n ? n : 1);
+    bool ok = cols.number && cols.balance && cols.locked && cols.attempts;
+
+    if (threads < 1) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > REPORT_MAX_THREADS) threads = REPORT_MAX_THREADS;
+    if ((size_t)threads > n / REPORT_BLOCK) threads = (int)(n / REPORT_BLOCK);   // not worth a thread
+    if (threads < 1) threads = 1;
+    size_t keep = (size_t)page * REPORT_PAGE;
+
+    ReportJob jobs[REPORT_MAX_THREADS];
+    pthread_t tids[REPORT_MAX_THREADS];
+    bool started[REPORT_MAX_THREADS];
+    memset(jobs, 0, sizeof(jobs));
+    for (int t = 0; ok && t < threads; ++t) {
+        ReportJob *job = &jobs[t];
+        job->layout = l;
+        job->starts = starts;
+        job->cols = &cols;
+        job->from = n * (size_t)t / (size_t)threads;
+        job->to = n * (size_t)(t + 1) / (size_t)threads;
+        job->filter = filter;
+        job->sort = sort;
+        job->keep = keep < job->to - job->from ? keep : job->to - job->from;
+        started[t] = t > 0 && pthread_create(&tids[t], NULL, reportWorker, job) == 0;
+    }
+    for (int t = 0; ok && t < threads; ++t) {
+        if (!started[t]) reportWorker(&jobs[t]);
+    }
+    for (int t = 0; ok && t < threads; ++t) {
+        if (started[t]) pthread_join(tids[t], NULL);
+    }
+    pthread_rwlock_unlock(&g_layoutLock);
+
+    // combine the jobs: totals add up, the kept rows are merged in order
+    ReportRow *rows = NULL;
+    size_t nrows = 0;
+    out->accounts = (long)n;
+    out->min = out->max = 0;
+    long atLeast[REPORT_BUCKETS - 1] = { 0 };
+    for (int t = 0; ok && t < threads; ++t) {
+        const ReportJob *job = &jobs[t];
+        ok = job->ok;
+        nrows += job->nrows;
+        out->matches += job->matches;
+        out->locked += job->locked;
+        out->attempted += job->attempted;
+        out->total += job->total;
+        if (t == 0 || job->min < out->min) out->min = job->min;
+        if (t == 0 || job->max > out->max) out->max = job->max;
+        for (int b = 0; b < REPORT_BUCKETS - 1; ++b) atLeast[b] += job->atLeast[b];
+    }
+    if (n == 0) out->min = out->max = 0;
+    out->hist[0] = (long)n - atLeast[0];
+    for (int b = 1; b < REPORT_BUCKETS; ++b) {
+        out->hist[b] = atLeast[b - 1] - (b < REPORT_BUCKETS - 1 ? atLeast[b] : 0);
+    }
+    if (ok && nrows > 0) {
+        rows = (ReportRow*)malloc(nrows * sizeof(ReportRow));
+        ok = rows != NULL;
+        size_t at = 0;
+        for (int t = 0; ok && t < threads; ++t) {
+            memcpy(rows + at, jobs[t].rows, jobs[t].nrows * sizeof(ReportRow));
+            at += jobs[t].nrows;
+        }
+        if (ok) qsort(rows, nrows, sizeof(ReportRow), cmpReportRowQsort);
+    }
+    for (int t = 0; t < threads; ++t) free(jobs[t].rows);
+    free(cols.number);
+    free(cols.balance);
+    free(cols.locked);
+    free(cols.attempts);
+    out->ms = (double)(monoNs() - t0) / 1e6;
+
+    // the page itself, as the records stand now
+    for (size_t i = keep - (keep ? REPORT_PAGE : 0); ok && i < keep && i < nrows; ++i) {
+        if (loadAccount(rows[i].number, &out->page[out->n])) out->n++;
+    }
+    free(rows);
+    return ok ? ATM_OK : ATM_ERR_IO;
+}
+
+/* The summary (page 0) or one page of a listing, for the menus and the
+   server; every line starts with prefix. *pages gets the listing's page
+   count. */
+AtmStatus writeReport(FILE *out, const char *prefix, ReportFilter filter, ReportSort sort,
+                      int page, int threads, long *pages) {
+    ReportTotals *r = (ReportTotals*)malloc(sizeof(ReportTotals));
+    if (!r) return ATM_ERR_IO;
+    AtmStatus st = opReport(filter, sort, page, threads, r);
+    *pages = (r->matches + REPORT_PAGE - 1) / REPORT_PAGE;
+    if (st != ATM_OK) { free(r); return st; }
+
+    char a[24], b[24];
+    if (page == 0) {
+        fprintf(out, "%s--- Accounts Report ---\n", prefix);
+        fprintf(out, "%sAccounts: %ld | Held: %s | Mean: %s\n", prefix, r->accounts, fmtCents(r->total, a),
+                fmtCents(r->accounts ? r->total / r->accounts : 0, b));
+        fprintf(out, "%sLowest: %s | Highest: %s\n", prefix, fmtCents(r->min, a), fmtCents(r->max, b));
+        fprintf(out, "%sLocked: %ld | %d+ failed PIN attempts: %ld\n", prefix, r->locked, REPORT_ATTEMPTS, r->attempted);
+        fprintf(out, "%s--- Balances ---\n", prefix);
+        long most = 1;
+        for (int i = 0; i < REPORT_BUCKETS; ++i) most = r->hist[i] > most ? r->hist[i] : most;
+        for (int i = 0; i < REPORT_BUCKETS; ++i) {
+            char bar[41];
+            int w = (int)((double)r->hist[i] * 40.0 / (double)most + 0.5);
+            memset(bar, '#', (size_t)w);
+            bar[w] = '\0';
+            fprintf(out, "%s%-22s %10ld  %s\n", prefix, reportBucketNames[i], r->hist[i], bar);
+        }
+    } else {
+        fprintf(out, "%s--- %s, %s ---\n", prefix, reportFilterNames[filter], reportSortNames[sort]);
+        for (int i = 0; i < r->n; ++i) writeAccountLine(out, prefix, &r->page[i]);
+        if (r->n == 0) fprintf(out, "%s(none)\n", prefix);
+        fprintf(out, "%s%ld match(es); page %d of %ld.\n", prefix, r->matches, page, *pages ? *pages : 1);
+    }
+    fprintf(out, "%s📊 %.1f ms over %ld account(s).\n", prefix, r->ms, r->accounts);
+    free(r);
+    return ATM_OK;
+}
+
+/* ======================= Bulk Transfers ======================= */
+/*
+ * `atm --transfers <file> [results]` applies a file of transfers, one CSV row
+ * "from,to,amount,reference" per line (an optional header line is skipped;
+ * references are at most BULK_REF_MAX characters). Rows are taken in file
+ * order, BULK_BATCH at a time. A batch is checked against an in-memory
+ * snapshot of the accounts it touches: both must exist and be unlocked and
+ * the sender must cover the amount, as it stands after the rows before it.
+ * Every touched account then goes to the journal once, in one record, and
+ * both legs are logged with the reference as their note. The results file
+ * (default <file>.results) gets one CSV line per row: applied, duplicate,
+ * rejected with the reason, or failed.
+ *
+ * transfers.refs keeps the references of applied rows, so running the same
+ * file again skips what was applied before. A batch's references and images
+ * are written there and synced before its journal commit, and the header's
+ * applied offset moves past them when the run ends. If the run dies in
+ * between, the next walOpen() puts those images back (bulkRecover()), so a
+ * reference on disk always means an applied transfer. Like end of day, the
+ * job needs the files to itself.
+ */
+#define BULK_MAGIC   0x314B4C42u   /* "BLK1" */
+#define BULK_BATCH   8192          // rows per journal commit
+#define BULK_REF_MAX 24            // fills a log note
+
+typedef struct {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t applied;      // the blocks below this offset are in the journal
+} BulkFileHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t refs;         // references that follow, then the account images
+    uint32_t images;
+    uint32_t checksum;     // FNV-1a over the counts, references and images
+} BulkBlock;
+
+typedef char BulkRef[BULK_REF_MAX];   // NUL-padded, not necessarily NUL-terminated
+
+typedef struct {
+    BulkRef *keys;         // open addressing, linear probing
+    uint8_t *used;
+    size_t   cap, count;   // cap: power of two, at least twice count
+} BulkRefSet;
+
+typedef struct {
+    long     rows, applied, duplicates, rejected, failed, batches;
+    int64_t  cents;        // total applied
+} BulkTotals;
+
+typedef struct {
+    long        line;
+    int32_t     from, to;
+    int64_t     cents;
+    int64_t     fromBal, toBal;   // balances right after this row
+    BulkRef     ref;
+    const char *why;              // NULL once applied
+} BulkRow;
+
+static const char BULK_DUPLICATE[] = "duplicate reference";
+
+const char* bulkRefsFile(void) {
+    return "transfers.refs";
+}
+
+static uint32_t bulkChecksum(const BulkBlock *b, const void *refs, const void *images) {
+    uint32_t h = 2166136261u;
+    h = fnv1a(h, &b->refs, sizeof(b->refs));
+    h = fnv1a(h, &b->images, sizeof(b->images));
+    h = fnv1a(h, refs, (size_t)b->refs * sizeof(BulkRef));
+    return fnv1a(h, images, (size_t)b->images * sizeof(Account));
+}
+
+/* Returns the slot holding ref, or the free slot where it would go. */
+static size_t bulkRefProbe(const BulkRefSet *s, const BulkRef ref) {
+    size_t mask = s->cap - 1;
+    size_t i = fnv1a(2166136261u, ref, sizeof(BulkRef)) & mask;
+    while (s->used[i] && memcmp(s->keys[i], ref, sizeof(BulkRef)) != 0) i = (i + 1) & mask;
+    return i;
+}
+
+static bool bulkRefSeen(const BulkRefSet *s, const BulkRef ref) {
+    return s->cap && s->used[bulkRefProbe(s, ref)];
+}
+
+static bool bulkRefAdd(BulkRefSet *s, const BulkRef ref) {
+    if ((s->count + 1) * 2 > s->cap) {
+        BulkRefSet t = { NULL, NULL, s->cap ? s->cap * 2 : IDX_MIN_CAP, s->count };
+        t.keys = (BulkRef*)malloc(t.cap * sizeof(BulkRef));
+        t.used = (uint8_t*)calloc(t.cap, 1);
+        if (!t.keys || !t.used) { free(t.keys); free(t.used); return false; }
+        for (size_t i = 0; i < s->cap; ++i) {
+            if (!s->used[i]) continue;
+            size_t j = bulkRefProbe(&t, s->keys[i]);
+            memcpy(t.keys[j], s->keys[i], sizeof(BulkRef));
+            t.used[j] = 1;
+        }
+        free(s->keys);
+        free(s->used);
+        *s = t;
+    }
+    size_t i = bulkRefProbe(s, ref);
+    if (!s->used[i]) {
+        memcpy(s->keys[i], ref, sizeof(BulkRef));
+        s->used[i] = 1;
+        s->count++;
+    }
+    return true;
+}
+
+/* Opens transfers.refs, writing the header of a new file. Returns the fd or -1. */
+static int bulkOpen(BulkFileHeader *h) {
+    int fd = ioOpen(bulkRefsFile(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+    ssize_t got = ioPread(fd, h, sizeof(*h), 0);
+    if (got == 0) {
+        memset(h, 0, sizeof(*h));
+        h->magic = BULK_MAGIC;
+        h->applied = sizeof(*h);
+        if (ioPwrite(fd, h, sizeof(*h), 0) == (ssize_t)sizeof(*h) && ioFdatasync(fd) == 0) return fd;
+    } else if (got == (ssize_t)sizeof(*h) && h->magic == BULK_MAGIC && h->applied >= sizeof(*h)) {
+        return fd;
+    }
+    close(fd);
+    return -1;
+}
+
+/* Reads the block at off with its references and images; false at the end
+   of the file or at a block that was not written completely. */
+static bool bulkReadBlock(int fd, off_t off, BulkBlock *b, BulkRef **refs, size_t *refsCap,
+                          Account **imgs, size_t *imgsCap) {
+    if (ioPread(fd, b, sizeof(*b), off) != (ssize_t)sizeof(*b) || b->magic != BULK_MAGIC ||
+        b->refs > BULK_BATCH || b->images > 2 * BULK_BATCH) {
+        return false;
+    }
+    size_t refBytes = (size_t)b->refs * sizeof(BulkRef), imgBytes = (size_t)b->images * sizeof(Account);
+    return growBuffer((char**)refs, refsCap, refBytes + 1) && growBuffer((char**)imgs, imgsCap, imgBytes + 1) &&
+           ioPread(fd, *refs, refBytes, off + (off_t)sizeof(*b)) == (ssize_t)refBytes &&
+           ioPread(fd, *imgs, imgBytes, off + (off_t)(sizeof(*b) + refBytes)) == (ssize_t)imgBytes &&
+           b->checksum == bulkChecksum(b, *refs, *imgs);
+}
+
+static off_t bulkBlockSize(const BulkBlock *b) {
+    return (off_t)(sizeof(*b) + (size_t)b->refs * sizeof(BulkRef) + (size_t)b->images * sizeof(Account));
+}
+
+static bool bulkSetApplied(int fd, BulkFileHeader *h, off_t end) {
+    h->applied = (uint64_t)end;
+    return ioPwrite(fd, h, sizeof(*h), 0) == (ssize_t)sizeof(*h) && ioFdatasync(fd) == 0;
+}
+
+/* Called by walOpen() in a process that has the files alone: puts the
+   images of batches from a run that stopped early back into the store.
+   Returns how many batches that was, or -1. */
+long bulkRecover(void) {
+    if (access(bulkRefsFile(), F_OK) != 0) return 0;
+    BulkFileHeader h;
+    int fd = bulkOpen(&h);
+    if (fd < 0) return -1;
 
-    char oldHash[65];
-    if (!sha256_hex(oldpin, oldHash)) { printf("Hash error.\n"); return; }
-    if (strcmp(oldHash, user->pinHash) != 0) { printf("❌ Incorrect current PIN.\n"); return; }
+    BulkBlock b;
+    BulkRef *refs = NULL;
+    Account *imgs = NULL;
+    size_t refsCap = 0, imgsCap = 0;
+    off_t off = (off_t)h.applied;
+    long redone = 0;
+    while (bulkReadBlock(fd, off, &b, &refs, &refsCap, &imgs, &imgsCap)) {
+        for (uint32_t i = 0; i < b.images; ++i) {
+            Account *a = accountRef(imgs[i].accountNumber);
+            if (a) *a = imgs[i];
+        }
+        off += bulkBlockSize(&b);
+        redone++;
+    }
+    free(refs);
+    free(imgs);
 
-    printf("Enter new PIN (hidden): ");
-    get_hidden_input(newpin1, sizeof(newpin1));
-    printf("Confirm new PIN (hidden): ");
-    get_hidden_input(newpin2, sizeof(newpin2));
+    // cut a block that was never finished, then nothing is pending any more
+    bool ok = (redone == 0 || storeSync()) && ftruncate(fd, off) == 0;
+    ok = ok && (off == (off_t)h.applied || bulkSetApplied(fd, &h, off));
+    close(fd);
+    return ok ? redone : -1;
+}
 
-    if (strcmp(newpin1, newpin2) != 0) {
-        printf("❌ PINs do not match.\n");
-        return;
+/* Validates one CSV line into row; returns NULL or why the row is rejected. */
+static const char* bulkParseRow(char *line, BulkRow *row) {
+    char *field[4];
+    int nf = 0;
+    char *save = NULL;
+    for (char *f = strtok_r(line, ",", &save); f; f = strtok_r(NULL, ",", &save)) {
+        if (nf == 4) return "expected 4 fields";
+        field[nf++] = trimField(f);
     }
-    if (strlen(newpin1) < 4) {
-        printf("❌ PIN too short (min 4 digits recommended).\n");
-        return;
+    if (nf != 4) return "expected 4 fields";
+
+    size_t refLen = strlen(field[3]);
+    if (refLen == 0) return "empty reference";
+    if (refLen > BULK_REF_MAX) return "reference too long";
+    memcpy(row->ref, field[3], refLen);
+
+    double amount;
+    if (!parseInt(field[0], &row->from)) return "bad source account";
+    if (!parseInt(field[1], &row->to)) return "bad target account";
+    if (!parseAmount(field[2], &amount) || !(amount > 0) || amount > MAX_AMOUNT) return "bad amount";
+    row->cents = toCents(amount);
+    return NULL;
+}
+
+typedef struct {
+    int         fd;              // transfers.refs
+    off_t       end;
+    BulkRefSet  seen;
+    IndexSlot  *snap;            // accountNumber -> index into imgs
+    uint64_t    snapCap;
+    Account    *imgs;
+    BulkRef    *refs;            // of the rows applied in this batch
+    BulkRow    *rows;
+    int         n;               // rows in this batch
+    FILE       *results;
+    BulkTotals *sum;
+} BulkRun;
+
+/* The batch's image of an account, copied from the store on first use. */
+static Account* bulkSnapshot(BulkRun *run, int *images, int32_t accountNumber) {
+    IndexSlot *slot = idxProbe(run->snap, run->snapCap, accountNumber);
+    if (!slot->used) {
+        if (!loadAccount(accountNumber, &run->imgs[*images])) return NULL;
+        slot->accountNumber = accountNumber;
+        slot->used = 1;
+        slot->offset = (*images)++;
     }
+    return &run->imgs[slot->offset];
+}
 
-    char newHash[65];
-    if (!sha256_hex(newpin1, newHash)) { printf("Hash error.\n"); return; }
-    strcpy(user->pinHash, newHash);
+/* Checks and applies the batch's rows, then makes it durable and logs it. */
+static bool bulkApplyBatch(BulkRun *run) {
+    int images = 0;
+    uint32_t refs = 0;
+    memset(run->snap, 0, (size_t)run->snapCap * sizeof(IndexSlot));
+    for (int i = 0; i < run->n; ++i) {
+        BulkRow *r = &run->rows[i];
+        if (r->why) continue;
+        Account *from, *to;
+        if (bulkRefSeen(&run->seen, r->ref)) r->why = BULK_DUPLICATE;
+        else if (r->from == r->to) r->why = "same account";
+        else if (!(from = bulkSnapshot(run, &images, r->from))) r->why = "source account not found";
+        else if (from->locked) r->why = "source account is locked";
+        else if (!(to = bulkSnapshot(run, &images, r->to))) r->why = "target account not found";
+        else if (to->locked) r->why = "target account is locked";
+        else if (r->cents > from->balanceCents) r->why = "insufficient funds";
+        else if (!bulkRefAdd(&run->seen, r->ref)) r->why = "out of memory";
+        else {
+            from->balanceCents -= r->cents;
+            to->balanceCents += r->cents;
+            r->fromBal = from->balanceCents;
+            r->toBal = to->balanceCents;
+            memcpy(run->refs[refs++], r->ref, sizeof(BulkRef));
+        }
+    }
 
-    if (!updateAccount(user)) {
-        printf("⚠️ Failed to update account on disk.\n");
-        return;
+    bool ok = true;
+    for (int i = 0; i < images; ++i) run->imgs[i].version++;
+    if (refs > 0) {
+        // the block first: once it is on disk the batch counts as applied
+        BulkBlock b = { BULK_MAGIC, refs, (uint32_t)images, 0 };
+        b.checksum = bulkChecksum(&b, run->refs, run->imgs);
+        size_t refBytes = refs * sizeof(BulkRef), imgBytes = (size_t)images * sizeof(Account);
+        IoChunk c[3] = {
+            { &b, sizeof(b), run->end },
+            { run->refs, refBytes, run->end + (off_t)sizeof(b) },
+            { run->imgs, imgBytes, run->end + (off_t)(sizeof(b) + refBytes) },
+        };
+        ok = ioWriteChunks(run->fd, c, 3, true);
+
+        const Account **ref = ok ? (const Account**)malloc((size_t)images * sizeof(Account*)) : NULL;
+        for (int i = 0; ref && i < images; ++i) ref[i] = &run->imgs[i];
+        ok = ref && walCommit(ref, images);
+        free(ref);
+        if (ok) {
+            run->end += bulkBlockSize(&b);
+            run->sum->batches++;
+        } else {
+            (void)ftruncate(run->fd, run->end);   // the block must not be redone
+            (void)ioFdatasync(run->fd);
+        }
     }
-    logTransaction(user, "PIN-CHG", 0.0, "PIN updated");
-    printf("✅ PIN changed successfully.\n");
+
+    for (int i = 0; i < run->n; ++i) {
+        BulkRow *r = &run->rows[i];
+        char ref[BULK_REF_MAX + 1];
+        snprintf(ref, sizeof(ref), "%.*s", BULK_REF_MAX, r->ref);
+        run->sum->rows++;
+        if (r->why == BULK_DUPLICATE) {
+            fprintf(run->results, "%ld,%s,duplicate\n", r->line, ref);
+            run->sum->duplicates++;
+        } else if (r->why) {
+            fprintf(run->results, "%ld,%s,rejected,%s\n", r->line, ref, r->why);
+            run->sum->rejected++;
+        } else if (!ok) {
+            fprintf(run->results, "%ld,%s,failed,not written to disk\n", r->line, ref);
+            run->sum->failed++;
+        } else {
+            Account a;
+            memset(&a, 0, sizeof(a));
+            a.accountNumber = r->from;
+            a.balanceCents = r->fromBal;
+            logTransaction(&a, TX_TRANSFER_OUT, r->cents, ref);
+            a.accountNumber = r->to;
+            a.balanceCents = r->toBal;
+            logTransaction(&a, TX_TRANSFER_IN, r->cents, ref);
+            fprintf(run->results, "%ld,%s,applied\n", r->line, ref);
+            run->sum->applied++;
+            run->sum->cents += r->cents;
+        }
+    }
+    run->n = 0;
+    return ok;
 }
 
-void transferFunds(Account *user) {
-    int toAcc;
-    double amount;
-    printf("Enter target Account Number: ");
-    if (scanf("%d", &toAcc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
-    flush_line();
+/* Loads every reference in transfers.refs into run->seen. */
+static bool bulkLoadRefs(BulkRun *run) {
+    BulkBlock b;
+    BulkRef *refs = NULL;
+    Account *imgs = NULL;
+    size_t refsCap = 0, imgsCap = 0;
+    bool ok = true;
+    run->end = (off_t)sizeof(BulkFileHeader);
+    while (ok && bulkReadBlock(run->fd, run->end, &b, &refs, &refsCap, &imgs, &imgsCap)) {
+        for (uint32_t i = 0; ok && i < b.refs; ++i) ok = bulkRefAdd(&run->seen, refs[i]);
+        run->end += bulkBlockSize(&b);
+    }
+    free(refs);
+    free(imgs);
+    return ok;
+}
 
-    if (toAcc == user->accountNumber) {
-        printf("❌ Cannot transfer to the same account.\n");
-        return;
+AtmStatus opBulkTransfer(const char *path, const char *resultsPath, BulkTotals *out) {
+    memset(out, 0, sizeof(*out));
+    FILE *in = fopen(path, "r");
+    if (!in) return ATM_ERR_NO_FILE;
+    FILE *results = fopen(resultsPath, "w");
+    if (!results) { fclose(in); return ATM_ERR_FILE; }
+
+    // no other process may touch the accounts while the file is applied
+    bool owned = cacheEnabled();
+    if (!owned && !rangeTryLock(g_store.fd, F_WRLCK, LOCK_BYTE_OWNER, 1)) {
+        fclose(in);
+        fclose(results);
+        return ATM_ERR_BUSY;
     }
 
-    Account target;
-    if (!loadAccount(toAcc, &target)) {
-        printf("❌ Target account not found.\n");
-        return;
+    BulkRun run;
+    memset(&run, 0, sizeof(run));
+    run.results = results;
+    run.sum = out;
+    run.snapCap = idxCapacityFor(2 * BULK_BATCH);
+    run.snap = (IndexSlot*)malloc((size_t)run.snapCap * sizeof(IndexSlot));
+    run.imgs = (Account*)malloc(2 * BULK_BATCH * sizeof(Account));
+    run.refs = (BulkRef*)malloc(BULK_BATCH * sizeof(BulkRef));
+    run.rows = (BulkRow*)malloc(BULK_BATCH * sizeof(BulkRow));
+    BulkFileHeader h;
+    run.fd = bulkOpen(&h);
+
+    AtmStatus st = ATM_OK;
+    if (!run.snap || !run.imgs || !run.refs || !run.rows || run.fd < 0 || !bulkLoadRefs(&run) ||
+        !cacheFlush()) {
+        st = ATM_ERR_IO;
     }
-    if (target.locked) {
-        printf("❌ Target account is locked.\n");
-        return;
+    fprintf(results, "line,reference,result,reason\n");
+
+    char *line = NULL;
+    size_t cap = 0;
+    long lineNo = 0;
+    while (st == ATM_OK && getline(&line, &cap, in) != -1) {
+        lineNo++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!*trimField(line)) continue;
+        if (lineNo == 1 && !isdigit((unsigned char)*trimField(line))) continue;   // header
+
+        BulkRow *r = &run.rows[run.n++];
+        memset(r, 0, sizeof(*r));
+        r->line = lineNo;
+        r->why = bulkParseRow(line, r);
+        if (run.n == BULK_BATCH && !bulkApplyBatch(&run)) st = ATM_ERR_IO;
     }
+    if (st == ATM_OK && run.n > 0 && !bulkApplyBatch(&run)) st = ATM_ERR_IO;
+    free(line);
 
-    printf("Enter amount to transfer: ");
-    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
-    flush_line();
+    // every batch is in the journal: none needs redoing after a crash
+    if (run.fd >= 0) {
+        if (run.end != (off_t)h.applied && !bulkSetApplied(run.fd, &h, run.end)) st = ATM_ERR_IO;
+        close(run.fd);
+    }
+    if (!owned) (void)rangeLock(g_store.fd, F_RDLCK, LOCK_BYTE_OWNER, 1);
+    if (fclose(results) != 0 && st == ATM_OK) st = ATM_ERR_FILE;
+    fclose(in);
+    free(run.seen.keys);
+    free(run.seen.used);
+    free(run.snap);
+    free(run.imgs);
+    free(run.refs);
+    free(run.rows);
+    return st;
+}
 
-    if (amount <= 0) {
-        printf("❌ Amount must be positive.\n");
-        return;
+int runBulkTransfer(const char *path, const char *resultsPath) {
+    char defaultResults[512];
+    if (!resultsPath) {
+        snprintf(defaultResults, sizeof(defaultResults), "%s.results", path);
+        resultsPath = defaultResults;
     }
-    if (amount > user->balance) {
-        printf("❌ Insufficient funds.\n");
-        return;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    BulkTotals sum;
+    AtmStatus st = opBulkTransfer(path, resultsPath, &sum);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (sum.rows > 0 || st == ATM_OK) {
+        double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+        char total[24];
+        printf("%s Bulk transfers: %ld row(s), %ld applied (%s) in %ld batch(es), %ld duplicate(s), "
+               "%ld rejected, %ld failed. Results in %s.\n",
+               sum.rejected || sum.failed ? "⚠️" : "✅", sum.rows, sum.applied, fmtCents(sum.cents, total),
+               sum.batches, sum.duplicates, sum.rejected, sum.failed, resultsPath);
+        printf("📊 %.3f s (%.0f rows/sec)\n", secs, secs > 0 ? (double)sum.rows / secs : 0.0);
+    }
+    if (st != ATM_OK) {
+        printf("%s\n", atmStatusText(st));
+        return 1;
+    }
+    return sum.rejected || sum.failed ? 1 : 0;
+}
+
+/* ======================= Backup and Restore ======================= */
+/*
+ * `atm --backup <file>` (or BACKUP <file> on the server) writes a copy of
+ * the accounts as they stood at one instant, while sessions keep running;
+ * `atm --restore <file>` puts such a copy back. A copy is a single file in
+ * the format of accounts.dat, whatever the shard count, and remembers the
+ * count so a restore can route the records back.
+ *
+ * Writers are never held up for the copy. The journal already carries the
+ * after-image of every change, so a backup notes where the journal ends,
+ * copies the store with large sequential reads while commits go on, then
+ * holds the journal for a moment to copy the records appended meanwhile and
+ * note its new end. Records present at the start are copied shard by shard,
+ * and those appended meanwhile go after all of them (see BackupPlan).
+ * Laying the images between the two ends over the copy
+ * turns it into the store as of the second one; a record read halfway
+ * through a commit is among them. Checkpoints leave the journal alone while
+ * any process holds LOCK_BYTE_BACKUP.
+ *
+ * The copy's header keeps the transaction log's end at the start (logFrom)
+ * and at the snapshot (logPos). logPos is read once every operation that
+ * committed before the snapshot has logged, so no change in the copy is
+ * missing below it; an operation that committed just after may be logged
+ * below it too. Every log entry states the balance after it, so a restore
+ * cuts the log at logPos and takes the balances of the entries from logFrom
+ * on, which brings those few up to date. Store and log then reconcile.
+ *
+ * A restore needs the files to itself. It empties the journal, rewrites
+ * the account files in place with their record counts at zero until the
+ * copy is complete (an interrupted restore leaves an empty store; run it
+ * again), and cuts transfers.refs back to its size at the snapshot.
+ */
+#define BACKUP_CHUNK ((size_t)1 << 20)   // bytes per copy read
+#define RESTORE_RUN  1024                // records buffered per shard before a write
+
+static struct {
+    pthread_mutex_t mu;    // one backup at a time per process
+    bool            running;
+} g_backup = { PTHREAD_MUTEX_INITIALIZER, false };
+
+/* True while this or another process takes a backup. */
+static bool backupRunning(void) {
+    return __atomic_load_n(&g_backup.running, __ATOMIC_ACQUIRE) ||
+           !rangeFree(g_store.fd, F_WRLCK, LOCK_BYTE_BACKUP, 1);
+}
+
+/* Copies bytes [off, end) of one file to another, starting at offset at. */
+static bool copyRange(int from, int to, off_t off, off_t end, off_t at, char *buf) {
+    while (off < end) {
+        size_t want = (uint64_t)(end - off) < BACKUP_CHUNK ? (size_t)(end - off) : BACKUP_CHUNK;
+        ssize_t got = ioPread(from, buf, want, off);
+        if (got <= 0 || ioPwrite(to, buf, (size_t)got, at) != got) return false;
+        off += got;
+        at += got;
     }
+    return true;
+}
 
-    user->balance   -= amount;
-    target.balance  += amount;
+/* Where each shard's records sit in a backup copy: those there when the copy
+   started first, shard after shard, then those appended before the snapshot.
+   Counts and positions are in records. */
+typedef struct {
+    const StoreLayout *layout;
+    uint64_t mid[STORE_MAX_SHARDS];     // records at the start of the copy
+    uint64_t end[STORE_MAX_SHARDS];     // and at the snapshot
+    uint64_t first[STORE_MAX_SHARDS];   // copy position of the shard's record 0
+    uint64_t tail[STORE_MAX_SHARDS];    // and of its record mid
+} BackupPlan;
 
-    if (!updateAccount(user)) { printf("⚠️ Failed to update sender on disk.\n"); return; }
-    if (!updateAccount(&target)) { printf("⚠️ Failed to update target on disk.\n"); return; }
+/* Byte offset in the copy of record r of shard k. */
+static off_t backupSlot(const BackupPlan *p, unsigned k, uint64_t r) {
+    uint64_t at = r < p->mid[k] ? p->first[k] + r : p->tail[k] + (r - p->mid[k]);
+    return (off_t)(sizeof(StoreHeader) + at * sizeof(Account));
+}
 
-    char note1[64], note2[64];
-    snprintf(note1, sizeof(note1), "to %d", target.accountNumber);
-    snprintf(note2, sizeof(note2), "from %d", user->accountNumber);
+/* Copies records [from, to) of shard k to their places in the copy. */
+static bool backupCopy(int fd, const BackupPlan *p, unsigned k, uint64_t from, uint64_t to, char *buf) {
+    const StoreShard *sh = p->layout->shard[k];
+    return copyRange(sh->fd, fd, (off_t)(sizeof(StoreHeader) + from * sizeof(Account)),
+                     (off_t)(sizeof(StoreHeader) + to * sizeof(Account)), backupSlot(p, k, from), buf);
+}
 
-    logTransaction(user,   "TRANSFER-", amount, note1);
-    logTransaction(&target,"TRANSFER+", amount, note2);
+/* The log's end once every record queued so far is written; -1 on error. */
+static int64_t txlogEnd(void) {
+    txlogDrain();
+    int64_t end = -1;
+    pthread_mutex_lock(&g_txlog.mu);
+    if (txlogAcquire()) {
+        end = g_txlog.endPos;
+        txlogRelease();
+    }
+    pthread_mutex_unlock(&g_txlog.mu);
+    return end;
+}
 
-    printf("✅ Transferred %.2f to A/C %d. New Balance: %.2f\n", amount, target.accountNumber, user->balance);
+/* Reads journal records [from, to) back, passing each image to put in
+   order; *records counts the records read. */
+static bool walReadBack(off_t from, off_t to, bool (*put)(const Account *img, void *arg), void *arg, long *records) {
+    Account *img = NULL;
+    size_t imgCap = 0;
+    bool ok = true;
+    for (off_t pos = from; ok && pos < to;) {
+        WalRecord r;
+        ok = ioPread(g_wal.fd, &r, sizeof(r), pos) == (ssize_t)sizeof(r) && r.magic == WAL_MAGIC &&
+             r.count > 0 && r.count <= WAL_MAX_IMAGES &&
+             growBuffer((char**)&img, &imgCap, (size_t)r.count * sizeof(Account));
+        size_t bytes = ok ? (size_t)r.count * sizeof(Account) : 0;
+        ok = ok && ioPread(g_wal.fd, img, bytes, pos + (off_t)sizeof(r)) == (ssize_t)bytes &&
+             r.checksum == walChecksum(r.lsn, r.count, img, sizeof(Account));
+        for (uint32_t i = 0; ok && i < r.count; ++i) ok = put(&img[i], arg);
+        pos += (off_t)(sizeof(r) + bytes);
+        if (ok) (*records)++;
+    }
+    free(img);
+    return ok;
 }
 
-/* ======================= Menus ======================= */
-void atmMenu(Account *user) {
-    for (;;) {
-        int choice;
-        printf("\n--- ATM Menu ---\n");
-        printf("1. Balance Inquiry\n");
-        printf("2. Deposit\n");
-        printf("3. Withdraw\n");
-        printf("4. Change PIN\n");
-        printf("5. Transfer Funds\n");
-        printf("6. Mini Statement (last 5)\n");
-        printf("7. Exit\n");
-        printf("Enter choice: ");
-        if (scanf("%d", &choice) != 1) { printf("Invalid input.\n"); flush_line(); continue; }
-        flush_line();
+typedef struct {
+    int               fd;
+    const BackupPlan *plan;
+} BackupRedo;
 
-        switch (choice) {
-            case 1: balanceInquiry(user); break;
-            case 2: deposit(user); break;
-            case 3: withdraw(user); break;
-            case 4: changePin(user); break;
-            case 5: transferFunds(user); break;
-            case 6: showMiniStatement(user, 5); break;
-            case 7: printf("👋 Thank you for using ATM.\n"); return;
-            default: printf("Invalid choice.\n");
+/* Writes an image into the copy at its record's place; records appended
+   after the snapshot are not in the copy. */
+static bool backupPut(const Account *img, void *arg) {
+    const BackupRedo *r = (const BackupRedo*)arg;
+    const StoreLayout *l = r->plan->layout;
+    StoreShard *sh;
+    const Account *a = shardRef(img->accountNumber, &sh);
+    unsigned k = shardOf(img->accountNumber, l->shards);
+    if (!a || sh != l->shard[k]) return true;
+    uint64_t i = (uint64_t)((size_t)((const char*)a - sh->base) - sizeof(StoreHeader)) / sizeof(Account);
+    if (i >= r->plan->end[k]) return true;
+    return ioPwrite(r->fd, img, sizeof(Account), backupSlot(r->plan, k, i)) == (ssize_t)sizeof(Account);
+}
+
+/* Returns once no operation, here or in another process, is between its
+   commit and its log entry: they do both under their accounts' locks, so
+   take every lock stripe and a read lock over each shard's records for an
+   instant. */
+static void backupQuiesce(const BackupPlan *p) {
+    pthread_once(&g_accountLocksOnce, accountLocksInit);
+    for (int i = 0; i < ACCOUNT_LOCK_STRIPES; ++i) pthread_mutex_lock(&g_accountLocks[i]);
+    for (unsigned k = 0; k < p->layout->shards; ++k) {
+        int fd = p->layout->shard[k]->fd;
+        off_t len = (off_t)(p->end[k] * sizeof(Account));
+        if (len > 0 && rangeLock(fd, F_RDLCK, (off_t)sizeof(StoreHeader), len)) {
+            (void)rangeLock(fd, F_UNLCK, (off_t)sizeof(StoreHeader), len);
         }
     }
+    for (int i = ACCOUNT_LOCK_STRIPES - 1; i >= 0; --i) pthread_mutex_unlock(&g_accountLocks[i]);
 }
 
-/* ======================= Admin ======================= */
-/* Super simple admin auth (demo only). 
-   Admin password: "admin123" (hashed here at runtime for compare). */
-bool adminLogin(void) {
-    char pass[64];
-    char inHash[65], targetHash[65];
+/* *redone: journal records laid over the copy. */
+AtmStatus opBackup(const char *path, uint64_t *accounts, int64_t *logPos, long *redone) {
+    *accounts = 0;
+    *logPos = 0;
+    *redone = 0;
+    if (!g_wal.running) return ATM_ERR_IO;
 
-    printf("\n--- Admin Login ---\nPassword (hidden): ");
-    get_hidden_input(pass, sizeof(pass));
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = ioOpen(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    char *buf = (char*)malloc(BACKUP_CHUNK);
+    if (fd < 0 || !buf) {
+        if (fd >= 0) { close(fd); remove(tmp); }
+        free(buf);
+        return ATM_ERR_FILE;
+    }
 
-    if (!sha256_hex(pass, inHash)) return false;
-    // precompute hash of "admin123"
-    (void)sha256_hex("admin123", targetHash);
+    pthread_mutex_lock(&g_backup.mu);
+    __atomic_store_n(&g_backup.running, true, __ATOMIC_RELEASE);
+    bool ok = rangeLock(g_store.fd, F_RDLCK, LOCK_BYTE_BACKUP, 1);
 
-    if (strcmp(inHash, targetHash) == 0) {
-        printf("✅ Admin authenticated.\n");
-        return true;
+    // where the log and the journal stand, then the store while commits go on
+    int64_t logFrom = ok ? txlogEnd() : -1;
+    off_t from = -1, to = -1;
+    if (logFrom >= 0 && walHold()) {
+        from = lseek(g_wal.fd, 0, SEEK_END);
+        walUnhold(false);
     }
-    printf("❌ Wrong admin password.\n");
-    return false;
+    ok = from >= 0;
+    BackupPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    plan.layout = storeLayout();
+    unsigned shards = plan.layout->shards;
+    uint64_t at = 0;
+    AtmStatus st = ok ? ATM_OK : ATM_ERR_IO;
+    for (unsigned k = 0; st == ATM_OK && k < shards; ++k) {
+        plan.mid[k] = __atomic_load_n(&shardHeader(plan.layout->shard[k])->count, __ATOMIC_ACQUIRE);
+        plan.first[k] = at;
+        at += plan.mid[k];
+        if (!backupCopy(fd, &plan, k, 0, plan.mid[k], buf)) st = ATM_ERR_FILE;
+    }
+
+    // the snapshot: records appended meanwhile, the header and the journal's end
+    StoreHeader h;
+    if (st == ATM_OK && cacheFlush() && walHold()) {
+        memcpy(&h, storeHeader(), sizeof(h));
+        for (unsigned k = 0; k < shards; ++k) {
+            plan.end[k] = __atomic_load_n(&shardHeader(plan.layout->shard[k])->count, __ATOMIC_ACQUIRE);
+            plan.tail[k] = at;
+            at += plan.end[k] - plan.mid[k];
+            if (!backupCopy(fd, &plan, k, plan.mid[k], plan.end[k], buf)) st = ATM_ERR_FILE;
+        }
+        h.count = at;
+        h.shards = shards;
+        to = lseek(g_wal.fd, 0, SEEK_END);
+        walUnhold(false);
+    }
+    BackupRedo redo = { fd, &plan };
+    if (st == ATM_OK && (to < from || !walReadBack(from, to, backupPut, &redo, redone))) st = ATM_ERR_IO;
+
+    // the log's end once everything committed up to the snapshot has logged
+    if (st == ATM_OK) {
+        backupQuiesce(&plan);
+        struct stat rs;
+        h.backup = 1;
+        h.logFrom = logFrom;
+        h.logPos = txlogEnd();
+        h.refsEnd = stat(bulkRefsFile(), &rs) == 0 ? (uint64_t)rs.st_size : 0;
+        if (h.logPos < 0) st = ATM_ERR_IO;
+        else if (ioPwrite(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || ioFsync(fd) != 0) st = ATM_ERR_FILE;
+        *accounts = h.count;
+        *logPos = h.logPos;
+    }
+
+    if (ok) (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_BACKUP, 1);
+    __atomic_store_n(&g_backup.running, false, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_backup.mu);
+    free(buf);
+    if (close(fd) != 0 && st == ATM_OK) st = ATM_ERR_FILE;
+    if (st == ATM_OK && rename(tmp, path) != 0) st = ATM_ERR_FILE;
+    if (st != ATM_OK) remove(tmp);
+    return st;
 }
 
-void adminCreateAccount(void) {
-    Account a = {0};
-    char pin[64];
+int runBackup(const char *path) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    uint64_t accounts;
+    int64_t logPos;
+    long redone;
+    AtmStatus st = opBackup(path, &accounts, &logPos, &redone);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (st != ATM_OK) {
+        printf("%s\n", atmStatusText(st));
+        return 1;
+    }
 
-    printf("\n--- Create Account ---\n");
-    printf("Enter new Account Number: ");
-    if (scanf("%d", &a.accountNumber) != 1) { printf("Invalid input.\n"); flush_line(); return; }
-    flush_line();
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double mb = (double)(sizeof(StoreHeader) + accounts * sizeof(Account)) / (1 << 20);
+    printf("✅ Backed up %llu account(s) to %s at log position %lld (%ld journal record(s) caught up).\n",
+           (unsigned long long)accounts, path, (long long)logPos, redone);
+    printf("📊 %.3f s (%.1f MB/s)\n", secs, secs > 0 ? mb / secs : 0.0);
+    return 0;
+}
 
-    if (accountExists(a.accountNumber)) {
-        printf("❌ Account number already exists.\n");
-        return;
+/* Cuts the transaction log back to its first pos records. Returns the
+   log's end afterwards (pos, or less if the log has lost records since). */
+static int64_t txlogCut(int64_t pos) {
+    uint32_t first, last;
+    if (!txlogSegmentRange(&first, &last)) return 0;
+    int64_t end = 0;
+    for (uint32_t seq = last; seq >= first && seq > 0; --seq) {
+        char path[64];
+        struct stat st;
+        txSegmentPath(seq, path, sizeof(path));
+        if (stat(path, &st) != 0) continue;
+        int64_t segStart = (int64_t)(seq - 1) * TXLOG_SEG_RECORDS;
+        if (segStart >= pos && seq > 1) {
+            if (remove(path) != 0) return -1;
+            continue;
+        }
+        off_t keep = segStart + TXLOG_SEG_RECORDS <= pos ? (off_t)TXLOG_SEGMENT_BYTES : posOffset(pos);
+        if (st.st_size > keep && truncate(path, keep) != 0) return -1;
+        if (st.st_size < (off_t)sizeof(TxSegmentHeader)) return end;
+        int64_t n = (int64_t)(((uint64_t)(st.st_size < keep ? st.st_size : keep) - sizeof(TxSegmentHeader)) / sizeof(TxRecord));
+        end = segStart + n;
+        break;
     }
+    return end;
+}
 
-    printf("Enter name: ");
-    if (!fgets(a.name, sizeof(a.name), stdin)) { printf("Input error.\n"); return; }
-    a.name[strcspn(a.name, "\r\n")] = '\0';
+/* Takes the balance of every log entry in [from, to), in log order, so
+   each account ends at its last one. Returns how many balances changed. */
+static long restoreRollForward(int64_t from, int64_t to) {
+    LogView view;
+    if (!viewOpen(&view, to)) return -1;
+    long changed = 0;
+    for (int64_t pos = from; pos < to; ++pos) {
+        const TxRecord *r = viewAt(&view, pos);
+        Account *a = r ? accountRef(r->accountNumber) : NULL;
+        if (a && a->balanceCents != r->balanceCents) {
+            a->balanceCents = r->balanceCents;
+            changed++;
+        }
+    }
+    viewClose(&view);
+    return storeSync() ? changed : -1;
+}
 
-    printf("Enter initial PIN (hidden, min 4): ");
-    get_hidden_input(pin, sizeof(pin));
-    if (strlen(pin) < 4) { printf("❌ PIN too short.\n"); return; }
-    (void)sha256_hex(pin, a.pinHash);
+/* Cuts transfers.refs back to size bytes, so references applied after the
+   backup count as new again. */
+static bool restoreRefs(uint64_t size) {
+    struct stat st;
+    if (stat(bulkRefsFile(), &st) != 0 || (uint64_t)st.st_size <= size) return true;
+    if (size <= sizeof(BulkFileHeader)) return remove(bulkRefsFile()) == 0;
+    BulkFileHeader h;
+    int fd = bulkOpen(&h);
+    if (fd < 0) return false;
+    bool ok = ftruncate(fd, (off_t)size) == 0 && (h.applied <= size || bulkSetApplied(fd, &h, (off_t)size));
+    close(fd);
+    return ok;
+}
 
-    printf("Enter initial balance: ");
-    if (scanf("%lf", &a.balance) != 1) { printf("Invalid input.\n"); flush_line(); return; }
-    flush_line();
+/* Writes records into the files of a shard layout being built, each to the
+   shard its number belongs to, RESTORE_RUN records at a time. */
+typedef struct {
+    unsigned shards;
+    int      fd[STORE_MAX_SHARDS];
+    uint64_t count[STORE_MAX_SHARDS];   // records written or buffered
+    unsigned used[STORE_MAX_SHARDS];    // records buffered
+    Account *run;                       // RESTORE_RUN records per shard
+    bool     ok;
+} ShardWriter;
 
-    a.failedAttempts = 0;
-    a.locked = 0;
+/* Creates (or empties) accounts.<k>.dat<suffix> for each of shards > 1. */
+static bool writerOpen(ShardWriter *w, unsigned shards, const char *suffix) {
+    memset(w, 0, sizeof(*w));
+    w->shards = shards;
+    for (unsigned k = 0; k < STORE_MAX_SHARDS; ++k) w->fd[k] = -1;
+    w->run = (Account*)malloc((size_t)shards * RESTORE_RUN * sizeof(Account));
+    w->ok = w->run != NULL;
+    for (unsigned k = 0; w->ok && k < shards; ++k) {
+        char file[32], path[48];
+        shardFile(k, shards, file, sizeof(file));
+        snprintf(path, sizeof(path), "%s%s", file, suffix);
+        w->fd[k] = ioOpen(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        w->ok = w->fd[k] >= 0 && storeCheckHeader(w->fd[k], path, shards) != 0;
+    }
+    return w->ok;
+}
 
-    if (!appendAccount(&a)) {
-        printf("⚠️ Failed to save account.\n");
-        return;
+static void writerFlush(ShardWriter *w, unsigned k) {
+    size_t bytes = (size_t)w->used[k] * sizeof(Account);
+    off_t at = (off_t)(sizeof(StoreHeader) + (w->count[k] - w->used[k]) * sizeof(Account));
+    if (w->ok && bytes > 0) {
+        w->ok = ioPwrite(w->fd[k], w->run + (size_t)k * RESTORE_RUN, bytes, at) == (ssize_t)bytes;
     }
-    printf("✅ Account created: %d (%s) with balance %.2f\n", a.accountNumber, a.name, a.balance);
+    w->used[k] = 0;
 }
 
-void adminListAccounts(void) {
-    FILE *fp = fopen(accountsFile(), "rb");
-    if (!fp) { printf("No accounts file.\n"); return; }
+static void writerPut(ShardWriter *w, const Account *a) {
+    unsigned k = shardOf(a->accountNumber, w->shards);
+    w->run[(size_t)k * RESTORE_RUN + w->used[k]++] = *a;
+    w->count[k]++;
+    if (w->used[k] == RESTORE_RUN) writerFlush(w, k);
+}
 
-    printf("\n--- All Accounts ---\n");
-    Account a;
-    int n = 0;
-    while (fread(&a, sizeof(Account), 1, fp) == 1) {
-        printf("A/C %-6d | %-20s | Bal: %10.2f | Locked: %d | Attempts: %d\n",
-               a.accountNumber, a.name, a.balance, a.locked, a.failedAttempts);
-        n++;
+/* Writes what is buffered, then raises each file's count over its records. */
+static bool writerFinish(ShardWriter *w) {
+    for (unsigned k = 0; k < w->shards; ++k) writerFlush(w, k);
+    for (unsigned k = 0; w->ok && k < w->shards; ++k) {
+        StoreHeader h;
+        w->ok = ioFdatasync(w->fd[k]) == 0 &&
+                ioPread(w->fd[k], &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+        h.count = w->count[k];
+        w->ok = w->ok && ioPwrite(w->fd[k], &h, sizeof(h), 0) == (ssize_t)sizeof(h) &&
+                ioFdatasync(w->fd[k]) == 0;
     }
-    if (n == 0) printf("(none)\n");
-    fclose(fp);
+    return w->ok;
 }
 
-void adminUnlockAccount(void) {
-    int acc;
-    printf("Enter account to unlock: ");
-    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
-    flush_line();
+static void writerClose(ShardWriter *w) {
+    for (unsigned k = 0; k < w->shards; ++k) {
+        if (w->fd[k] >= 0) close(w->fd[k]);
+    }
+    free(w->run);
+}
 
-    Account a;
-    if (!loadAccount(acc, &a)) { printf("Account not found.\n"); return; }
+/* Routes the records of a backup copy into the shard files of its layout. */
+static bool restoreSplit(int in, const StoreHeader *h, char *buf) {
+    ShardWriter w;
+    bool ok = writerOpen(&w, h->shards, "");
+    off_t end = (off_t)(sizeof(StoreHeader) + h->count * sizeof(Account));
+    for (off_t off = (off_t)sizeof(StoreHeader); ok && off < end;) {
+        size_t want = (uint64_t)(end - off) < BACKUP_CHUNK ? (size_t)(end - off) : BACKUP_CHUNK;
+        ssize_t got = ioPread(in, buf, want, off);
+        ok = got > 0 && (size_t)got % sizeof(Account) == 0;
+        for (size_t i = 0; ok && i < (size_t)got / sizeof(Account); ++i) writerPut(&w, (const Account*)buf + i);
+        ok = ok && w.ok;
+        off += got;
+    }
+    ok = ok && writerFinish(&w);
+    writerClose(&w);
+    return ok;
+}
 
-    a.locked = 0;
-    a.failedAttempts = 0;
-    if (!updateAccount(&a)) { printf("Failed to update.\n"); return; }
-    printf("✅ Account %d unlocked.\n", acc);
+AtmStatus opRestore(const char *path, uint64_t *accounts, int64_t *logPos, long *rolled) {
+    int in = ioOpen(path, O_RDONLY);
+    if (in < 0) return ATM_ERR_NO_FILE;
+    StoreHeader h;
+    struct stat st;
+    if (fstat(in, &st) != 0 || ioPread(in, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+        h.magic != STORE_MAGIC || h.version != STORE_VERSION || h.headerSize != sizeof(StoreHeader) ||
+        h.recordSize != sizeof(Account) || !h.backup || h.logFrom < 0 || h.logPos < h.logFrom ||
+        h.count > ((uint64_t)st.st_size - sizeof(StoreHeader)) / sizeof(Account) ||
+        h.shards > STORE_MAX_SHARDS || (h.shards & (h.shards - 1)) != 0) {
+        close(in);
+        return ATM_ERR_NOT_BACKUP;
+    }
+    unsigned shards = h.shards ? h.shards : 1;
+
+    int fd = ioOpen(accountsFile(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) { close(in); return ATM_ERR_IO; }
+    if (!rangeTryLock(fd, F_WRLCK, LOCK_BYTE_OWNER, 1)) {
+        close(fd);
+        close(in);
+        return ATM_ERR_BUSY;
+    }
+
+    // the journal's images belong to the store being replaced
+    StoreHeader live = h;
+    live.count = 0;
+    live.backup = 0;
+    live.logFrom = live.logPos = 0;
+    live.refsEnd = 0;
+    off_t end = (off_t)(sizeof(StoreHeader) + h.count * sizeof(Account));
+    char *buf = (char*)malloc(BACKUP_CHUNK);
+    bool ok = buf && (remove(journalFile()) == 0 || errno == ENOENT) &&
+              (remove(indexFile()) == 0 || errno == ENOENT) &&
+              ioPwrite(fd, &live, sizeof(live), 0) == (ssize_t)sizeof(live) && ioFdatasync(fd) == 0;
+    if (shards == 1) {
+        ok = ok && copyRange(in, fd, (off_t)sizeof(StoreHeader), end, (off_t)sizeof(StoreHeader), buf) &&
+             ftruncate(fd, end) == 0 && ioFdatasync(fd) == 0;
+        live.count = h.count;
+        ok = ok && ioPwrite(fd, &live, sizeof(live), 0) == (ssize_t)sizeof(live) && ioFdatasync(fd) == 0;
+    } else {
+        // accounts.dat keeps only the header; the records go to their shards
+        ok = ok && ftruncate(fd, (off_t)sizeof(StoreHeader)) == 0 && restoreSplit(in, &h, buf);
+    }
+    if (ok) storeRemoveShards(shards == 1 ? 0 : shards, true);
+    free(buf);
+    close(in);
+
+    // the log back to the snapshot, then the balances of its last entries
+    int64_t logEnd = ok ? txlogCut(h.logPos) : -1;
+    ok = logEnd >= 0 && restoreRefs(h.refsEnd);
+    *rolled = 0;
+    if (ok && logEnd > h.logFrom) {
+        ok = storeOpen() && (*rolled = restoreRollForward(h.logFrom, logEnd)) >= 0;
+        storeClose();
+    }
+    *accounts = h.count;
+    *logPos = logEnd;
+
+    (void)rangeLock(fd, F_UNLCK, LOCK_BYTE_OWNER, 1);
+    close(fd);
+    return ok ? ATM_OK : ATM_ERR_IO;
 }
 
-void adminResetPin(void) {
-    int acc;
-    char newpin[64], hash[65];
+int runRestore(const char *path) {
+    uint64_t accounts = 0;
+    int64_t logPos = 0;
+    long rolled = 0;
+    AtmStatus st = opRestore(path, &accounts, &logPos, &rolled);
+    if (st != ATM_OK) {
+        printf("%s\n", atmStatusText(st));
+        return 1;
+    }
+    printf("✅ Restored %llu account(s) from %s; transaction log cut back to %lld entries, "
+           "%ld balance change(s) taken from its tail.\n",
+           (unsigned long long)accounts, path, (long long)logPos, rolled);
+    return 0;
+}
 
-    printf("Enter account to reset PIN: ");
-    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
-    flush_line();
+/* ======================= Resharding ======================= */
+/*
+ * `atm --reshard <n>` (or RESHARD <n> on the server) moves the accounts into
+ * n shards (see Account Store) while the sessions of this process keep
+ * running. Like end-of-day posting it needs the files to itself, so other
+ * atm processes must be stopped first.
+ *
+ * The records are copied into accounts.<k>.dat.split files without holding
+ * anything up, much as a backup copies them: the journal is pinned first
+ * (see Backup and Restore), so every change made during the copy can be read
+ * back from it. Then sessions are held for a moment - every lock stripe, the
+ * layout and the journal - while the records appended meanwhile are copied
+ * and the journal's images since the copy started are laid over the new
+ * files. Writing the new shard count into accounts.dat's header is the
+ * commit point; the .split files are then renamed into place and the new
+ * layout takes over. A reshard that stops partway is finished, or undone,
+ * the next time the store is opened.
+ */
 
-    Account a;
-    if (!loadAccount(acc, &a)) { printf("Account not found.\n"); return; }
+/* Lays a journal image over its record in the new shards. */
+static bool reshardPut(const Account *img, void *arg) {
+    const StoreLayout *l = (const StoreLayout*)arg;
+    StoreShard *sh = l->shard[shardOf(img->accountNumber, l->shards)];
+    if (!sh->idx) return false;
+    IndexSlot *s = idxProbe(idxSlots(sh), sh->idx->capacity, img->accountNumber);
+    if (s->used) memcpy(sh->base + s->offset, img, sizeof(Account));
+    return true;
+}
 
-    printf("Enter new PIN (hidden, min 4): ");
-    get_hidden_input(newpin, sizeof(newpin));
-    if (strlen(newpin) < 4) { printf("❌ PIN too short.\n"); return; }
+/* With everything held: moves the records appended to the old shards since
+   the copy, and the journal's images from `from` on, into the new ones. */
+static bool reshardCatchUp(const StoreLayout *old, const StoreLayout *l, const uint64_t *copied,
+                           off_t from, long *redone) {
+    size_t n = 0;
+    for (unsigned j = 0; j < old->shards; ++j) n += shardCount(old->shard[j]) - copied[j];
+    Account *part = (Account*)malloc((n ? n : 1) * sizeof(Account));
+    bool ok = part != NULL;
+    for (unsigned k = 0; ok && n > 0 && k < l->shards; ++k) {
+        long m = 0;
+        for (unsigned j = 0; j < old->shards; ++j) {
+            const StoreShard *sh = old->shard[j];
+            for (size_t i = copied[j]; i < shardCount(sh); ++i) {
+                if (shardOf(shardAt(sh, i)->accountNumber, l->shards) == k) part[m++] = *shardAt(sh, i);
+            }
+        }
+        pthread_rwlock_wrlock(&l->shard[k]->lock);
+        ok = shardAppend(l->shard[k], part, m);
+        pthread_rwlock_unlock(&l->shard[k]->lock);
+    }
+    free(part);
 
-    (void)sha256_hex(newpin, hash);
-    strcpy(a.pinHash, hash);
-    a.failedAttempts = 0;
-    a.locked = 0;
+    off_t to = lseek(g_wal.fd, 0, SEEK_END);
+    ok = ok && to >= from && walReadBack(from, to, reshardPut, (void*)l, redone);
+    for (unsigned k = 0; ok && k < l->shards; ++k) ok = shardSync(l->shard[k]);
+    return ok;
+}
 
-    if (!updateAccount(&a)) { printf("Failed to update.\n"); return; }
-    printf("✅ PIN reset for A/C %d.\n", acc);
+/* Commits the new layout in accounts.dat's header, renames its files into
+   place and switches to it. Caller holds everything reshardCatchUp() needs. */
+static bool reshardSwitch(StoreLayout *old, StoreLayout *l) {
+    StoreHeader *h = storeHeader();
+    StoreHeader was = *h;
+    h->shards = l->shards;
+    if (old->shards == 1) h->count = 0;   // the records now live in the shard files
+    if (ioMsync(h, sizeof(StoreHeader), MS_SYNC) != 0) {
+        *h = was;
+        return false;
+    }
+
+    bool ok = true;
+    for (unsigned k = 0; k < l->shards; ++k) {
+        StoreShard *sh = l->shard[k];
+        shardFile(k, l->shards, sh->file, sizeof(sh->file));
+        shardIndexFile(k, l->shards, sh->idxFile, sizeof(sh->idxFile));
+        char split[48];
+        snprintf(split, sizeof(split), "%s.split", sh->file);
+        if (rename(split, sh->file) != 0) ok = false;   // the next open finishes it
+        snprintf(split, sizeof(split), "%s.split", sh->idxFile);
+        if (rename(split, sh->idxFile) != 0) remove(sh->idxFile);
+    }
+    for (unsigned j = 0; j < old->shards; ++j) old->shard[j]->retired = true;
+    l->prev = old;
+    __atomic_store_n(&g_store.layout, l, __ATOMIC_RELEASE);
+    return ok;
 }
 
-void adminMenu(void) {
-    if (!adminLogin()) return;
+static AtmStatus reshardRun(StoreLayout *old, unsigned shards, long *redone) {
+    // where the journal stands, then every record while commits go on
+    off_t from = -1;
+    if (walHold()) {
+        from = lseek(g_wal.fd, 0, SEEK_END);
+        walUnhold(false);
+    }
+    if (from < 0) return ATM_ERR_IO;
 
-    for (;;) {
-        int ch;
-        printf("\n--- Admin Menu ---\n");
-        printf("1. Create Account\n");
-        printf("2. List Accounts\n");
-        printf("3. Unlock Account\n");
-        printf("4. Reset PIN\n");
-        printf("5. Exit Admin\n");
-        printf("Enter choice: ");
-        if (scanf("%d", &ch) != 1) { printf("Invalid input.\n"); flush_line(); continue; }
-        flush_line();
+    ShardWriter w;
+    uint64_t copied[STORE_MAX_SHARDS];
+    bool ok = writerOpen(&w, shards, ".split");
+    for (unsigned j = 0; ok && j < old->shards; ++j) {
+        StoreShard *sh = old->shard[j];
+        pthread_rwlock_rdlock(&sh->lock);
+        copied[j] = shardCount(sh);
+        pthread_rwlock_unlock(&sh->lock);
+        for (uint64_t i = 0; i < copied[j]; ++i) {
+            Account a;
+            recordRead(&a, shardAt(sh, i));
+            writerPut(&w, &a);
+        }
+        ok = w.ok;
+    }
+    ok = ok && writerFinish(&w);
+    writerClose(&w);
 
-        switch (ch) {
-            case 1: adminCreateAccount(); break;
-            case 2: adminListAccounts();  break;
-            case 3: adminUnlockAccount(); break;
-            case 4: adminResetPin();      break;
-            case 5: return;
-            default: printf("Invalid choice.\n");
+    // open them, which indexes them
+    StoreLayout *l = ok ? (StoreLayout*)calloc(1, sizeof(StoreLayout)) : NULL;
+    ok = l != NULL;
+    if (ok) l->shards = shards;
+    for (unsigned k = 0; ok && k < shards; ++k) {
+        char file[32], idx[32];
+        shardFile(k, shards, file, sizeof(file));
+        shardIndexFile(k, shards, idx, sizeof(idx));
+        strcat(file, ".split");
+        strcat(idx, ".split");
+        l->shard[k] = shardOpen(file, idx, -1, false, shards);
+        ok = l->shard[k] != NULL;
+    }
+
+    // hold every session for the catch-up and the switch
+    bool switched = false;
+    if (ok) {
+        pthread_once(&g_accountLocksOnce, accountLocksInit);
+        for (int i = 0; i < ACCOUNT_LOCK_STRIPES; ++i) pthread_mutex_lock(&g_accountLocks[i]);
+        pthread_rwlock_wrlock(&g_layoutLock);
+        if (walHold()) {
+            for (unsigned j = 0; j < old->shards; ++j) pthread_rwlock_wrlock(&old->shard[j]->lock);
+            ok = reshardCatchUp(old, l, copied, from, redone);
+            if (ok) {
+                uint32_t was = storeHeader()->shards;
+                ok = reshardSwitch(old, l);
+                switched = storeHeader()->shards != was;
+            }
+            for (unsigned j = old->shards; j-- > 0;) pthread_rwlock_unlock(&old->shard[j]->lock);
+            walUnhold(false);
+        } else {
+            ok = false;
+        }
+        pthread_rwlock_unlock(&g_layoutLock);
+        for (int i = ACCOUNT_LOCK_STRIPES - 1; i >= 0; --i) pthread_mutex_unlock(&g_accountLocks[i]);
+    }
+
+    if (!switched) {
+        layoutFree(l);
+        storeRemoveShards(STORE_MAX_SHARDS, false);   // just the .split files
+        return ok ? ATM_OK : ATM_ERR_IO;
+    }
+    // the old files are still mapped here; removing them only drops the names
+    if (old->shards == 1) remove(indexFile());
+    storeRemoveShards(shards, false);
+    return ok ? ATM_OK : ATM_ERR_IO;
+}
+
+/* *accounts: accounts moved; *redone: journal records laid over them. */
+AtmStatus opReshard(unsigned shards, uint64_t *accounts, long *redone) {
+    *accounts = 0;
+    *redone = 0;
+    if (shards < 2 || shards > STORE_MAX_SHARDS || (shards & (shards - 1)) != 0) return ATM_ERR_SHARDS;
+    if (!g_wal.running) return ATM_ERR_IO;
+
+    // no other process may touch the accounts while they move
+    bool owned = cacheEnabled();
+    if (!owned && !rangeTryLock(g_store.fd, F_WRLCK, LOCK_BYTE_OWNER, 1)) return ATM_ERR_BUSY;
+
+    // the journal stays as it is until the new shards have caught up with it
+    pthread_mutex_lock(&g_backup.mu);
+    __atomic_store_n(&g_backup.running, true, __ATOMIC_RELEASE);
+    StoreLayout *old = storeLayout();
+    AtmStatus st = old->shards == shards ? ATM_OK : reshardRun(old, shards, redone);
+    *accounts = storeCount();
+    __atomic_store_n(&g_backup.running, false, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_backup.mu);
+
+    if (!owned) (void)rangeLock(g_store.fd, F_RDLCK, LOCK_BYTE_OWNER, 1);
+    return st;
+}
+
+int runReshard(unsigned shards) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    unsigned was = storeLayout()->shards;
+    uint64_t accounts;
+    long redone;
+    AtmStatus st = opReshard(shards, &accounts, &redone);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (st != ATM_OK) {
+        printf("%s\n", atmStatusText(st));
+        return 1;
+    }
+
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("✅ Moved %llu account(s) from %u to %u shard(s) (%ld journal record(s) caught up).\n",
+           (unsigned long long)accounts, was, shards, redone);
+    printf("📊 %.3f s\n", secs);
+    return 0;
+}
+
+/* Finishes or undoes a reshard that stopped partway: the shard count in
+   accounts.dat's header says which layout is current. Renames the current
+   layout's .split files into place, drops the rest, and drops files of
+   shards past the count. Needs the files to itself; otherwise it waits for
+   a later open. */
+static void reshardRecover(void) {
+    unsigned shards = g_store.header->shards ? g_store.header->shards : 1;
+    if (shards > STORE_MAX_SHARDS || (shards & (shards - 1)) != 0) return;
+    if (!rangeTryLock(g_store.fd, F_WRLCK, LOCK_BYTE_OWNER, 1)) return;
+
+    bool tidy = true;
+    for (unsigned k = 0; shards > 1 && k < shards; ++k) {
+        char file[32], idx[32], split[48];
+        StoreHeader h;
+        shardFile(k, shards, file, sizeof(file));
+        shardIndexFile(k, shards, idx, sizeof(idx));
+        snprintf(split, sizeof(split), "%s.split", file);
+        int fd = ioOpen(split, O_RDONLY);
+        if (fd < 0) continue;
+        bool current = ioPread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) &&
+                       h.magic == STORE_MAGIC && h.shards == shards;
+        close(fd);
+        if (!current) continue;   // an undone reshard's: removed below
+        if (rename(split, file) != 0) { tidy = false; continue; }
+        snprintf(split, sizeof(split), "%s.split", idx);
+        if (rename(split, idx) != 0) remove(idx);
+    }
+
+    // records a move to several shards left behind in accounts.dat
+    struct stat st;
+    if (shards > 1 && fstat(g_store.fd, &st) == 0 && st.st_size > (off_t)sizeof(StoreHeader)) {
+        g_store.header->count = 0;
+        if (ioMsync(g_store.header, sizeof(StoreHeader), MS_SYNC) == 0) {
+            (void)ftruncate(g_store.fd, (off_t)sizeof(StoreHeader));
+            remove(indexFile());
         }
     }
+    if (tidy) storeRemoveShards(shards == 1 ? 0 : shards, false);
+    (void)rangeLock(g_store.fd, F_UNLCK, LOCK_BYTE_OWNER, 1);
 }
 
 /* ======================= Seed Sample Accounts ======================= */
 void createSampleAccounts(void) {
-    FILE *fp = fopen(accountsFile(), "wb");
-    if (!fp) {
+    storeClose();   // the files are replaced underneath any live mapping
+    remove(accountsFile());
+    remove(indexFile());
+    remove(journalFile());   // its images belong to the accounts just replaced
+    if (!storeOpen()) {      // a new store, with ATM_SHARDS shards
         printf("Failed to create accounts file.\n");
         exit(1);
     }
 
     Account users[2];
+    memset(users, 0, sizeof(users));
 
     users[0].accountNumber = 1001;
     strcpy(users[0].name, "Alice");
-    users[0].balance = 5000.0;
-    sha256_hex("1234", users[0].pinHash);  // demo PIN 1234
+    users[0].balanceCents = 500000;
+    sha256_digest("1234", users[0].pinHash);  // demo PIN 1234
     users[0].failedAttempts = 0;
     users[0].locked = 0;
 
     users[1].accountNumber = 1002;
     strcpy(users[1].name, "Bob");
-    users[1].balance = 3000.0;
-    sha256_hex("4321", users[1].pinHash);  // demo PIN 4321
+    users[1].balanceCents = 300000;
+    sha256_digest("4321", users[1].pinHash);  // demo PIN 4321
     users[1].failedAttempts = 0;
     users[1].locked = 0;
 
-    if (fwrite(users, sizeof(Account), 2, fp) != 2) {
+    bool taken[2];
+    if (appendAccounts(users, 2, taken) != 2) {
         printf("Failed to write accounts.\n");
-        fclose(fp);
         exit(1);
     }
-    fclose(fp);
     printf("Sample accounts created: [1001/1234], [1002/4321]\n");
 }
 
 /* ======================= main ======================= */
-int main(void) {
+#ifndef ATM_NO_MAIN   // atm_bench.c includes this file and brings its own main
+int main(int argc, char **argv) {
+    bool server = argc > 1 && strcmp(argv[1], "--server") == 0;
+    bool batch = argc > 1 && strcmp(argv[1], "--batch") == 0;
+    bool eod = argc > 2 && strcmp(argv[1], "--eod") == 0;
+    bool reconcile = argc > 1 && strcmp(argv[1], "--reconcile") == 0;
+    bool transfers = argc > 2 && strcmp(argv[1], "--transfers") == 0;
+    bool backup = argc > 2 && strcmp(argv[1], "--backup") == 0;
+    bool restore = argc > 2 && strcmp(argv[1], "--restore") == 0;
+    bool reshard = argc > 2 && strcmp(argv[1], "--reshard") == 0;
+    if (argc > 1 && !server && !batch && !eod && !reconcile && !transfers && !backup && !restore && !reshard) {
+        printf("Usage: %s [--server [socket] [workers] | --batch [file] | --eod <rules> [threads] |\n"
+               "       --reconcile [threads] | --transfers <file> [results] |\n"
+               "       --backup <file> | --restore <file> | --reshard <shards>]\n", argv[0]);
+        return 2;
+    }
     printf("🏦 ATM System (C + OpenSSL)\n");
+    statsWatchSignal();   // before any other thread starts
 
-    // ---- First run ONLY: uncomment the next line to seed demo accounts, then comment again ----
-    createSampleAccounts();
+    // the restore replaces the files itself, before anything maps them
+    if (restore) return runRestore(argv[2]);
 
-    for (;;) {
+    // first run: seed the demo accounts; an existing store is never touched
+    if (access(accountsFile(), F_OK) != 0) createSampleAccounts();
+
+    if (!storeOpen() || !walOpen()) {
+        printf("Failed to open accounts store.\n");
+        return 1;
+    }
+
+    // the server and the admin menu search by name; the batch runs seldom do
+    if (server || (!batch && !eod && !reconcile && !transfers && !backup && !reshard)) nameIndexEnable();
+
+    int rc = 0;
+    if (server) {
+        rc = runServer(argc > 2 ? argv[2] : SERVER_SOCKET_DEFAULT,
+                       argc > 3 ? atoi(argv[3]) : SERVER_WORKERS_DEFAULT);
+    } else if (batch) {
+        rc = runBatch(argc > 2 ? argv[2] : "-");
+    } else if (eod) {
+        rc = runEndOfDay(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+    } else if (reconcile) {
+        rc = runReconcile(argc > 2 ? atoi(argv[2]) : 0);
+    } else if (transfers) {
+        rc = runBulkTransfer(argv[2], argc > 3 ? argv[3] : NULL);
+    } else if (backup) {
+        rc = runBackup(argv[2]);
+    } else if (reshard) {
+        rc = runReshard((unsigned)atoi(argv[2]));
+    }
+    while (!server && !batch && !eod && !reconcile && !transfers && !backup && !reshard) {
         int mode;
         printf("\n1. User Login\n2. Admin\n3. Exit\nChoose: ");
         if (scanf("%d", &mode) != 1) { printf("Invalid input.\n"); flush_line(); continue; }
@@ -652,5 +7778,10 @@ int main(void) {
             printf("Invalid choice.\n");
         }
     }
-    return 0;
+    txlogClose();
+    walClose();
+    storeClose();
+    if (!statsDump()) printf("Could not write %s.\n", statsFile());
+    return rc;
 }
+#endif
@@ -0,0 +1,319 @@
+/*
+ * Microbenchmarks for the ATM storage and auth hot paths.
+ * Build and run:  make bench            (BENCH_OPS=n to change the op count)
+ *            or:  gcc -O2 atm_bench.c -o atm_bench -lcrypto -lpthread && ./atm_bench [ops]
+ *
+ * Every case works on a fresh scratch directory created under the current
+ * one (so fsync costs are those of the disk atm really runs on) and prints
+ * one JSON object per line on stdout:
+ *
+ *   {"case":"loadAccount","accounts":1000,"log_records":0,"ops":10000,
+ *    "ops_per_sec":1234567,"p50_ns":310,"p99_ns":870}
+ *
+ * Progress messages go to stderr, so stdout can be piped straight into a
+ * comparison script.
+ */
+
+#define ATM_NO_MAIN
+#include "atm.c"
+
+#define BENCH_FIRST_ACCOUNT 100000
+#define BENCH_LONG_LOG      1000000L   // records in the "long log" statement case
+
+static long      g_benchOps = 10000;
+static uint64_t *g_samples;
+static uint64_t  g_rng = 0x9E3779B97F4A7C15ull;
+static char      g_benchDir[64];
+
+static uint64_t nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t benchRand(void) {
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng;
+}
+
+static int randomAccount(long accounts) {
+    return BENCH_FIRST_ACCOUNT + (int)(benchRand() % (uint64_t)accounts);
+}
+
+static int cmpU64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Prints one result line from the g_samples[0..ops) latencies. */
+static void report(const char *name, long ops, uint64_t wallNs) {
+    txlogDrain();   // so log_records counts what the writer thread still holds
+    if (ops <= 0) {
+        fprintf(stderr, "%s: no samples taken\n", name);
+        return;
+    }
+    qsort(g_samples, (size_t)ops, sizeof(uint64_t), cmpU64);
+    long p99 = ops * 99 / 100;
+    if (p99 >= ops) p99 = ops - 1;
+    int64_t logRecords = g_txlog.fd >= 0 ? g_txlog.endPos : 0;
+    printf("{\"case\":\"%s\",\"accounts\":%zu,\"log_records\":%lld,\"ops\":%ld,"
+           "\"ops_per_sec\":%.0f,\"p50_ns\":%llu,\"p99_ns\":%llu}\n",
+           name, storeCount(), (long long)logRecords, ops,
+           wallNs ? (double)ops * 1e9 / (double)wallNs : 0.0,
+           (unsigned long long)g_samples[ops / 2], (unsigned long long)g_samples[p99]);
+    fflush(stdout);
+}
+
+/* ======================= Scratch Directory ======================= */
+/* Closes everything atm.c has open and deletes the scratch directory. */
+static void benchLeave(void) {
+    txlogClose();
+    walClose();
+    storeClose();
+    DIR *d = opendir(".");
+    if (d) {
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL) {
+            if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) remove(e->d_name);
+        }
+        closedir(d);
+    }
+    if (chdir("..") != 0 || rmdir(g_benchDir) != 0) fprintf(stderr, "could not remove %s\n", g_benchDir);
+}
+
+/* Writes the header and `accounts` records straight to accounts.dat, then
+   opens the store (which builds the index) and the journal. */
+static bool benchSeed(long accounts) {
+    FILE *fp = fopen(accountsFile(), "wb");
+    if (!fp) return false;
+
+    StoreHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = STORE_MAGIC;
+    h.version = STORE_VERSION;
+    h.headerSize = sizeof(StoreHeader);
+    h.recordSize = sizeof(Account);
+    h.count = (uint64_t)accounts;
+    if (fwrite(&h, sizeof(h), 1, fp) != 1) { fclose(fp); return false; }
+
+    Account a;
+    memset(&a, 0, sizeof(a));
+    strcpy(a.name, "Bench");
+    a.balanceCents = 100000000;
+    if (!sha256_digest("1234", a.pinHash)) { fclose(fp); return false; }
+    for (long i = 0; i < accounts; ++i) {
+        a.accountNumber = BENCH_FIRST_ACCOUNT + (int)i;
+        if (fwrite(&a, sizeof(a), 1, fp) != 1) { fclose(fp); return false; }
+    }
+    if (fclose(fp) != 0) return false;
+    return storeOpen() && walOpen();
+}
+
+/* Enters a fresh scratch directory seeded with `accounts` accounts. On
+   failure the directory is removed again and we are back where we were. */
+static bool benchStart(long accounts) {
+    strcpy(g_benchDir, "atm_bench.XXXXXX");
+    if (!mkdtemp(g_benchDir)) return false;
+    if (chdir(g_benchDir) != 0) {
+        rmdir(g_benchDir);
+        return false;
+    }
+    if (benchSeed(accounts)) return true;
+    benchLeave();
+    return false;
+}
+
+static int benchAbort(long accounts) {
+    fprintf(stderr, "could not seed %ld accounts\n", accounts);
+    free(g_samples);
+    return 1;
+}
+
+/* ======================= Cases ======================= */
+static void benchSha256(void) {
+    uint8_t digest[32];
+    uint64_t t0 = nowNs();
+    for (long i = 0; i < g_benchOps; ++i) {
+        uint64_t s = nowNs();
+        (void)sha256_digest("1234", digest);
+        g_samples[i] = nowNs() - s;
+    }
+    report("sha256", g_benchOps, nowNs() - t0);
+}
+
+static void benchLoad(long accounts) {
+    Account a;
+    uint64_t t0 = nowNs();
+    for (long i = 0; i < g_benchOps; ++i) {
+        int acc = randomAccount(accounts);
+        uint64_t s = nowNs();
+        (void)loadAccount(acc, &a);
+        g_samples[i] = nowNs() - s;
+    }
+    report("loadAccount", g_benchOps, nowNs() - t0);
+}
+
+/* Lookups of numbers no account has, as mistyped logins make. */
+static void benchMiss(long accounts) {
+    Account a;
+    uint64_t t0 = nowNs();
+    for (long i = 0; i < g_benchOps; ++i) {
+        int acc = randomAccount(accounts) + (int)accounts;
+        uint64_t s = nowNs();
+        (void)loadAccount(acc, &a);
+        g_samples[i] = nowNs() - s;
+    }
+    report("loadAccount_miss", g_benchOps, nowNs() - t0);
+}
+
+static void benchUpdate(long accounts, const char *name) {
+    Account a;
+    long taken = 0;   // a failed load takes no sample
+    uint64_t t0 = nowNs();
+    for (long i = 0; i < g_benchOps; ++i) {
+        if (!loadAccount(randomAccount(accounts), &a)) continue;
+        a.balanceCents += 100;
+        uint64_t s = nowNs();
+        (void)updateAccount(&a);
+        g_samples[taken++] = nowNs() - s;
+    }
+    report(name, taken, nowNs() - t0);
+}
+
+static void benchTransfer(long accounts, const char *name) {
+    long taken = 0;
+    uint64_t t0 = nowNs();
+    for (long i = 0; i < g_benchOps; ++i) {
+        Account user;
+        int from = randomAccount(accounts), to = randomAccount(accounts);
+        if (to == from) to = from == BENCH_FIRST_ACCOUNT ? from + 1 : from - 1;
+        if (!loadAccount(from, &user)) continue;
+        uint64_t s = nowNs();
+        (void)opTransfer(&user, to, 0.01);
+        g_samples[taken++] = nowNs() - s;
+    }
+    report(name, taken, nowNs() - t0);
+}
+
+static void benchLogAppend(long accounts) {
+    Account a;
+    if (!loadAccount(BENCH_FIRST_ACCOUNT, &a)) return;
+    uint64_t t0 = nowNs();
+    for (long i = 0; i < g_benchOps; ++i) {
+        a.accountNumber = randomAccount(accounts);
+        uint64_t s = nowNs();
+        logTransaction(&a, TX_DEPOSIT, 100, NULL);
+        g_samples[i] = nowNs() - s;
+    }
+    report("logTransaction", g_benchOps, nowNs() - t0);
+}
+
+/* Statement for an account whose last few records sit among `logRecords`
+   records of other accounts. */
+static void benchStatement(long accounts, long logRecords) {
+    Account a;
+    if (!loadAccount(BENCH_FIRST_ACCOUNT, &a)) return;
+    for (long i = 0; i < logRecords; ++i) {
+        a.accountNumber = i % 100 == 0 ? BENCH_FIRST_ACCOUNT : randomAccount(accounts);
+        logTransaction(&a, TX_DEPOSIT, 100, NULL);
+    }
+
+    FILE *sink = fopen("/dev/null", "w");
+    if (!sink) return;
+    uint64_t t0 = nowNs();
+    for (long i = 0; i < g_benchOps; ++i) {
+        uint64_t s = nowNs();
+        writeMiniStatement(sink, "", BENCH_FIRST_ACCOUNT, 5);
+        g_samples[i] = nowNs() - s;
+    }
+    report(logRecords > 1000 ? "miniStatement_long" : "miniStatement_short", g_benchOps, nowNs() - t0);
+    fclose(sink);
+}
+
+/* One day of CSV from an account whose records are among `logRecords`
+   records spread a minute apart, the day picked at random. */
+static void benchStatementRange(long accounts, long logRecords) {
+    TxRecord batch[TXRING_BATCH];
+    int64_t start = (int64_t)time(NULL) - logRecords * 60;
+    for (long i = 0; i < logRecords;) {
+        int n = 0;
+        for (; n < TXRING_BATCH && i < logRecords; ++n, ++i) {
+            memset(&batch[n], 0, sizeof(TxRecord));
+            batch[n].accountNumber = i % 100 == 0 ? BENCH_FIRST_ACCOUNT : randomAccount(accounts);
+            batch[n].type = TX_DEPOSIT;
+            batch[n].timestamp = start + i * 60;
+            batch[n].amountCents = 100;
+        }
+        if (!txlogAppendBatch(batch, n)) return;
+    }
+
+    FILE *sink = fopen("/dev/null", "w");
+    if (!sink) return;
+    long days = logRecords / 1440 > 0 ? logRecords / 1440 : 1;
+    StmtQuery q = { 0, 0, 0, STMT_CSV };
+    uint64_t t0 = nowNs();
+    for (long i = 0; i < g_benchOps; ++i) {
+        long found;
+        q.from = start + (int64_t)(benchRand() % (uint64_t)days) * 86400;
+        q.to = q.from + 86399;
+        uint64_t s = nowNs();
+        (void)writeStatementRange(sink, "", BENCH_FIRST_ACCOUNT, &q, &found);
+        g_samples[i] = nowNs() - s;
+    }
+    report("statementRange_day", g_benchOps, nowNs() - t0);
+    fclose(sink);
+}
+
+/* ======================= main ======================= */
+int main(int argc, char **argv) {
+    if (argc > 1) g_benchOps = atol(argv[1]);
+    if (g_benchOps <= 0) {
+        fprintf(stderr, "Usage: %s [ops]\n", argv[0]);
+        return 2;
+    }
+    g_samples = malloc((size_t)g_benchOps * sizeof(uint64_t));
+    if (!g_samples) return 1;
+
+    benchSha256();
+
+    static const long sizes[] = { 1000, 100000, 1000000 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        fprintf(stderr, "seeding %ld accounts...\n", sizes[i]);
+        if (!benchStart(sizes[i])) return benchAbort(sizes[i]);
+        benchLoad(sizes[i]);
+        benchMiss(sizes[i]);
+        benchUpdate(sizes[i], "updateAccount");
+        benchTransfer(sizes[i], "transfer");
+        benchLeave();
+    }
+
+    // the same paths through the write-back cache (ATM_CACHE_KB)
+    setenv("ATM_CACHE_KB", "4096", 1);
+    if (!benchStart(100000)) return benchAbort(100000);
+    benchUpdate(100000, "updateAccount_cached");
+    benchTransfer(100000, "transfer_cached");
+    benchLeave();
+    unsetenv("ATM_CACHE_KB");
+
+    if (!benchStart(1000)) return benchAbort(1000);
+    benchLogAppend(1000);
+    benchLeave();
+
+    static const long logs[] = { 100, BENCH_LONG_LOG };
+    for (size_t i = 0; i < sizeof(logs) / sizeof(logs[0]); ++i) {
+        fprintf(stderr, "writing a %ld record log...\n", logs[i]);
+        if (!benchStart(1000)) return benchAbort(1000);
+        benchStatement(1000, logs[i]);
+        benchLeave();
+    }
+
+    fprintf(stderr, "writing a %ld record log over %ld days...\n", BENCH_LONG_LOG, BENCH_LONG_LOG / 1440);
+    if (!benchStart(1000)) return benchAbort(1000);
+    benchStatementRange(1000, BENCH_LONG_LOG);
+    benchLeave();
+
+    free(g_samples);
+    return 0;
+}
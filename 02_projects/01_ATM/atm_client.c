@@ -0,0 +1,494 @@
+/*
+ * ATM client for the ATM server (atm --server).
+ * Build (Linux/macOS):  gcc atm_client.c -o atm_client
+ * Usage: ./atm_client [socket]     (default socket: atm.sock)
+ *
+ * Shows the same menus as the interactive atm program, but every operation is
+ * sent to the server as one command line and the server's reply is printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define ACCOUNT_NAME_MAX 15   /* characters the server keeps of a name */
+
+static FILE *g_in;       // replies from the server
+static FILE *g_out;      // commands to the server
+static FILE *g_listing;  // where listing lines go instead of stdout, if set
+
+/* ======================= Helpers ======================= */
+void flush_line(void) {
+    int c;
+    while ((c = getchar()) != '\n' && c != EOF) { /* discard */ }
+}
+
+/* Hidden input for PIN (no echo) */
+void get_hidden_input(char *buf, size_t sz) {
+    struct termios oldt, newt;
+    tcgetattr(STDIN_FILENO, &oldt);
+    newt = oldt;
+    newt.c_lflag &= ~(ECHO);
+    tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+
+    if (fgets(buf, (int)sz, stdin) == NULL) {
+        buf[0] = '\0';
+    }
+    tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+    // strip newline
+    buf[strcspn(buf, "\r\n")] = '\0';
+    putchar('\n');
+}
+
+/* PINs and names travel as protocol words, so they must not contain spaces. */
+static bool isWord(const char *s) {
+    return *s && strpbrk(s, " \t") == NULL;
+}
+
+/* Sends one command and prints the reply. Returns true for "OK", false for
+   "ERR"; exits if the server went away. */
+static bool request(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(g_out, fmt, ap);
+    va_end(ap);
+    fputc('\n', g_out);
+    if (fflush(g_out) != 0) {
+        printf("Lost connection to the ATM server.\n");
+        exit(1);
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), g_in)) {
+        if (strncmp(line, "+ ", 2) == 0) {
+            fputs(line + 2, g_listing ? g_listing : stdout);
+            continue;
+        }
+        bool ok = strncmp(line, "OK ", 3) == 0;
+        fputs(line + (ok ? 3 : 4), stdout);
+        return ok;
+    }
+    printf("Lost connection to the ATM server.\n");
+    exit(1);
+}
+
+static bool askLine(const char *prompt, char *buf, size_t n) {
+    printf("%s", prompt);
+    if (!fgets(buf, (int)n, stdin)) { printf("Input error.\n"); return false; }
+    buf[strcspn(buf, "\r\n")] = '\0';
+    return true;
+}
+
+/* Asks for the period, types and format of a date-range statement and
+   fills in the words that follow HISTORY [acct]. */
+static bool askHistory(char *words, size_t n) {
+    static const char *const formats[] = { "text", "csv", "json" };
+    char from[32], to[32], types[96], format[16];
+    if (!askLine("From (YYYY-MM-DD, or YYYY-MM for a whole month): ", from, sizeof(from)) ||
+        !askLine("To (Enter = same as From): ", to, sizeof(to)) ||
+        !askLine("Types, e.g. DEPOSIT,WITHDRAW,TRANSFER,PIN-CHG (Enter = all): ", types, sizeof(types)) ||
+        !askLine("Format: 1. Text  2. CSV  3. JSON (Enter = text): ", format, sizeof(format))) {
+        return false;
+    }
+    int f = format[0] ? atoi(format) : 1;
+    if (!isWord(from) || (to[0] && !isWord(to)) || (types[0] && !isWord(types)) || f < 1 || f > 3) {
+        printf("Invalid input.\n");
+        return false;
+    }
+    snprintf(words, n, "%s %s %s %s", from, to[0] ? to : from, formats[f - 1], types);
+    return true;
+}
+
+/* Like request() but prints nothing on success (pre-checks before a prompt). */
+static bool check(const char *fmt, int arg) {
+    fprintf(g_out, fmt, arg);
+    fputc('\n', g_out);
+    fflush(g_out);
+
+    char line[1024];
+    if (!fgets(line, sizeof(line), g_in)) {
+        printf("Lost connection to the ATM server.\n");
+        exit(1);
+    }
+    if (strncmp(line, "OK ", 3) == 0) return true;
+    fputs(line + 4, stdout);
+    return false;
+}
+
+/* ======================= Customer ======================= */
+static void deposit(void) {
+    double amount;
+    printf("Enter deposit amount: ");
+    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    (void)request("DEPOSIT %.2f", amount);
+}
+
+static void withdraw(void) {
+    double amount;
+    printf("Enter withdrawal amount: ");
+    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    (void)request("WITHDRAW %.2f", amount);
+}
+
+static void changePin(void) {
+    char oldpin[64], newpin1[64], newpin2[64];
+
+    printf("Enter current PIN (hidden): ");
+    get_hidden_input(oldpin, sizeof(oldpin));
+    printf("Enter new PIN (hidden): ");
+    get_hidden_input(newpin1, sizeof(newpin1));
+    printf("Confirm new PIN (hidden): ");
+    get_hidden_input(newpin2, sizeof(newpin2));
+
+    if (strcmp(newpin1, newpin2) != 0) {
+        printf("❌ PINs do not match.\n");
+        return;
+    }
+    if (!isWord(oldpin) || !isWord(newpin1)) {
+        printf("❌ PINs cannot contain spaces.\n");
+        return;
+    }
+    (void)request("CHPIN %s %s", oldpin, newpin1);
+}
+
+static void transferFunds(void) {
+    int toAcc;
+    double amount;
+    printf("Enter target Account Number: ");
+    if (scanf("%d", &toAcc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    if (!check("TARGET %d", toAcc)) return;
+
+    printf("Enter amount to transfer: ");
+    if (scanf("%lf", &amount) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    (void)request("TRANSFER %d %.2f", toAcc, amount);
+}
+
+static void statementByDate(void) {
+    char words[256];
+    if (!askHistory(words, sizeof(words))) return;
+    putchar('\n');
+    (void)request("HISTORY %s", words);
+}
+
+static void atmMenu(void) {
+    for (;;) {
+        int choice;
+        printf("\n--- ATM Menu ---\n");
+        printf("1. Balance Inquiry\n");
+        printf("2. Deposit\n");
+        printf("3. Withdraw\n");
+        printf("4. Change PIN\n");
+        printf("5. Transfer Funds\n");
+        printf("6. Mini Statement (last 5)\n");
+        printf("7. Statement by Date\n");
+        printf("8. Exit\n");
+        printf("Enter choice: ");
+        if (scanf("%d", &choice) != 1) { printf("Invalid input.\n"); flush_line(); continue; }
+        flush_line();
+
+        switch (choice) {
+            case 1: (void)request("BALANCE"); break;
+            case 2: deposit(); break;
+            case 3: withdraw(); break;
+            case 4: changePin(); break;
+            case 5: transferFunds(); break;
+            case 6: putchar('\n'); (void)request("STATEMENT 5"); break;
+            case 7: statementByDate(); break;
+            case 8: (void)request("LOGOUT"); return;
+            default: printf("Invalid choice.\n");
+        }
+    }
+}
+
+static bool login(void) {
+    int accNo;
+    printf("\nEnter Account Number: ");
+    if (scanf("%d", &accNo) != 1) { printf("Invalid input.\n"); flush_line(); return false; }
+    flush_line();
+    if (!check("CHECK %d", accNo)) return false;
+
+    char pin[64];
+    printf("Enter PIN (hidden): ");
+    get_hidden_input(pin, sizeof(pin));
+    if (!isWord(pin)) { printf("❌ Invalid PIN.\n"); return false; }
+
+    putchar('\n');
+    return request("LOGIN %d %s", accNo, pin);
+}
+
+/* ======================= Admin ======================= */
+static void adminCreateAccount(void) {
+    int accNo;
+    char name[50], pin[64];
+    double balance;
+
+    printf("\n--- Create Account ---\n");
+    printf("Enter new Account Number: ");
+    if (scanf("%d", &accNo) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    if (!check("FREE %d", accNo)) return;
+
+    printf("Enter name (max %d characters): ", ACCOUNT_NAME_MAX);
+    if (!fgets(name, sizeof(name), stdin)) { printf("Input error.\n"); return; }
+    name[strcspn(name, "\r\n")] = '\0';
+    if (!name[0]) { printf("Invalid input.\n"); return; }
+    if (strlen(name) > ACCOUNT_NAME_MAX) { printf("❌ Name too long (max %d characters).\n", ACCOUNT_NAME_MAX); return; }
+
+    printf("Enter initial PIN (hidden, min 4): ");
+    get_hidden_input(pin, sizeof(pin));
+    if (!isWord(pin)) { printf("❌ PINs cannot contain spaces.\n"); return; }
+
+    printf("Enter initial balance: ");
+    if (scanf("%lf", &balance) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    (void)request("CREATE %d %s %.2f %s", accNo, pin, balance, name);
+}
+
+static void adminAccountCommand(const char *prompt, const char *cmd) {
+    int acc;
+    printf("%s", prompt);
+    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    (void)request("%s %d", cmd, acc);
+}
+
+static void adminResetPin(void) {
+    int acc;
+    char newpin[64];
+
+    printf("Enter account to reset PIN: ");
+    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    printf("Enter new PIN (hidden, min 4): ");
+    get_hidden_input(newpin, sizeof(newpin));
+    if (!isWord(newpin)) { printf("❌ PINs cannot contain spaces.\n"); return; }
+    (void)request("RESETPIN %d %s", acc, newpin);
+}
+
+static void adminExportLog(void) {
+    int acc;
+    char path[128];
+
+    printf("Account to export (0 = all): ");
+    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    printf("Output file (on the server): ");
+    if (!fgets(path, sizeof(path), stdin)) { printf("Input error.\n"); return; }
+    path[strcspn(path, "\r\n")] = '\0';
+    if (!isWord(path)) { printf("❌ No file name given.\n"); return; }
+    (void)request("EXPORT %d %s", acc, path);
+}
+
+static void adminImportAccounts(void) {
+    char path[128];
+
+    printf("CSV file on the server (number,name,pin,balance per line): ");
+    if (!fgets(path, sizeof(path), stdin)) { printf("Input error.\n"); return; }
+    path[strcspn(path, "\r\n")] = '\0';
+    if (!isWord(path)) { printf("❌ No file name given.\n"); return; }
+    (void)request("IMPORT %s", path);
+}
+
+static void adminBackup(void) {
+    char path[128];
+
+    printf("Backup file (on the server): ");
+    if (!fgets(path, sizeof(path), stdin)) { printf("Input error.\n"); return; }
+    path[strcspn(path, "\r\n")] = '\0';
+    if (!isWord(path)) { printf("❌ No file name given.\n"); return; }
+    (void)request("BACKUP %s", path);
+}
+
+static void adminReshard(void) {
+    int shards;
+
+    printf("New shard count (a power of two, 2 to 64): ");
+    if (scanf("%d", &shards) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    (void)request("RESHARD %d", shards);
+}
+
+static void adminSearchAccounts(void) {
+    char name[64], line[32];
+
+    printf("Name starts with (max %d characters, Enter = all): ", ACCOUNT_NAME_MAX);
+    if (!fgets(name, sizeof(name), stdin)) { printf("Input error.\n"); return; }
+    name[strcspn(name, "\r\n")] = '\0';
+
+    for (int page = 1; page > 0;) {
+        putchar('\n');
+        if (!request("SEARCH %d %s", page, name)) return;
+        printf("Page to show (Enter = done): ");
+        if (!fgets(line, sizeof(line), stdin)) return;
+        page = atoi(line);
+    }
+}
+
+static void adminReports(void) {
+    static const char *const which[] = { "all", "locked", "attempts" };
+    static const char *const order[] = { "top", "bottom", "attempts", "number" };
+    int w, o;
+    char line[32];
+
+    putchar('\n');
+    if (!request("REPORT")) return;
+
+    printf("\nList: 1. All accounts  2. Locked  3. Failed PIN attempts  0. Done\nChoose: ");
+    if (scanf("%d", &w) != 1 || w < 1 || w > 3) { flush_line(); return; }
+    flush_line();
+    printf("Order: 1. Highest balance  2. Lowest balance  3. Most failed attempts  4. Number\nChoose: ");
+    if (scanf("%d", &o) != 1 || o < 1 || o > 4) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+
+    for (int page = 1; page > 0;) {
+        putchar('\n');
+        if (!request("REPORT %s %s %d", which[w - 1], order[o - 1], page)) return;
+        printf("Page to show (Enter = done): ");
+        if (!fgets(line, sizeof(line), stdin)) return;
+        page = atoi(line);
+    }
+}
+
+/* The listing can be saved to a file on this side of the connection. */
+static void adminAccountHistory(void) {
+    int acc;
+    char words[256], path[128];
+
+    printf("Account: ");
+    if (scanf("%d", &acc) != 1) { printf("Invalid input.\n"); flush_line(); return; }
+    flush_line();
+    if (!askHistory(words, sizeof(words)) || !askLine("Save to a local file (Enter = screen): ", path, sizeof(path))) {
+        return;
+    }
+    if (path[0] && !(g_listing = fopen(path, "w"))) { printf("❌ Cannot write %s.\n", path); return; }
+    if (!path[0]) putchar('\n');
+
+    bool ok = request("HISTORY %d %s", acc, words);
+    if (g_listing) {
+        if (fclose(g_listing) != 0) ok = false;
+        g_listing = NULL;
+        printf(ok ? "✅ Saved to %s.\n" : "❌ %s may be incomplete.\n", path);
+    }
+}
+
+static void adminMenu(void) {
+    char pass[64];
+    printf("\n--- Admin Login ---\nPassword (hidden): ");
+    get_hidden_input(pass, sizeof(pass));
+    if (!isWord(pass)) { printf("❌ Wrong admin password.\n"); return; }
+    if (!request("ADMIN %s", pass)) return;
+
+    for (;;) {
+        int ch;
+        printf("\n--- Admin Menu ---\n");
+        printf("1. Create Account\n");
+        printf("2. List Accounts\n");
+        printf("3. Unlock Account\n");
+        printf("4. Reset PIN\n");
+        printf("5. Export Transaction Log\n");
+        printf("6. Import Accounts (CSV)\n");
+        printf("7. Statistics\n");
+        printf("8. Backup Accounts\n");
+        printf("9. Reshard Accounts\n");
+        printf("10. Search Accounts by Name\n");
+        printf("11. Reports\n");
+        printf("12. Account History (CSV/JSON)\n");
+        printf("13. Exit Admin\n");
+        printf("Enter choice: ");
+        if (scanf("%d", &ch) != 1) { printf("Invalid input.\n"); flush_line(); continue; }
+        flush_line();
+
+        switch (ch) {
+            case 1: adminCreateAccount(); break;
+            case 2: putchar('\n'); (void)request("LIST"); break;
+            case 3: adminAccountCommand("Enter account to unlock: ", "UNLOCK"); break;
+            case 4: adminResetPin(); break;
+            case 5: adminExportLog(); break;
+            case 6: adminImportAccounts(); break;
+            case 7: putchar('\n'); (void)request("STATS"); break;
+            case 8: adminBackup(); break;
+            case 9: adminReshard(); break;
+            case 10: adminSearchAccounts(); break;
+            case 11: adminReports(); break;
+            case 12: adminAccountHistory(); break;
+            case 13: (void)request("LOGOUT"); return;
+            default: printf("Invalid choice.\n");
+        }
+    }
+}
+
+/* ======================= main ======================= */
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "atm.sock";
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) { printf("Socket path too long.\n"); return 1; }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        printf("Cannot connect to the ATM server at %s.\n", path);
+        return 1;
+    }
+    g_in = fdopen(fd, "r");
+    g_out = fdopen(dup(fd), "w");
+    if (!g_in || !g_out) { printf("Connection setup failed.\n"); return 1; }
+
+    // greeting
+    char line[1024];
+    if (!fgets(line, sizeof(line), g_in)) {
+        printf("Lost connection to the ATM server.\n");
+        return 1;
+    }
+    if (strncmp(line, "OK ", 3) != 0) {
+        fputs(line, stdout);
+        return 1;
+    }
+    fputs(line + 3, stdout);
+
+    for (;;) {
+        int mode;
+        printf("\n1. User Login\n2. Admin\n3. Exit\nChoose: ");
+        if (scanf("%d", &mode) != 1) {
+            if (feof(stdin)) break;
+            printf("Invalid input.\n");
+            flush_line();
+            continue;
+        }
+        flush_line();
+
+        if (mode == 1) {
+            if (!login()) {
+                printf("Exiting to main menu.\n");
+                continue;
+            }
+            atmMenu();
+        } else if (mode == 2) {
+            adminMenu();
+        } else if (mode == 3) {
+            break;
+        } else {
+            printf("Invalid choice.\n");
+        }
+    }
+    (void)request("QUIT");
+    fclose(g_out);
+    fclose(g_in);
+    return 0;
+}